@@ -0,0 +1,16 @@
+#pragma once
+#include <cmd_parser.h>
+#include <cstddef>
+#include <cstdio>
+
+// Runs the list and compress jobs of a manifest, one command line per line
+// (as given to this program, without its name; blank lines and lines
+// starting with '#' are ignored), on one shared scheduler running at most
+// `concurrency` jobs at a time. Compress jobs all run first. List jobs
+// reading the same archives are merged into one scan.
+// Listings without --output wait in a temporary file, then go to stdout
+// whole, one job at a time, so memory does not grow with them; a result
+// line per job goes to stderr. Jobs may not write the same --output file,
+// and at most one may read a list of inputs from stdin, none if the manifest
+// is read from it. Returns 0 when every job succeeded.
+auto run_batch(const cmd::Parser& parser, std::FILE* manifest, std::size_t concurrency) -> int;
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+
+struct BenchOptions {
+    // Bytes taken from the inputs, spread over all their files
+    std::uint64_t sample_size = 16 << 20;
+    // Compressed independently, which is what lets several cores share the work
+    std::size_t block_size = 1 << 20;
+    std::optional<std::string_view> codec;
+    // Filter chain run in front of every codec, see zfiles::make_filter_chain()
+    std::optional<std::string_view> filter;
+    bool json = false;
+};
+
+// Compresses a sample of `inputs` with every codec and level, then prints
+// ratio, compress and decompress speed, peak memory and the Pareto front of
+// speed against ratio, plus how compression at the default level scales
+// with threads. With a filter chain, the throughput of each stage comes first.
+auto run_bench(std::span<const std::string_view> inputs, const BenchOptions& options) -> int;
@@ -1,10 +1,14 @@
 #pragma once
 #include <string_view>
 #include <optional>
-#include <functional>
 #include <vector>
+#include "function_ref.h"
+#include "types.h"
 namespace cmd::config
 {
+    // A plain function or a captureless lambda, kept by pointer
+    using Validator = utils::FunctionRef<bool(std::string_view)>;
+
     template <class CRTP>
     struct Common {
         std::string_view longname;
@@ -40,7 +44,7 @@ namespace cmd::config
         MinMax(uint32_t max) : max(max)
         {}
 
-        constexpr CRTP& set_max(int max) noexcept {
+        constexpr CRTP& set_max(uint32_t max) noexcept {
             this->max = max;
             return *static_cast<CRTP*>(this);
         }
@@ -48,7 +52,9 @@ namespace cmd::config
 
     struct Argument : Common<Argument> {
         std::optional<std::string_view> metavar;
-        std::optional<std::function<bool(std::string_view)>> validator;
+        std::optional<Validator> validator;
+        // Converted once while parsing, after the validator
+        std::optional<types::Type> type = std::nullopt;
         std::optional<std::string_view> default_value = std::nullopt;
         bool required=false;
 
@@ -66,10 +72,14 @@ namespace cmd::config
             this->metavar = metavar;
             return *this;
         }
-        Argument& set_validator(std::function<bool(std::string_view)> validator) noexcept {
+        Argument& set_validator(Validator validator) noexcept {
             this->validator = validator;
             return *this;
         }
+        constexpr Argument& set_type(types::Type type) noexcept {
+            this->type = type;
+            return *this;
+        }
         constexpr Argument& set_default_value(std::string_view default_value) noexcept {
             this->default_value = default_value;
             return *this;
@@ -96,8 +106,10 @@ namespace cmd::config
 
     struct Command : Common<Command> {
         std::vector<Argument> arguments;
-        std::optional<std::function<bool(std::string_view)>> input_validator;
+        std::optional<Validator> input_validator;
         std::vector<Flag> flags;
+        // Inputs may also be listed in files, given as @FILE or --files-from=FILE (- for stdin)
+        bool input_files = false;
         // std::vector<Command> subcommands;
 
         Command(std::string_view longname) : Common(longname)
@@ -120,10 +132,14 @@ namespace cmd::config
             flags.push_back(flag);
             return *this;
         }
-        Command& set_input_validator(std::function<bool(std::string_view)> validator) {
+        Command& set_input_validator(Validator validator) {
             input_validator = validator;
             return *this;
         }
+        Command& set_input_files(bool accepted) {
+            input_files = accepted;
+            return *this;
+        }
         Argument& make_argument(std::string_view longname, std::optional<char32_t> shortname = std::nullopt) {
             return add_argument(Argument(longname, shortname)).arguments.back();
         }
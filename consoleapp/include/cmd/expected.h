@@ -1,4 +1,5 @@
 #pragma once
+#include <version>
 #ifdef __cpp_lib_expected
 #include <expected>
 template <class T, class E>
@@ -0,0 +1,28 @@
+#pragma once
+#include <concepts>
+#include <type_traits>
+#include <utility>
+
+namespace cmd::utils
+{
+    template <class Signature>
+    class FunctionRef;
+
+    // Reference to a function: one pointer, no allocation, one indirect
+    // call. Only plain functions and captureless lambdas are accepted, kept
+    // by pointer, so that the reference can never outlive what it calls; a
+    // callable with state does not compile.
+    template <class R, class... Args>
+    class FunctionRef<R(Args...)> {
+        R (*function)(Args...);
+    public:
+        FunctionRef(R (*function)(Args...)) noexcept : function(function) {}
+        template <class F>
+            requires (!std::same_as<std::remove_cvref_t<F>, FunctionRef> && std::is_convertible_v<const F&, R (*)(Args...)>)
+        FunctionRef(const F& callable) noexcept : function(callable) {}
+
+        R operator()(Args... args) const {
+            return function(std::forward<Args>(args)...);
+        }
+    };
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace cmd::utils
+{
+    // Inputs listed in a file, or on stdin for "-": one per line, or one per
+    // NUL-terminated record when the list holds a NUL byte, as written by
+    // find -print0. Regular files are mapped; other streams are read into
+    // buffers that are never moved, and published up to their last complete
+    // record. The records handed out point into either, so the list has to
+    // outlive them.
+    class InputFile {
+    public:
+        // Position of the next record
+        struct Cursor {
+            std::size_t block = 0;
+            std::size_t offset = 0;
+        };
+
+        // nullptr if the file cannot be read. A stream opened with `whole`
+        // false is only read as far as more() is called.
+        static auto open(std::string_view path, bool whole = true) -> std::shared_ptr<InputFile>;
+
+        InputFile() = default;
+        InputFile(const InputFile&) = delete;
+        InputFile& operator=(const InputFile&) = delete;
+        ~InputFile();
+
+        // Reads the next block of a stream; false at its end, or on an error.
+        auto more() -> bool;
+        auto failed() const -> bool {
+            return read_failed;
+        }
+        // Upper bound of the number of records read so far, to size what receives them
+        auto count() const -> std::size_t {
+            auto separators = std::size_t{0};
+            for (auto block : blocks)
+                separators += static_cast<std::size_t>(std::count(block.begin(), block.end(), separator)) + 1;
+            return separators;
+        }
+        // Next non-empty record read so far, moving the cursor past it
+        auto next(Cursor& cursor) const -> std::optional<std::string_view> {
+            for (; cursor.block < blocks.size(); ++cursor.block, cursor.offset = 0) {
+                auto const block = blocks[cursor.block];
+                while (cursor.offset < block.size()) {
+                    auto const end = std::min(block.find(separator, cursor.offset), block.size());
+                    auto record = block.substr(cursor.offset, end - cursor.offset);
+                    cursor.offset = end + 1;
+                    if (separator == '\n' && record.ends_with('\r'))
+                        record.remove_suffix(1);
+                    if (!record.empty())
+                        return record;
+                }
+            }
+            return std::nullopt;
+        }
+        // Calls `visit` with each record read so far, in order, until it returns false.
+        template <class Visitor>
+        auto for_each(Visitor&& visit) const -> bool {
+            auto cursor = Cursor{};
+            while (auto const record = next(cursor)) {
+                if (!visit(*record))
+                    return false;
+            }
+            return true;
+        }
+
+    private:
+        auto map(int fd, std::size_t size) -> bool;
+
+        std::vector<std::string_view> blocks;
+        std::vector<std::unique_ptr<char[]>> storage;
+        void* mapping = nullptr;
+        std::size_t mapping_size = 0;
+        char separator = '\n';
+        // State of a stream being read
+        int fd = -1;
+        bool owns_fd = false;
+        bool read_failed = false;
+        // The last buffer of `storage` is filled up to `filled`, and its records published up to `published`
+        std::size_t capacity = 0;
+        std::size_t filled = 0;
+        std::size_t published = 0;
+        bool detected = false;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cmd::utils
+{
+    // Name table of a set of commands or options: long names in a sorted flat
+    // map, ASCII short names in a direct table indexed by codepoint, other short
+    // names in a second sorted map. When names collide, the first one added
+    // wins, as with a linear search.
+    template <class Value>
+    class NameIndex {
+        std::vector<std::pair<std::string_view, Value>> longnames;
+        std::array<std::optional<Value>, 128> ascii{};
+        std::vector<std::pair<char32_t, Value>> shortnames;
+    public:
+        void add(std::string_view longname, std::optional<char32_t> shortname, Value value) {
+            longnames.emplace_back(longname, value);
+            if (!shortname)
+                return;
+            if (*shortname < ascii.size()) {
+                if (!ascii[*shortname])
+                    ascii[*shortname] = value;
+            } else {
+                shortnames.emplace_back(*shortname, value);
+            }
+        }
+        // To be called once everything was added, before any find().
+        void build() {
+            auto by_name = [](const auto& a, const auto& b) { return a.first < b.first; };
+            auto same_name = [](const auto& a, const auto& b) { return a.first == b.first; };
+            std::stable_sort(longnames.begin(), longnames.end(), by_name);
+            longnames.erase(std::unique(longnames.begin(), longnames.end(), same_name), longnames.end());
+            std::stable_sort(shortnames.begin(), shortnames.end(), by_name);
+            shortnames.erase(std::unique(shortnames.begin(), shortnames.end(), same_name), shortnames.end());
+        }
+
+        auto find(std::string_view longname) const -> std::optional<Value> {
+            auto found = std::lower_bound(longnames.begin(), longnames.end(), longname, [](const auto& item, std::string_view name) {
+                return item.first < name;
+            });
+            if (found == longnames.end() || found->first != longname)
+                return std::nullopt;
+            return found->second;
+        }
+        auto find(char32_t shortname) const -> std::optional<Value> {
+            if (shortname < ascii.size())
+                return ascii[shortname];
+            auto found = std::lower_bound(shortnames.begin(), shortnames.end(), shortname, [](const auto& item, char32_t name) {
+                return item.first < name;
+            });
+            if (found == shortnames.end() || found->first != shortname)
+                return std::nullopt;
+            return found->second;
+        }
+    };
+
+    // Flag or argument of a command, by its position in config::Command::flags or ::arguments
+    struct Option {
+        enum class Kind {
+            Flag,
+            Argument
+        } kind;
+        std::size_t position;
+    };
+    using OptionIndex = NameIndex<Option>;
+}
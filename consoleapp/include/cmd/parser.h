@@ -1,18 +1,36 @@
 #pragma once
 #include "utils.h"
 #include "config.h"
+#include "lookup.h"
 #include "result.h"
+#include <memory>
+#include <memory_resource>
 
 namespace cmd
 {
+    // The whole configuration has to be done before the first parse: name
+    // lookup tables are built then and kept for the following ones.
     class Parser {
+        using Option = utils::Option;
+        using OptionIndex = utils::OptionIndex;
+        struct Lookup {
+            utils::NameIndex<std::size_t> commands;
+            // Options of each command, in the order of `commands`
+            std::vector<OptionIndex> options;
+            // Options of a global command set by value
+            OptionIndex global_options;
+        };
+
         std::optional<std::variant<config::Command, std::string_view>> global_command;
         std::vector<config::Command> commands;
         std::string_view program_name;
+        // Shared by copies, and at a fixed address that parse results point to
+        mutable std::shared_ptr<const Lookup> lookup;
     public:
         
         Parser& add_command(config::Command command) {
             commands.push_back(command);
+            lookup.reset();
             return *this;
         }
         config::Command& make_command(std::string_view longname, std::optional<char32_t> shortname = std::nullopt) {
@@ -20,13 +38,26 @@ namespace cmd
         }
         Parser& set_global_command(config::Command command) {
             global_command = command;
+            lookup.reset();
             return *this;
         }
         Parser& set_global_command(std::string_view longname) {
             global_command = longname;
+            lookup.reset();
             return *this;
         }
-        auto parse(utils::Iterable<std::string_view> auto args) const -> result::PosExpected<result::Result>;
+        // Name of the command a command line runs, empty if none: a lookup of
+        // its first token, so that a caller can pick between parse() and
+        // stream() without parsing twice.
+        auto command_name(utils::Iterable<std::string_view> auto args) const -> std::string_view;
+        // The result's columns are allocated from `resource`, which has to outlive it.
+        auto parse(utils::Iterable<std::string_view> auto args, std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const -> result::PosExpected<result::Result>;
+
+        // Range of the parameters of a command line, parsed and validated one
+        // at a time as it is iterated; see stream.h.
+        template <class Args>
+        class Stream;
+        auto stream(utils::Iterable<std::string_view> auto args, std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const -> Stream<decltype(args)>;
     private:
         auto get_global_command() const -> std::optional<std::reference_wrapper<const config::Command>> {
             if (!global_command.has_value()) 
@@ -35,25 +66,38 @@ namespace cmd
             if (std::holds_alternative<config::Command>(global_command.value())) 
                 return std::optional{std::ref(std::get<config::Command>(global_command.value()))};
 
-            for (const auto& command : commands) {
-                if (std::get<std::string_view>(global_command.value()) == command.longname) {
-                    return std::optional{std::ref(command)};
-                }
-            }
+            if (auto found = get_lookup().commands.find(std::get<std::string_view>(global_command.value())))
+                return std::optional{std::ref(commands[*found])};
             return std::nullopt;
         }
+        static auto index_options(const config::Command& command) -> OptionIndex;
+        // Path of the input list named by an @FILE or --files-from=FILE token, if the command takes them
+        static auto input_list(const config::Command& command, std::string_view token) -> std::optional<std::string_view>;
+        static auto unreadable_file(std::string_view path) -> result::PositionnedError;
+        // Command named by the token at itarg, which is then moved past it, else the global command
+        template <utils::Iterator<std::string_view> Iter>
+        auto select_command(Iter& itarg, Iter end) const -> std::optional<std::reference_wrapper<const config::Command>>;
+        auto get_lookup() const -> const Lookup&;
+        auto get_options(const config::Command& command) const -> const OptionIndex&;
         template <utils::Iterator<std::string_view> Iter>
         auto parse_long_argument(Iter& itarg, Iter end, const config::Command& command, result::Command& result_command) const -> result::PosExpected<bool>;
         template <utils::Iterator<std::string_view> Iter>
         auto parse_short_argument(Iter& itarg, Iter end, const config::Command& command, result::Command& result_command) const -> result::PosExpected<bool>;
         
-        auto add_argument(result::Command& result_command, const config::Argument& argument, std::string_view name, const std::string_view value) const -> result::PosExpected<bool>;
-        auto add_flag(result::Command& result_command, const config::Flag& flag, std::string_view name) const -> result::PosExpected<bool>;
+        auto add_argument(result::Command& result_command, const config::Command& command, std::size_t position, std::string_view name, const std::string_view value) const -> result::PosExpected<bool>;
+        auto add_flag(result::Command& result_command, const config::Command& command, std::size_t position, std::string_view name) const -> result::PosExpected<bool>;
         auto add_input(result::Command& result_command, const config::Command& command, std::string_view input) const -> result::PosExpected<bool>;
+        // Adds every input listed in the file at `path`, or on stdin for "-"
+        auto add_input_file(result::Command& result_command, const config::Command& command, std::string_view path) const -> result::PosExpected<bool>;
 
-        auto parse_command(utils::Iterable<std::string_view> auto args, const config::Command& command) const -> result::PosExpected<result::Command>;
+        // Parses the token at itarg, and the value after it for a short argument
+        template <utils::Iterator<std::string_view> Iter>
+        auto parse_parameter(Iter& itarg, Iter end, const config::Command& command, result::Command& result_command) const -> result::PosExpected<bool>;
+        auto check_required(const config::Command& command, const result::Command& result_command) const -> result::PosExpected<bool>;
+        auto parse_command(utils::Iterable<std::string_view> auto args, const config::Command& command, std::pmr::memory_resource* resource) const -> result::PosExpected<result::Command>;
 
     };
 }
 
-#include "parser.inl"
\ No newline at end of file
+#include "parser.inl"
+#include "stream.h"
\ No newline at end of file
@@ -7,53 +7,12 @@
 #include <optional>
 #include <string_view>
 #include <variant>
-#include <unordered_set>
 namespace cmd
 {
-    auto Parser::parse(utils::Iterable<std::string_view> auto args) const -> result::PosExpected<result::Result> {
-        result::Result result;
-        result.program = args[0];
+    auto Parser::parse(utils::Iterable<std::string_view> auto args, std::pmr::memory_resource* resource) const -> result::PosExpected<result::Result> {
 
         auto itarg = std::next(args.begin());
-        
-        std::optional<std::reference_wrapper<const config::Command>> current_command = std::nullopt;
-        // Find command
-        // If no argument or starts with a flag, then it is a global command
-        if (itarg == args.end() || std::string_view(*itarg).starts_with("-")) {
-            current_command = this->get_global_command();
-        } else {
-            // Determine if the command name is a shortname (single character) or longname (multiple characters)
-            auto char_len = cmd::utils::uni::utf8_char_length(*itarg);
-            if (!char_len) 
-                return result::make_unexpected(result::PositionnedError{
-                        .error = result::Error{
-                        .argument = "",
-                        .value = std::nullopt,
-                        .type = result::Error::Type::None,
-                        .code = result::Error::Code::BadString
-                    },
-                    .position = std::distance(args.begin(), itarg)
-                });
-            auto found_cmd = commands.end();
-            // If the command name is a single character, then search for a command with that shortname
-            if (char_len.value() <= std::string_view(*itarg).size()) {
-                auto codepoint = cmd::utils::uni::codepoint(*itarg).value();
-                found_cmd = std::find_if(commands.begin(), commands.end(), [codepoint](const config::Command& command) {
-                    return command.shortname == codepoint;
-                });
-            } else {
-                found_cmd = std::find_if(commands.begin(), commands.end(), [&](const config::Command& command) {
-                    return command.longname == *itarg;
-                });
-            }
-            // If the command was not found, then return an error
-            if (found_cmd != commands.end()) {
-                current_command = std::ref(*found_cmd);
-                ++itarg;
-            } else {
-                current_command = this->get_global_command();
-            }
-        }
+        auto current_command = select_command(itarg, args.end());
         if (!current_command.has_value()) {
             return result::make_unexpected(result::PositionnedError{
                     .error = result::Error{
@@ -67,13 +26,46 @@ namespace cmd
         }
 
         // Parse command arguments
-        auto parsed_cmd = parse_command(args.subspan(std::distance(args.begin(), itarg)), current_command.value());
+        auto parsed_cmd = parse_command(args.subspan(std::distance(args.begin(), itarg)), current_command.value(), resource);
         if (!parsed_cmd) {
             parsed_cmd.error().position += std::distance(args.begin(), itarg);
             return result::make_unexpected(parsed_cmd.error());
         }
-        result.command = std::move(parsed_cmd.value());
-        return std::move(result);
+        // Moved in at construction, so that the columns keep their allocator
+        return result::Result{
+            .program = args[0],
+            .command = std::move(parsed_cmd.value())
+        };
+    }
+    auto Parser::command_name(utils::Iterable<std::string_view> auto args) const -> std::string_view {
+        auto itarg = std::next(args.begin());
+        auto const command = select_command(itarg, args.end());
+        return command ? command->get().longname : std::string_view{};
+    }
+    auto Parser::stream(utils::Iterable<std::string_view> auto args, std::pmr::memory_resource* resource) const -> Stream<decltype(args)> {
+        return Stream<decltype(args)>(*this, std::move(args), resource);
+    }
+    template <utils::Iterator<std::string_view> Iter>
+    auto Parser::select_command(Iter& itarg, Iter end) const -> std::optional<std::reference_wrapper<const config::Command>> {
+        // Find command
+        // If no argument or starts with a flag, then it is a global command
+        if (itarg == end || std::string_view(*itarg).starts_with("-"))
+            return this->get_global_command();
+        // Determine if the command name is a shortname (single character) or longname (multiple characters).
+        // A token that is not UTF-8 cannot name a command: it is left to the global command as an input.
+        auto const token = std::string_view(*itarg);
+        auto const length = cmd::utils::uni::utf8_length(token);
+        std::optional<std::size_t> found_cmd;
+        if (length && *length == 1) {
+            auto pos = std::size_t{0};
+            found_cmd = get_lookup().commands.find(cmd::utils::uni::next_codepoint(token, pos));
+        } else if (length) {
+            found_cmd = get_lookup().commands.find(token);
+        }
+        if (!found_cmd)
+            return this->get_global_command();
+        ++itarg;
+        return std::ref(commands[*found_cmd]);
     }
     template <utils::Iterator<std::string_view> Iter>
     auto Parser::parse_long_argument(Iter& itarg, Iter end, const config::Command& command, result::Command& result_command) const -> result::PosExpected<bool>
@@ -92,11 +84,8 @@ namespace cmd
             value = arg.substr(equal_pos + 1);
             name = arg.substr(2, equal_pos - 2);
         }
-        auto long_finder = [name](const auto& param) {
-            return param.longname == name;
-        };
-        auto found_flag = std::find_if(command.flags.begin(), command.flags.end(), long_finder);
-        if (found_flag != command.flags.end()) {
+        auto found = get_options(command).find(name);
+        if (found && found->kind == Option::Kind::Flag) {
             if (value) {
                 return result::make_unexpected(result::PositionnedError{
                     .error = result::Error{
@@ -108,13 +97,12 @@ namespace cmd
                     .position = 0
                 });
             }
-            auto res = this->add_flag(result_command, *found_flag, name);
+            auto res = this->add_flag(result_command, command, found->position, name);
             if (!res) {
                 return res;
             }
         } else {
-            auto found_argument = std::find_if(command.arguments.begin(), command.arguments.end(), long_finder);
-            if (found_argument != command.arguments.end()) {
+            if (found) {
                 if (!value) {
                     return result::make_unexpected(result::PositionnedError{
                         .error = result::Error{
@@ -126,7 +114,7 @@ namespace cmd
                         .position = 0
                     });
                 }
-                auto res = this->add_argument(result_command, *found_argument, name, value.value());
+                auto res = this->add_argument(result_command, command, found->position, name, value.value());
                 if (!res) {
                     return res;
                 }
@@ -152,37 +140,23 @@ namespace cmd
         std::optional<std::string_view> value;
         // argument format: -n [value] or -fff
         name = arg.substr(1);
-        if (name.size() > cmd::utils::uni::utf8_char_length(name).value()) {
+        // The token is validated once here; its characters are then decoded unchecked
+        auto const length = cmd::utils::uni::utf8_length(name);
+        if (!length)
+            return result::make_unexpected(result::PositionnedError{
+                .error = result::Error{
+                    .argument = name,
+                    .value = std::nullopt,
+                    .type = result::Error::Type::Flag,
+                    .code = result::Error::Code::BadString
+                },
+                .position = 0
+            });
+        if (*length > 1) {
             //multi flags
-            for (auto iName = 0; iName<name.size();) {
-                auto exp_len = cmd::utils::uni::utf8_char_length(name.substr(iName));
-                if (!exp_len)
-                    return result::make_unexpected(result::PositionnedError{
-                        .error = result::Error{
-                            .argument = name,
-                            .value = value,
-                            .type = result::Error::Type::Flag,
-                            .code = result::Error::Code::BadString
-                        },
-                        .position = 0
-                    });
-                auto len = exp_len.value();
-                auto exp_codepoint = cmd::utils::uni::codepoint(name.substr(iName, len));
-                if (!exp_codepoint)
-                    return result::make_unexpected(result::PositionnedError{
-                        .error = result::Error{
-                            .argument = name,
-                            .value = std::nullopt,
-                            .type = result::Error::Type::Flag,
-                            .code = result::Error::Code::BadString
-                        },
-                        .position = 0
-                    });
-                auto codepoint = exp_codepoint.value();
-                auto found_flag = std::find_if(command.flags.begin(), command.flags.end(), [codepoint](const auto& flag) {
-                    return flag.shortname == codepoint;
-                });
-                if (found_flag == command.flags.end()) {
+            for (auto iName = std::size_t{0}; iName < name.size();) {
+                auto found = get_options(command).find(cmd::utils::uni::next_codepoint(name, iName));
+                if (!found || found->kind != Option::Kind::Flag) {
                     return result::make_unexpected(result::PositionnedError{
                         .error = result::Error{
                             .argument = name,
@@ -193,40 +167,22 @@ namespace cmd
                         .position = 0
                     });
                 }
-                auto res = this->add_flag(result_command, *found_flag, name);
+                auto res = this->add_flag(result_command, command, found->position, name);
                 if (!res) {
                     return res;
                 }
-                iName += len;
             }
         } else {
             // one flag or argument
-            name = arg.substr(1);
-            auto exp_codepoint = cmd::utils::uni::codepoint(name);
-            if (!exp_codepoint)
-                return result::make_unexpected(result::PositionnedError{
-                    .error = result::Error{
-                        .argument = name,
-                        .value = std::nullopt,
-                        .type = result::Error::Type::Flag,
-                        .code = result::Error::Code::BadString
-                    },
-                    .position = 0
-                });
-            auto codepoint = exp_codepoint.value();
-            auto found_flag = std::find_if(command.flags.begin(), command.flags.end(), [codepoint](const auto& flag) {
-                return flag.shortname == codepoint;
-            });
-            if (found_flag != command.flags.end()) {
-                auto res = this->add_flag(result_command, *found_flag, name);
+            auto iName = std::size_t{0};
+            auto found = get_options(command).find(cmd::utils::uni::next_codepoint(name, iName));
+            if (found && found->kind == Option::Kind::Flag) {
+                auto res = this->add_flag(result_command, command, found->position, name);
                 if (!res) {
                     return res;
                 }
             } else {
-                auto found_argument = std::find_if(command.arguments.begin(), command.arguments.end(), [codepoint](const auto& argument) {
-                    return argument.shortname == codepoint;
-                });
-                if (found_argument != command.arguments.end()) {
+                if (found) {
                     auto itvalue = ++itarg;
                     if (itvalue == endarg) {
                         return result::make_unexpected(result::PositionnedError{
@@ -239,7 +195,7 @@ namespace cmd
                             .position = 0
                         });
                     }
-                    auto res = this->add_argument(result_command, *found_argument, name, *itvalue);
+                    auto res = this->add_argument(result_command, command, found->position, name, *itvalue);
                     if (!res) {
                         return res;
                     }
@@ -262,66 +218,44 @@ namespace cmd
 
     
 
-    auto Parser::parse_command(utils::Iterable<std::string_view> auto args, const config::Command& command) const -> result::PosExpected<result::Command> {
-        result::Command result_command;
-        result_command.name = command.longname;
+    template <utils::Iterator<std::string_view> Iter>
+    auto Parser::parse_parameter(Iter& itarg, Iter end, const config::Command& command, result::Command& result_command) const -> result::PosExpected<bool> {
+        auto name = std::string_view(*itarg);
+        if (name.starts_with("---")) {
+            return result::make_unexpected(result::PositionnedError{
+                .error = result::Error{
+                    name,
+                    std::nullopt,
+                    result::Error::Type::None,
+                    result::Error::Code::SyntaxError
+                },
+                .position = 0
+            });
+        }
+        if (auto const list = input_list(command, name))
+            return this->add_input_file(result_command, command, *list);
+        if (name.starts_with("--")) {
+            // argument format: --name=value
+            return this->parse_long_argument(itarg, end, command, result_command);
+        }
+        if (name.starts_with("-") && name.size() > 1)
+            return this->parse_short_argument(itarg, end, command, result_command);
+        return this->add_input(result_command, command, name);
+    }
+    auto Parser::parse_command(utils::Iterable<std::string_view> auto args, const config::Command& command, std::pmr::memory_resource* resource) const -> result::PosExpected<result::Command> {
+        result::Command result_command(resource);
+        result_command.prepare(command, static_cast<std::size_t>(std::distance(args.begin(), args.end())));
+        result_command.options = &get_options(command);
 
         for (auto itarg = args.begin(); itarg != args.end(); itarg++) {
-            auto name = std::string_view(*itarg);
-            std::optional<std::string_view> value = std::nullopt;
-            bool is_short = false;
-            if (name.starts_with("---")) {
-                return result::make_unexpected(result::PositionnedError{
-                    .error = result::Error{
-                        *itarg,
-                        std::nullopt,
-                        result::Error::Type::None,
-                        result::Error::Code::SyntaxError
-                    },
-                    .position = std::distance(args.begin(), itarg)
-                });
-            }
-            result::PosExpected<bool> parameter;
-            if (name.starts_with("--")) {
-                // argument format: --name=value
-                parameter = this->parse_long_argument(itarg, args.end(), command, result_command);
-            } else if (name.starts_with("-")) {
-                parameter = this->parse_short_argument(itarg, args.end(), command, result_command);
-            } else {
-                //TODO: is an input
-                parameter = this->add_input(result_command, command, name);
-            }
+            auto parameter = this->parse_parameter(itarg, args.end(), command, result_command);
             if (!parameter) {
                 parameter.error().position += std::distance(args.begin(), itarg);
                 return result::make_unexpected(parameter.error());
             }
         }
-        //post validation
-        std::unordered_set<std::string_view> required_arguments;
-        for (auto& argument : command.arguments) {
-            if (argument.required) {
-                required_arguments.insert(argument.longname);
-            }
-        }
-        for (auto param : result_command.parameters) {
-            if (std::holds_alternative<result::Argument>(param)) {
-                auto argument = std::get<result::Argument>(param);
-                if (auto found = required_arguments.find(argument.name); found != required_arguments.end()) {
-                    required_arguments.erase(found);
-                }
-            }
-        }
-        if (!required_arguments.empty()) {
-            return result::make_unexpected(result::PositionnedError{
-                .error = result::Error{
-                    .argument = *required_arguments.begin(),
-                    .value = std::nullopt,
-                    .type = result::Error::Type::Argument,
-                    .code = result::Error::Code::RequiredArgument
-                },
-                .position = 0
-            });
-        }
+        if (auto required = check_required(command, result_command); !required)
+            return result::make_unexpected(required.error());
         return std::move(result_command);
     }
 }
\ No newline at end of file
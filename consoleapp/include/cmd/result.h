@@ -1,7 +1,17 @@
 #pragma once
+#include <chrono>
 #include <string_view>
 #include <span>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <variant>
+#include <vector>
 #include "config.h"
+#include "input_file.h"
+#include "lookup.h"
+#include "types.h"
 #include "utils.h"
 
 namespace cmd::result 
@@ -11,6 +21,8 @@ namespace cmd::result
         std::string_view name;
         std::string_view value;
         const cmd::config::Argument& argument_parser;
+        // Value converted to the argument's type, if it has one
+        cmd::types::Value typed = {};
     };
     struct Flag {
         std::string_view name;
@@ -18,27 +30,134 @@ namespace cmd::result
         const cmd::config::Flag& flag_parser;
     };
     using Parameter = std::variant<Argument, Flag, Input>;
+    // Parameters of a command, kept in one column per kind, each in command
+    // line order. Columns are sized up front and allocated from the memory
+    // resource given to the parser, so that a command line of any length
+    // costs a handful of allocations.
     struct Command {
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+        static constexpr auto none = std::numeric_limits<std::size_t>::max();
+
         std::string_view name;
-        std::vector<Parameter> parameters;
+        std::pmr::vector<Input> inputs;
+        std::pmr::vector<Argument> arguments;
+        // Times each flag of config->flags was given
+        std::pmr::vector<uint32_t> flag_occurrences;
+        // Position in `arguments` of the last value of each argument of config->arguments, or none
+        std::pmr::vector<std::size_t> last_arguments;
+        // Lists inputs were read from; those inputs point into them.
+        std::vector<std::shared_ptr<const cmd::utils::InputFile>> input_files;
+        // Set by the parser; both point into it.
+        const cmd::config::Command* config = nullptr;
+        const cmd::utils::OptionIndex* options = nullptr;
+        // When set, each parameter is also appended here as it is parsed, and inputs are not kept
+        std::pmr::vector<Parameter>* emitted = nullptr;
+
+        Command() = default;
+        explicit Command(allocator_type allocator) : inputs(allocator), arguments(allocator), flag_occurrences(allocator), last_arguments(allocator) {}
+
+        // Sizes the columns for `command` and a command line of `tokens` tokens.
+        void prepare(const cmd::config::Command& command, std::size_t tokens) {
+            config = &command;
+            name = command.longname;
+            inputs.reserve(tokens);
+            flag_occurrences.assign(command.flags.size(), 0);
+            last_arguments.assign(command.arguments.size(), none);
+        }
+        // Returns the number of times the flag was given so far.
+        auto add_flag(std::size_t position) -> uint32_t {
+            auto const occurrence = ++flag_occurrences[position];
+            if (emitted)
+                emitted->push_back(Flag{ .name = config->flags[position].longname, .occurrence = occurrence, .flag_parser = config->flags[position] });
+            return occurrence;
+        }
+        void add_argument(Argument argument, std::size_t position) {
+            last_arguments[position] = arguments.size();
+            arguments.push_back(argument);
+            if (emitted)
+                emitted->push_back(argument);
+        }
+        void add_input(Input input) {
+            if (emitted)
+                emitted->push_back(input);
+            else
+                inputs.push_back(input);
+        }
+
+        // Number of times the flag was given
+        auto get_flag(std::string_view flag) const -> uint32_t {
+            auto const found = find(flag, cmd::utils::Option::Kind::Flag);
+            return found ? flag_occurrences[*found] : 0;
+        }
+        // Last value given to the argument, else its default value
+        auto get_argument(std::string_view argument) const -> std::optional<std::string_view> {
+            auto const found = find(argument, cmd::utils::Option::Kind::Argument);
+            if (!found)
+                return std::nullopt;
+            if (last_arguments[*found] != none)
+                return arguments[last_arguments[*found]].value;
+            return config->arguments[*found].default_value;
+        }
+        // Every value given to a repeatable argument, in order
+        auto get_arguments(std::string_view argument) const -> std::vector<std::string_view> {
+            auto values = std::vector<std::string_view>{};
+            if (auto const found = find(argument, cmd::utils::Option::Kind::Argument); found && last_arguments[*found] != none) {
+                auto const& wanted = config->arguments[*found];
+                for (auto const& given : arguments) {
+                    if (&given.argument_parser == &wanted)
+                        values.push_back(given.value);
+                }
+            }
+            return values;
+        }
+        auto get_inputs() const -> std::span<const Input> {
+            return inputs;
+        }
+        // Last value of an argument declared with the matching type, else its default value
+        auto get_integer(std::string_view argument) const -> std::optional<std::int64_t> {
+            return get_typed<std::int64_t>(argument);
+        }
+        auto get_size(std::string_view argument) const -> std::optional<std::uint64_t> {
+            return get_typed<std::uint64_t>(argument);
+        }
+        auto get_duration(std::string_view argument) const -> std::optional<std::chrono::milliseconds> {
+            return get_typed<std::chrono::milliseconds>(argument);
+        }
+        // Position of the value in the argument's types::Choice
+        auto get_choice(std::string_view argument) const -> std::optional<std::size_t> {
+            auto const chosen = get_typed<cmd::types::Chosen>(argument);
+            return chosen ? std::optional(chosen->index) : std::nullopt;
+        }
 
-        Flag& add_flag(const cmd::config::Flag& flag) {
-            auto found = std::find_if(parameters.begin(), parameters.end(), [name=flag.longname](const auto& parameter) {
-                return std::holds_alternative<Flag>(parameter) && std::get<Flag>(parameter).name == name;
-            });
-            if (found == parameters.end()) {
-                parameters.push_back(Flag{flag.longname, 1, flag});
-                return std::get<Flag>(parameters.back());
-            } else {
-                std::get<Flag>(*found).occurrence++;
-                return std::get<Flag>(*found);
+    private:
+        template <class T>
+        auto get_typed(std::string_view argument) const -> std::optional<T> {
+            auto const found = find(argument, cmd::utils::Option::Kind::Argument);
+            if (!found)
+                return std::nullopt;
+            if (last_arguments[*found] != none) {
+                auto const value = std::get_if<T>(&arguments[last_arguments[*found]].typed);
+                return value ? std::optional(*value) : std::nullopt;
             }
+            // Default values are few and constant: they are converted when asked for.
+            auto const& config_argument = config->arguments[*found];
+            if (!config_argument.type || !config_argument.default_value)
+                return std::nullopt;
+            auto const value = cmd::types::convert(*config_argument.type, *config_argument.default_value);
+            return value && std::holds_alternative<T>(*value) ? std::optional(std::get<T>(*value)) : std::nullopt;
+        }
+        auto find(std::string_view name, cmd::utils::Option::Kind kind) const -> std::optional<std::size_t> {
+            if (!options)
+                return std::nullopt;
+            auto const found = options->find(name);
+            if (!found || found->kind != kind)
+                return std::nullopt;
+            return found->position;
         }
     };
     struct Result {
         std::string_view program;
         Command command;
-        std::vector<Parameter> parameters;
     };
     struct Error {
         std::string_view argument;
@@ -65,7 +184,8 @@ namespace cmd::result
             NotEnoughFlags,
             RequiredArgument,
             SyntaxError,
-            BadString
+            BadString,
+            UnreadableFile
         } code;
         std::string to_string() const;
     };
@@ -0,0 +1,122 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string_view>
+#include "parser.h"
+#include "types.h"
+
+// Command line declared as constant data. Name clashes are caught at compile
+// time, and the runtime Parser is filled from it in one go.
+namespace cmd::schema
+{
+    using Validator = bool (*)(std::string_view);
+
+    struct Argument {
+        std::string_view longname;
+        std::optional<char32_t> shortname = std::nullopt;
+        std::string_view description = {};
+        Validator validator = nullptr;
+        std::optional<types::Type> type = std::nullopt;
+        std::optional<std::string_view> default_value = std::nullopt;
+        bool required = false;
+    };
+    struct Flag {
+        std::string_view longname;
+        std::optional<char32_t> shortname = std::nullopt;
+        std::string_view description = {};
+        std::uint32_t max = std::numeric_limits<std::uint32_t>::max();
+    };
+    struct Command {
+        std::string_view longname;
+        std::optional<char32_t> shortname = std::nullopt;
+        std::string_view description = {};
+        std::span<const Argument> arguments = {};
+        std::span<const Flag> flags = {};
+        Validator input_validator = nullptr;
+        // Accept @FILE and --files-from=FILE lists of inputs
+        bool input_files = false;
+    };
+    struct Schema {
+        std::span<const Command> commands;
+        // Command run when the first token is not a command name
+        std::optional<std::string_view> global_command = std::nullopt;
+    };
+
+    namespace detail
+    {
+        // Names are compared pairwise: schemas are small and this only runs
+        // while compiling.
+        template <class T, class U>
+        consteval auto clash(const T& a, const U& b) -> bool {
+            return a.longname == b.longname || (a.shortname && a.shortname == b.shortname);
+        }
+    }
+
+    // Fails to compile (the throw is not a constant expression) when two
+    // commands, or two options of one command, share a name, or when the
+    // global command does not exist.
+    consteval auto validate(const Schema& schema) -> bool {
+        auto global_found = !schema.global_command;
+        for (auto i = std::size_t{0}; i < schema.commands.size(); ++i) {
+            auto const& command = schema.commands[i];
+            if (command.longname.empty())
+                throw "command without a name";
+            global_found = global_found || command.longname == *schema.global_command;
+            for (auto j = i + 1; j < schema.commands.size(); ++j) {
+                if (detail::clash(command, schema.commands[j]))
+                    throw "two commands share a name";
+            }
+            for (auto a = std::size_t{0}; a < command.arguments.size(); ++a) {
+                for (auto b = a + 1; b < command.arguments.size(); ++b) {
+                    if (detail::clash(command.arguments[a], command.arguments[b]))
+                        throw "two arguments of a command share a name";
+                }
+                for (auto const& flag : command.flags) {
+                    if (detail::clash(command.arguments[a], flag))
+                        throw "an argument and a flag of a command share a name";
+                }
+            }
+            for (auto a = std::size_t{0}; a < command.flags.size(); ++a) {
+                for (auto b = a + 1; b < command.flags.size(); ++b) {
+                    if (detail::clash(command.flags[a], command.flags[b]))
+                        throw "two flags of a command share a name";
+                }
+            }
+        }
+        if (!global_found)
+            throw "the global command is not declared";
+        return true;
+    }
+
+    // Parser configured from a schema checked at compile time. The strings
+    // of the schema are referred to, not copied.
+    template <const Schema& schema>
+    auto make_parser() -> Parser {
+        static_assert(validate(schema));
+        auto parser = Parser{};
+        for (auto const& command : schema.commands) {
+            auto& config = parser.make_command(command.longname, command.shortname).set_description(command.description);
+            if (command.input_validator)
+                config.set_input_validator(command.input_validator);
+            config.set_input_files(command.input_files);
+            for (auto const& argument : command.arguments) {
+                auto& option = config.make_argument(argument.longname, argument.shortname)
+                    .set_description(argument.description)
+                    .set_required(argument.required);
+                if (argument.validator)
+                    option.set_validator(argument.validator);
+                if (argument.type)
+                    option.set_type(*argument.type);
+                if (argument.default_value)
+                    option.set_default_value(*argument.default_value);
+            }
+            for (auto const& flag : command.flags)
+                config.make_flag(flag.longname, flag.shortname).set_description(flag.description).set_max(flag.max);
+        }
+        if (schema.global_command)
+            parser.set_global_command(*schema.global_command);
+        return parser;
+    }
+}
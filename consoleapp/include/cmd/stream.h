@@ -0,0 +1,175 @@
+#pragma once
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <utility>
+#include "parser.h"
+
+namespace cmd
+{
+    // Parameters of a command line as a single-pass range, each one parsed
+    // and validated when the iteration reaches it, so that work on the first
+    // inputs can start before the last ones are read. Input lists are read
+    // as the iteration needs them, a block of a pipe at a time, and their
+    // inputs are not collected; they stay valid as long as the stream.
+    //
+    // The command is known once the stream is built. Its flags and arguments
+    // are also gathered in command(), complete when the iteration is over.
+    // The first error ends the range.
+    template <class Args>
+    class Parser::Stream {
+    public:
+        using Element = result::PosExpected<result::Parameter>;
+
+        class iterator {
+            Stream* stream = nullptr;
+        public:
+            using value_type = Element;
+            using difference_type = std::ptrdiff_t;
+
+            iterator() = default;
+            explicit iterator(Stream* stream) : stream(stream) {}
+
+            auto operator*() const -> const Element& {
+                return *stream->current;
+            }
+            auto operator++() -> iterator& {
+                stream->advance();
+                return *this;
+            }
+            void operator++(int) {
+                stream->advance();
+            }
+            friend auto operator==(const iterator& it, std::default_sentinel_t) -> bool {
+                return it.at_end();
+            }
+        private:
+            auto at_end() const -> bool {
+                return !stream->current;
+            }
+        };
+
+        // Iterators refer to the stream: it is neither copied nor moved.
+        Stream(const Parser& parser, Args args, std::pmr::memory_resource* resource)
+            : parser(parser), args(std::move(args)), itarg(std::next(this->args.begin())), endarg(this->args.end()), state(resource), pending(resource)
+        {
+            auto const command = parser.select_command(itarg, endarg);
+            command_position = std::distance(this->args.begin(), itarg);
+            if (!command) {
+                fail(result::PositionnedError{
+                    .error = result::Error{
+                        .argument = "",
+                        .value = std::nullopt,
+                        .type = result::Error::Type::Command,
+                        .code = result::Error::Code::NoGlobalCommand
+                    },
+                    .position = 0
+                }, command_position);
+                return;
+            }
+            config = &command->get();
+            state.prepare(*config, 0);
+            state.options = &parser.get_options(*config);
+            state.emitted = &pending;
+        }
+        Stream(const Stream&) = delete;
+        Stream& operator=(const Stream&) = delete;
+
+        auto begin() -> iterator {
+            if (!started) {
+                started = true;
+                if (!current)
+                    advance();
+            }
+            return iterator(this);
+        }
+        auto end() const -> std::default_sentinel_t {
+            return {};
+        }
+
+        auto program() const -> std::string_view {
+            return *args.begin();
+        }
+        // Name is empty if no command was found
+        auto command() const -> const result::Command& {
+            return state;
+        }
+
+    private:
+        using Iter = decltype(std::declval<const Args&>().begin());
+
+        void advance() {
+            current.reset();
+            while (true) {
+                if (next_pending < pending.size()) {
+                    current.emplace(pending[next_pending++]);
+                    return;
+                }
+                pending.clear();
+                next_pending = 0;
+                if (finished)
+                    return;
+                if (list) {
+                    if (auto const input = list->next(cursor)) {
+                        if (auto added = parser.add_input(state, *config, *input); !added)
+                            return fail(added.error(), list_position);
+                        continue;
+                    }
+                    if (list->more())
+                        continue;
+                    if (list->failed())
+                        return fail(Parser::unreadable_file(list_path), list_position);
+                    list.reset();
+                    continue;
+                }
+                if (itarg == endarg) {
+                    finished = true;
+                    if (auto required = parser.check_required(*config, state); !required)
+                        fail(required.error(), command_position);
+                    return;
+                }
+                auto const position = std::distance(args.begin(), itarg);
+                if (auto const path = Parser::input_list(*config, *itarg)) {
+                    list = utils::InputFile::open(*path, false);
+                    if (!list)
+                        return fail(Parser::unreadable_file(*path), position);
+                    state.input_files.push_back(list);
+                    list_path = *path;
+                    list_position = position;
+                    cursor = {};
+                } else if (auto parsed = parser.parse_parameter(itarg, endarg, *config, state); !parsed) {
+                    return fail(parsed.error(), std::distance(args.begin(), itarg));
+                }
+                ++itarg;
+            }
+        }
+        void fail(result::PositionnedError error, std::ptrdiff_t position) {
+            error.position += position;
+            pending.clear();
+            next_pending = 0;
+            finished = true;
+            current.emplace(result::make_unexpected(error));
+        }
+
+        const Parser& parser;
+        Args args;
+        Iter itarg;
+        Iter endarg;
+        std::ptrdiff_t command_position = 0;
+        const config::Command* config = nullptr;
+        result::Command state;
+        // Parameters of the last token parsed, not yielded yet
+        std::pmr::vector<result::Parameter> pending;
+        std::size_t next_pending = 0;
+        // Input list being read
+        std::shared_ptr<utils::InputFile> list;
+        utils::InputFile::Cursor cursor;
+        std::string_view list_path;
+        std::ptrdiff_t list_position = 0;
+        std::optional<Element> current;
+        bool started = false;
+        bool finished = false;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <variant>
+
+// Types an argument value can be declared with. The value is converted once
+// by the parser, with std::from_chars; a value that does not convert, or
+// falls out of the declared range, is reported as an invalid value.
+namespace cmd::types
+{
+    struct Integer {
+        std::int64_t min = std::numeric_limits<std::int64_t>::min();
+        std::int64_t max = std::numeric_limits<std::int64_t>::max();
+    };
+    // Byte count with an optional K, M or G suffix
+    struct Size {
+        std::uint64_t min = 0;
+        std::uint64_t max = std::numeric_limits<std::uint64_t>::max();
+    };
+    // Number with a unit among ms, s, m and h; seconds without unit
+    struct Duration {
+        std::chrono::milliseconds min = std::chrono::milliseconds::zero();
+        std::chrono::milliseconds max = std::chrono::milliseconds::max();
+    };
+    // One of a fixed set of strings, which have to outlive the parser
+    struct Choice {
+        std::span<const std::string_view> values;
+    };
+    using Type = std::variant<Integer, Size, Duration, Choice>;
+
+    // Position of the chosen string in Choice::values
+    struct Chosen {
+        std::size_t index;
+    };
+    // Converted value, std::monostate for an argument declared without a type
+    using Value = std::variant<std::monostate, std::int64_t, std::uint64_t, std::chrono::milliseconds, Chosen>;
+
+    namespace detail
+    {
+        // Whole text parsed as a number, followed by a suffix
+        template <class T>
+        auto number(std::string_view text, std::string_view& suffix) -> std::optional<T> {
+            auto number = T{};
+            auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+            if (error != std::errc{})
+                return std::nullopt;
+            suffix = std::string_view(end, text.data() + text.size());
+            return number;
+        }
+        // value * multiplier, if it fits
+        inline auto scale(std::uint64_t value, std::uint64_t multiplier) -> std::optional<std::uint64_t> {
+            if (value > std::numeric_limits<std::uint64_t>::max() / multiplier)
+                return std::nullopt;
+            return value * multiplier;
+        }
+
+        inline auto convert(const Integer& type, std::string_view text) -> std::optional<Value> {
+            auto suffix = std::string_view{};
+            auto const value = number<std::int64_t>(text, suffix);
+            if (!value || !suffix.empty() || *value < type.min || *value > type.max)
+                return std::nullopt;
+            return *value;
+        }
+        inline auto convert(const Size& type, std::string_view text) -> std::optional<Value> {
+            auto suffix = std::string_view{};
+            auto value = number<std::uint64_t>(text, suffix);
+            if (value && !suffix.empty())
+                value = suffix == "K" ? scale(*value, 1u << 10) : suffix == "M" ? scale(*value, 1u << 20) : suffix == "G" ? scale(*value, 1u << 30) : std::nullopt;
+            if (!value || *value < type.min || *value > type.max)
+                return std::nullopt;
+            return *value;
+        }
+        inline auto convert(const Duration& type, std::string_view text) -> std::optional<Value> {
+            auto suffix = std::string_view{};
+            auto value = number<std::uint64_t>(text, suffix);
+            if (value && suffix != "ms")
+                value = suffix.empty() || suffix == "s" ? scale(*value, 1000) : suffix == "m" ? scale(*value, 60'000) : suffix == "h" ? scale(*value, 3'600'000) : std::nullopt;
+            if (!value || *value > static_cast<std::uint64_t>(std::chrono::milliseconds::max().count()))
+                return std::nullopt;
+            auto const duration = std::chrono::milliseconds(static_cast<std::chrono::milliseconds::rep>(*value));
+            if (duration < type.min || duration > type.max)
+                return std::nullopt;
+            return duration;
+        }
+        inline auto convert(const Choice& type, std::string_view text) -> std::optional<Value> {
+            auto const found = std::find(type.values.begin(), type.values.end(), text);
+            if (found == type.values.end())
+                return std::nullopt;
+            return Chosen{ static_cast<std::size_t>(found - type.values.begin()) };
+        }
+    }
+
+    // std::nullopt if `text` is not a valid value of `type`
+    inline auto convert(const Type& type, std::string_view text) -> std::optional<Value> {
+        return std::visit([&](const auto& type) { return detail::convert(type, text); }, type);
+    }
+}
\ No newline at end of file
@@ -1,7 +1,14 @@
 #pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <iterator>
 #include <string_view>
 #include "expected.h"
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 namespace cmd::utils::uni {
     struct UnicodeError {
         std::string_view str;
@@ -12,63 +19,122 @@ namespace cmd::utils::uni {
     };
     template <class T>
     using Expected = expected<T, UnicodeError>;
-    [[nodiscard]] constexpr Expected<uint8_t> utf8_char_length(std::string_view str) noexcept {
-        auto c = str.front();
-        if ((c & 0x80) == 0) {
-            return 1;
-        } else if ((c & 0xE0) == 0xC0) {
-            return 2;
-        } else if ((c & 0xF0) == 0xE0) {
-            return 3;
-        } else if ((c & 0xF8) == 0xF0) {
-            return 4;
-        } else {
-            return unexpected<UnicodeError>(UnicodeError{
+
+    namespace detail {
+        struct Decoded {
+            char32_t codepoint;
+            uint8_t length;
+        };
+        // Decodes the character at str[pos], rejecting what is not well-formed
+        // UTF-8: stray or missing continuation bytes, overlong forms,
+        // surrogates, codepoints past U+10FFFF and truncated sequences.
+        [[nodiscard]] constexpr Expected<Decoded> decode(std::string_view str, size_t pos) noexcept {
+            auto const invalid = unexpected<UnicodeError>(UnicodeError{
                 .str = str,
-                .pos = 0,
+                .pos = pos,
                 .error = UnicodeError::Error::InvalidUtf8Char
             });
+            if (pos >= str.size())
+                return invalid;
+            auto const byte = [&](size_t i) { return static_cast<uint8_t>(str[pos + i]); };
+            auto const lead = byte(0);
+            if (lead < 0x80)
+                return Decoded{lead, 1};
+            // Length, and range of the second byte, as in table 3-7 of the Unicode standard
+            uint8_t length = 0;
+            uint8_t low = 0x80;
+            uint8_t high = 0xBF;
+            if (lead >= 0xC2 && lead <= 0xDF) {
+                length = 2;
+            } else if (lead >= 0xE0 && lead <= 0xEF) {
+                length = 3;
+                low = lead == 0xE0 ? 0xA0 : 0x80;
+                high = lead == 0xED ? 0x9F : 0xBF;
+            } else if (lead >= 0xF0 && lead <= 0xF4) {
+                length = 4;
+                low = lead == 0xF0 ? 0x90 : 0x80;
+                high = lead == 0xF4 ? 0x8F : 0xBF;
+            } else {
+                return invalid;
+            }
+            if (str.size() - pos < length || byte(1) < low || byte(1) > high)
+                return invalid;
+            char32_t codepoint = lead & (0x7F >> length);
+            for (size_t i = 1; i < length; ++i) {
+                if ((byte(i) & 0xC0) != 0x80)
+                    return invalid;
+                codepoint = (codepoint << 6) | (byte(i) & 0x3F);
+            }
+            return Decoded{codepoint, length};
+        }
+
+        // Length of the run of ASCII bytes at the start of [data, data + size),
+        // checked a vector (or a word) at a time; the tail shorter than a word
+        // is left to the caller.
+        inline size_t ascii_prefix(const char* data, size_t size) noexcept {
+            size_t pos = 0;
+#if defined(__AVX2__)
+            for (; pos + 32 <= size; pos += 32) {
+                if (_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos))) != 0)
+                    return pos;
+            }
+#endif
+#if defined(__SSE2__)
+            for (; pos + 16 <= size; pos += 16) {
+                if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos))) != 0)
+                    return pos;
+            }
+#endif
+            for (; pos + 8 <= size; pos += 8) {
+                uint64_t word;
+                std::memcpy(&word, data + pos, sizeof(word));
+                if ((word & 0x8080808080808080u) != 0)
+                    return pos;
+            }
+            return pos;
         }
     }
+
+    [[nodiscard]] constexpr Expected<uint8_t> utf8_char_length(std::string_view str) noexcept {
+        auto decoded = detail::decode(str, 0);
+        if (!decoded)
+            return unexpected<UnicodeError>(decoded.error());
+        return (*decoded).length;
+    }
+    // Validates the whole string and counts its codepoints. ASCII runs are
+    // skipped a vector at a time (AVX2 or SSE2 when the build targets them,
+    // 8-byte words otherwise); other characters are decoded one by one.
     [[nodiscard]] constexpr Expected<size_t> utf8_length(std::string_view str) noexcept {
-        uint8_t len = 0;
-        for (auto itChar = str.begin(); itChar != str.end();) {
-            auto c = *itChar;
-            auto char_len = utf8_char_length(std::string_view{itChar, 1});
-            if (!char_len) {
-                auto error = std::move(char_len.error());
-                error.pos = std::distance(str.begin(), itChar);
-                return unexpected<UnicodeError>(std::move(error));
+        size_t length = 0;
+        for (size_t pos = 0; pos < str.size();) {
+            auto scalar_end = str.size();
+            if !consteval {
+                auto const ascii = detail::ascii_prefix(str.data() + pos, str.size() - pos);
+                pos += ascii;
+                length += ascii;
+                // Decode past the vector that stopped the run before trying again.
+                scalar_end = std::min(str.size(), pos + 32);
+            }
+            while (pos < scalar_end) {
+                auto decoded = detail::decode(str, pos);
+                if (!decoded)
+                    return unexpected<UnicodeError>(decoded.error());
+                pos += (*decoded).length;
+                length += 1;
             }
-            len += 1;
-            itChar += char_len.value();
         }
-        return len;
+        return length;
     }
     [[nodiscard]] constexpr Expected<char32_t> codepoint(std::string_view utf8) noexcept {
-        char32_t codepoint = 0;
-        auto it = utf8.begin();
-        if ((*it & 0x80) == 0) {
-            codepoint = *it;
-        } else if ((*it & 0xE0) == 0xC0) {
-            codepoint = (*it & 0x1F) << 6;
-            codepoint |= *(++it) & 0x3F;
-        } else if ((*it & 0xF0) == 0xE0) {
-            codepoint = (*it & 0x0F) << 12;
-            codepoint |= (*(++it) & 0x3F) << 6;
-            codepoint |= *(++it) & 0x3F;
-        } else if ((*it & 0xF8) == 0xF0) {
-            codepoint = (*it & 0x07) << 18;
-            codepoint |= (*(++it) & 0x3F) << 12;
-            codepoint |= (*(++it) & 0x3F) << 6;
-            codepoint |= *(++it) & 0x3F;
-        } else {
-            return unexpected<UnicodeError>(UnicodeError{
-                .str = utf8,
-                .pos = 0,
-                .error = UnicodeError::Error::InvalidUtf8Char
-            });
-        }
-        return codepoint;
+        auto decoded = detail::decode(utf8, 0);
+        if (!decoded)
+            return unexpected<UnicodeError>(decoded.error());
+        return (*decoded).codepoint;
+    }
+    // Codepoint at str[pos] of a string already validated, moving pos past it.
+    [[nodiscard]] constexpr char32_t next_codepoint(std::string_view valid, size_t& pos) noexcept {
+        auto const decoded = detail::decode(valid, pos);
+        pos += (*decoded).length;
+        return (*decoded).codepoint;
     }
 }
\ No newline at end of file
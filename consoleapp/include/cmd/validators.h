@@ -0,0 +1,41 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <concepts>
+#include <filesystem>
+#include <string_view>
+#include <system_error>
+
+// Ready-made value validators. Each one is a plain function, instantiated
+// from its table or bounds, so it goes into a schema or a FunctionRef as a
+// function pointer, without type erasure or allocation.
+namespace cmd::validators
+{
+    // Value equal to one of the strings of `values`, a constexpr array of string_view
+    template <const auto& values>
+    auto one_of(std::string_view value) -> bool {
+        return std::find(std::begin(values), std::end(values), value) != std::end(values);
+    }
+
+    // Whole value parsed as an integer between min and max, inclusive
+    template <std::integral auto min, decltype(min) max>
+    auto in_range(std::string_view value) -> bool {
+        auto number = decltype(min){};
+        auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+        return error == std::errc{} && end == value.data() + value.size() && number >= min && number <= max;
+    }
+
+    // Whole value parsed as an integer of type T
+    template <std::integral T>
+    auto integer(std::string_view value) -> bool {
+        auto number = T{};
+        auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+        return error == std::errc{} && end == value.data() + value.size();
+    }
+
+    // Path of an existing file or directory
+    inline auto existing_path(std::string_view value) -> bool {
+        auto error = std::error_code{};
+        return std::filesystem::exists(std::filesystem::symlink_status(std::filesystem::path(value), error));
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cmd_parser.h>
+#include <cmd/expected.h>
+#include <zfiles/policy.h>
+#include <zfiles/scheduler.h>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+struct CompressOptions {
+    std::optional<int> level;
+    // zstd level adapted to the throughput, see zfiles::WriteOptions
+    bool adaptive_level = false;
+    // Bytes/s the adaptive level keeps up with
+    std::optional<double> target_rate;
+    // Split the archive into volumes of this many bytes
+    std::optional<std::uint64_t> volume_size;
+    // zstd long-distance matching window, as a power of 2
+    std::optional<int> long_window;
+    // Largest zstd window, in bytes
+    std::optional<std::uint64_t> memory_limit;
+    // Level or storing per file content, for zip and tar.zst
+    std::optional<zfiles::Policy> policy;
+    // Report what the options did on stderr
+    bool verbose = false;
+};
+
+// Options of a parsed compress command line, or why they do not go together
+auto compress_options(const cmd::result::Command& command) -> expected<CompressOptions, std::string>;
+
+// Packs the given files and directories, recursively, into a new archive whose
+// format and compression follow the name of `output`. Entries are named after
+// each input's last path component, as tar does. If writing fails once the
+// archive is created, it is removed along with its volumes. Volumes are
+// written by tasks of `scheduler`, if given, while the next are encoded.
+auto run_compress(std::span<const std::string_view> inputs, const std::filesystem::path& output, const CompressOptions& options, zfiles::Scheduler* scheduler = nullptr) -> int;
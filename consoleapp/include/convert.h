@@ -0,0 +1,22 @@
+#pragma once
+#include <zfiles/matcher.h>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+
+struct ConvertOptions {
+    std::optional<int> level;
+    std::optional<zfiles::PathFilter> filter;
+    // Largest zstd window of the source, in bytes
+    std::optional<std::uint64_t> memory_limit;
+    // Decoded data waiting for the encoder, at most
+    std::size_t buffer_size = 16 << 20;
+};
+
+// Rewrites the entries of `source` into a new archive whose format and
+// compression follow the name of `destination`, without temporary files.
+// Decoding and encoding run on two threads joined by a bounded buffer. An
+// archive converted to the same format and compression, unchanged, is copied
+// as is.
+auto run_convert(const std::filesystem::path& source, const std::filesystem::path& destination, ConvertOptions options) -> int;
@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <optional>
+
+// Compares two archives entry by entry and writes one line per difference,
+// in path order: "A path" (only in `right`), "D path" (only in `left`) or
+// "M path" (type, size, link target or content differ). Contents are compared
+// by the CRC-32 the archive stores; only entries without one are decoded and
+// hashed. `memory_limit` bounds the zstd window of both archives, as for
+// list. Returns 1 when the archives differ, 0 otherwise.
+auto run_diff(const std::filesystem::path& left, const std::filesystem::path& right, std::FILE* output, std::optional<std::uint64_t> memory_limit = std::nullopt) -> int;
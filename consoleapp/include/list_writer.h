@@ -0,0 +1,39 @@
+#pragma once
+#include <zfiles/reader.h>
+#include <fmt/format.h>
+#include <cstdio>
+#include <optional>
+#include <string_view>
+
+enum class ListFormat {
+    Text,
+    Ndjson,
+    Tsv,
+};
+auto parse_list_format(std::string_view name) -> std::optional<ListFormat>;
+
+// Formats entries into one reusable buffer and writes it out in large chunks,
+// so listing an archive costs no allocation and no stream call per entry.
+// TSV columns: path, type, size, mtime, mode (archive first once begin_archive is used).
+// The mode is octal in both TSV and NDJSON, where it is a string ("0644").
+class ListWriter {
+public:
+    ListWriter(std::FILE* output, ListFormat format);
+    ListWriter(const ListWriter&) = delete;
+    ListWriter& operator=(const ListWriter&) = delete;
+    ~ListWriter();
+
+    // Starts the entries of `archive`, when several archives are listed.
+    void begin_archive(std::string_view archive);
+    void write(const zfiles::Entry& entry);
+    // Throws std::system_error when the output cannot be written.
+    void flush();
+
+private:
+    static constexpr std::size_t flush_threshold = 1 << 20;
+
+    std::FILE* output;
+    ListFormat format;
+    std::optional<std::string_view> archive;
+    fmt::memory_buffer buffer;
+};
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+// Writes raw bytes to a file descriptor. Data that already sits in a file is
+// moved by the kernel where it can (splice into pipes, sendfile otherwise)
+// instead of being copied through user space.
+class RawOutput {
+public:
+    explicit RawOutput(int fd);
+    RawOutput(const RawOutput&) = delete;
+    RawOutput& operator=(const RawOutput&) = delete;
+    ~RawOutput();
+
+    void write(std::span<const std::byte> data);
+    void write_zeros(std::uint64_t count);
+    // Copies `length` bytes found at `offset` in `path`.
+    void copy_from(const std::filesystem::path& path, std::uint64_t offset, std::uint64_t length);
+
+private:
+    auto open_source(const std::filesystem::path& path) -> int;
+    auto kernel_copy(int source_fd, std::uint64_t& offset, std::uint64_t& length) -> bool;
+
+    int fd;
+    bool is_pipe;
+    int source = -1;
+    std::filesystem::path source_path;
+    std::vector<std::byte> buffer;
+};
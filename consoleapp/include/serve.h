@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+
+// Archive service answering list/stat/read requests on a Unix domain socket.
+// Indexes, open archive files and decoded entries stay in memory between
+// requests, so repeated lookups do not reopen and rescan archives.
+//
+// Every message is a frame: u32 size of the rest, u32 id, then
+//   request:  u8 operation, u8 flags, string archive, [string entry, [u64 offset, u64 length]]
+//   response: u8 status, then the result, or a string message if status is error
+// Numbers are little-endian; a string is a u32 size followed by its bytes.
+// Requests may be pipelined: responses come back in order, with their request's id.
+//   list -> u32 count, then count entry records
+//   stat -> one entry record
+//   read -> u8 0, u64 size, then the bytes
+//        or u8 1, u64 offset, u64 size, with the archive file descriptor passed
+//           along (SCM_RIGHTS): the bytes are at that offset in the file. Only
+//           when the request has the accept_fd flag and the entry is stored as is.
+// Read returns up to `length` bytes from `offset` in the entry, and at most
+// max_read_size when they come inline: larger reads take several requests.
+// An entry record is string path, u8 type, u8 has_size, u64 size, i64 mtime, u32 mode, string link.
+namespace serve_protocol {
+    enum class Operation : std::uint8_t {
+        List = 1,
+        Stat = 2,
+        Read = 3,
+    };
+    enum class Status : std::uint8_t {
+        Ok = 0,
+        Error = 1,
+    };
+    constexpr std::uint8_t accept_fd = 1;
+    constexpr std::uint32_t max_request_size = 1 << 20;
+    constexpr std::uint64_t max_read_size = std::uint64_t{1} << 26;
+} // namespace serve_protocol
+
+// Serves until SIGINT or SIGTERM; decoded entries are cached up to `cache_size` bytes.
+// `memory_limit` bounds the zstd window of the archives, as for list.
+auto serve(const std::filesystem::path& socket_path, std::uint64_t cache_size, std::optional<std::uint64_t> memory_limit = std::nullopt) -> int;
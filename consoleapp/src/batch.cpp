@@ -0,0 +1,334 @@
+#include <batch.h>
+#include <compress.h>
+#include <list_writer.h>
+#include <zfiles/reader.h>
+#include <zfiles/scheduler.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+    struct ListJob {
+        std::size_t line;
+        ListFormat format = ListFormat::Text;
+        std::optional<std::string> output;
+        std::vector<std::string> archives;
+        std::vector<std::string> include;
+        std::vector<std::string> exclude;
+        std::optional<std::uint64_t> memory_limit;
+    };
+
+    struct CompressJob {
+        std::size_t line;
+        std::vector<std::string> inputs;
+        std::string output;
+        CompressOptions options;
+    };
+
+    // Jobs of one group read the same archives and share a single scan.
+    struct Group {
+        std::vector<ListJob> jobs;
+    };
+
+    class Report {
+    public:
+        void ok(const ListJob& job, std::size_t entries, std::size_t merged) {
+            auto lock = std::lock_guard(mutex);
+            if (merged > 1)
+                fmt::print(stderr, "line {}: ok, {} entries (one scan for {} jobs)\n", job.line, entries, merged);
+            else
+                fmt::print(stderr, "line {}: ok, {} entries\n", job.line, entries);
+        }
+        void ok(const CompressJob& job) {
+            auto lock = std::lock_guard(mutex);
+            fmt::print(stderr, "line {}: ok, {} written\n", job.line, job.output);
+        }
+        void error(std::size_t line, std::string_view message) {
+            auto lock = std::lock_guard(mutex);
+            fmt::print(stderr, "line {}: error: {}\n", line, message);
+            failed = true;
+        }
+        // Copies a whole listing to stdout without interleaving it with another.
+        auto output(std::FILE* listing) -> bool {
+            std::rewind(listing);
+            auto buffer = std::array<char, 1 << 16>{};
+            auto lock = std::lock_guard(mutex);
+            while (auto const count = std::fread(buffer.data(), 1, buffer.size(), listing))
+                std::fwrite(buffer.data(), 1, count, stdout);
+            std::fflush(stdout);
+            return !std::ferror(listing);
+        }
+        bool has_failed() const { return failed; }
+
+    private:
+        std::mutex mutex;
+        std::atomic<bool> failed = false;
+    };
+
+    // Splits a manifest line on blanks; double quotes group words, and a
+    // backslash inside them escapes the next character.
+    auto split_line(std::string_view line) -> std::vector<std::string>
+    {
+        auto words = std::vector<std::string>{};
+        auto it = line.begin();
+        while (true) {
+            while (it != line.end() && (*it == ' ' || *it == '\t' || *it == '\r'))
+                ++it;
+            if (it == line.end())
+                return words;
+            auto& word = words.emplace_back();
+            auto quoted = false;
+            for (; it != line.end() && (quoted || (*it != ' ' && *it != '\t' && *it != '\r')); ++it) {
+                if (*it == '"')
+                    quoted = !quoted;
+                else if (quoted && *it == '\\' && std::next(it) != line.end())
+                    word.push_back(*++it);
+                else
+                    word.push_back(*it);
+            }
+        }
+    }
+
+    // Whether a job line reads a list of inputs from stdin
+    auto reads_stdin(const std::vector<std::string>& words) -> bool
+    {
+        return std::ranges::any_of(words, [](std::string_view word) { return word == "@-" || word == "--files-from=-"; });
+    }
+
+    auto output_key(const std::string& output) -> std::filesystem::path
+    {
+        auto error = std::error_code{};
+        auto path = std::filesystem::weakly_canonical(output, error);
+        return error ? std::filesystem::path(output) : path;
+    }
+
+    auto read_line(std::FILE* input, std::string& line) -> bool
+    {
+        line.clear();
+        for (auto c = std::fgetc(input); c != EOF; c = std::fgetc(input)) {
+            if (c == '\n')
+                return true;
+            line.push_back(static_cast<char>(c));
+        }
+        return !line.empty();
+    }
+
+    auto to_list_job(std::size_t line, const cmd::result::Command& command) -> ListJob
+    {
+        auto job = ListJob{};
+        job.line = line;
+        if (auto const format = command.get_argument("format"))
+            job.format = parse_list_format(*format).value();
+        if (auto const output = command.get_argument("output"))
+            job.output = std::string(*output);
+        for (auto const pattern : command.get_arguments("include"))
+            job.include.emplace_back(pattern);
+        for (auto const pattern : command.get_arguments("exclude"))
+            job.exclude.emplace_back(pattern);
+        job.memory_limit = command.get_size("memory-limit");
+        for (auto const input : command.get_inputs())
+            job.archives.emplace_back(input);
+        return job;
+    }
+
+    // Jobs sharing a scan must read the same archives, which may be spelled
+    // differently from one line to the next, with the same filter and memory limit.
+    using GroupKey = std::tuple<std::vector<std::filesystem::path>, std::vector<std::string>, std::vector<std::string>, std::optional<std::uint64_t>>;
+    auto group_key(const ListJob& job) -> GroupKey
+    {
+        auto archives = std::vector<std::filesystem::path>{};
+        for (auto const& archive : job.archives) {
+            auto error = std::error_code{};
+            auto path = std::filesystem::weakly_canonical(archive, error);
+            archives.push_back(error ? std::filesystem::path(archive) : std::move(path));
+        }
+        return {std::move(archives), job.include, job.exclude, job.memory_limit};
+    }
+
+    auto make_filter(const ListJob& job) -> std::optional<zfiles::PathFilter>
+    {
+        if (job.include.empty() && job.exclude.empty())
+            return std::nullopt;
+        auto const include = std::vector<std::string_view>(job.include.begin(), job.include.end());
+        auto const exclude = std::vector<std::string_view>(job.exclude.begin(), job.exclude.end());
+        return zfiles::PathFilter(include, exclude);
+    }
+
+    struct Sink {
+        explicit Sink(const ListJob& job) : job(job) {}
+
+        const ListJob& job;
+        // The --output file, or a temporary one holding the listing until it goes to stdout
+        std::FILE* file = nullptr;
+        std::optional<ListWriter> writer;
+        std::size_t entries = 0;
+    };
+
+    void run_compress_job(const CompressJob& job, zfiles::Scheduler& scheduler, Report& report)
+    {
+        try {
+            auto const inputs = std::vector<std::string_view>(job.inputs.begin(), job.inputs.end());
+            if (run_compress(inputs, job.output, job.options, &scheduler) != 0)
+                report.error(job.line, fmt::format("{}: not written", job.output));
+            else
+                report.ok(job);
+        } catch (const std::exception& error) {
+            report.error(job.line, error.what());
+        }
+    }
+
+    void run_group(Group& group, Report& report)
+    {
+        auto sinks = std::vector<std::unique_ptr<Sink>>{};
+        for (auto const& job : group.jobs) {
+            auto sink = std::make_unique<Sink>(job);
+            sink->file = job.output ? std::fopen(job.output->c_str(), "wb") : std::tmpfile();
+            if (!sink->file) {
+                report.error(job.line, fmt::format("{}: cannot open for writing", job.output.value_or("temporary file")));
+                continue;
+            }
+            sink->writer.emplace(sink->file, job.format);
+            sinks.push_back(std::move(sink));
+        }
+        if (sinks.empty())
+            return;
+
+        auto const& archives = group.jobs.front().archives;
+        auto failure = std::optional<std::string>{};
+        try {
+            auto const filter = make_filter(group.jobs.front());
+            for (auto i = std::size_t{0}; i < archives.size(); ++i) {
+                auto reader = zfiles::Reader(std::filesystem::path(archives[i]), 1 << 20, group.jobs.front().memory_limit);
+                if (filter)
+                    reader.set_filter(*filter);
+                for (auto& sink : sinks) {
+                    if (archives.size() > 1)
+                        sink->writer->begin_archive(sink->job.archives[i]);
+                }
+                while (auto entry = reader.next()) {
+                    for (auto& sink : sinks) {
+                        sink->writer->write(*entry);
+                        ++sink->entries;
+                    }
+                }
+            }
+        } catch (const std::exception& error) {
+            failure = error.what();
+        }
+
+        for (auto& sink : sinks) {
+            auto sink_failure = failure;
+            if (!sink_failure) {
+                try {
+                    sink->writer->flush();
+                } catch (const std::exception& error) {
+                    sink_failure = error.what();
+                }
+            }
+            sink->writer.reset();
+            if (!sink->job.output && !sink_failure && (std::fflush(sink->file) != 0 || !report.output(sink->file)))
+                sink_failure = fmt::format("temporary file: {}", std::strerror(errno));
+            if (std::fclose(sink->file) != 0 && !sink_failure)
+                sink_failure = fmt::format("{}: {}", sink->job.output.value_or("temporary file"), std::strerror(errno));
+            if (sink_failure)
+                report.error(sink->job.line, *sink_failure);
+            else
+                report.ok(sink->job, sink->entries, sinks.size());
+        }
+    }
+}
+
+auto run_batch(const cmd::Parser& parser, std::FILE* manifest, std::size_t concurrency) -> int
+{
+    auto report = Report{};
+    auto compress_jobs = std::vector<CompressJob>{};
+    auto groups = std::vector<Group>{};
+    auto group_of = std::map<GroupKey, std::size_t>{};
+    // Line of the job writing each output file, and of the one reading stdin
+    auto writer_of = std::map<std::filesystem::path, std::size_t>{};
+    auto stdin_reader = std::optional<std::size_t>{};
+
+    // Pre-flight: parse every line before anything runs, and gather the jobs
+    // that read the same archives so each archive is scanned once.
+    auto line = std::string{};
+    for (auto number = std::size_t{1}; read_line(manifest, line); ++number) {
+        auto words = split_line(line);
+        if (words.empty() || words.front().starts_with('#'))
+            continue;
+        // Checked before parsing, which would read the list.
+        if (reads_stdin(words)) {
+            if (manifest == stdin) {
+                report.error(number, "cannot read inputs from stdin: the manifest is read from it");
+                continue;
+            }
+            if (stdin_reader) {
+                report.error(number, fmt::format("cannot read inputs from stdin: line {} already does", *stdin_reader));
+                continue;
+            }
+            stdin_reader = number;
+        }
+        auto arguments = std::vector<std::string_view>{"batch"};
+        arguments.insert(arguments.end(), words.begin(), words.end());
+        auto const parsed = parser.parse(std::span(arguments));
+        if (!parsed) {
+            report.error(number, parsed.error().to_string());
+            continue;
+        }
+        auto const& command = parsed->command;
+        if (command.name != "list" && command.name != "compress") {
+            report.error(number, fmt::format("{} cannot run in a batch", command.name));
+            continue;
+        }
+        auto const output = command.get_argument("output");
+        if (command.get_inputs().empty()) {
+            report.error(number, fmt::format("{}: no {} given", command.name, command.name == "list" ? "archive" : "input"));
+            continue;
+        }
+        if (output) {
+            auto [found, inserted] = writer_of.try_emplace(output_key(std::string(*output)), number);
+            if (!inserted) {
+                report.error(number, fmt::format("{}: also written by line {}", *output, found->second));
+                continue;
+            }
+        }
+        if (command.name == "compress") {
+            auto options = compress_options(command);
+            if (!options) {
+                report.error(number, options.error());
+                continue;
+            }
+            auto& job = compress_jobs.emplace_back(CompressJob{ .line = number, .inputs = {}, .output = std::string(*output), .options = std::move(*options) });
+            for (auto const input : command.get_inputs())
+                job.inputs.emplace_back(input);
+            continue;
+        }
+        auto job = to_list_job(number, command);
+        auto [found, inserted] = group_of.try_emplace(group_key(job), groups.size());
+        if (inserted)
+            groups.emplace_back();
+        groups[found->second].jobs.push_back(std::move(job));
+    }
+
+    // Archives are written before any is listed, so that a list line may
+    // read what a compress line writes.
+    auto scheduler = zfiles::Scheduler(concurrency);
+    for (auto const& job : compress_jobs)
+        scheduler.submit([&job, &scheduler, &report] { run_compress_job(job, scheduler, report); });
+    scheduler.wait();
+    for (auto& group : groups)
+        scheduler.submit([&group, &report] { run_group(group, report); });
+    scheduler.wait();
+    return report.has_failed() ? 1 : 0;
+}
@@ -0,0 +1,381 @@
+#include <bench.h>
+#include <zfiles/codec.h>
+#include <zfiles/reader.h>
+#include <zfiles/scheduler.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Results travel from the measuring child process through a pipe.
+    struct Measure {
+        double compress_seconds = 0.0;
+        double decompress_seconds = 0.0;
+        std::uint64_t compressed_bytes = 0;
+        bool ok = false;
+    };
+    struct ScalingMeasure {
+        std::array<double, 16> seconds{};
+        bool ok = false;
+    };
+
+    struct Row {
+        const zfiles::Codec* codec;
+        int level;
+        Measure measure;
+        std::uint64_t peak_rss;
+        bool pareto = false;
+
+        double ratio(std::uint64_t sample_size) const {
+            return measure.compressed_bytes ? static_cast<double>(sample_size) / static_cast<double>(measure.compressed_bytes) : 0.0;
+        }
+    };
+    struct Scaling {
+        const zfiles::Codec* codec;
+        ScalingMeasure measure;
+    };
+    struct FilterRow {
+        std::string_view name;
+        double encode_mb_s;
+        double decode_mb_s;
+    };
+
+    auto megabytes_per_second(std::uint64_t bytes, double seconds) -> double
+    {
+        return seconds > 0.0 ? static_cast<double>(bytes) / seconds / 1e6 : 0.0;
+    }
+
+    auto elapsed(Clock::time_point since) -> double
+    {
+        return std::chrono::duration<double>(Clock::now() - since).count();
+    }
+
+    // Takes an equal share of the sample from every file, so that one large
+    // file does not make up all of it; what small files leave goes to the next ones.
+    auto collect_sample(std::span<const std::string_view> inputs, std::uint64_t sample_size) -> std::vector<std::byte>
+    {
+        auto files = std::vector<std::filesystem::path>{};
+        for (auto const input : inputs) {
+            auto error = std::error_code{};
+            if (std::filesystem::is_directory(input, error)) {
+                for (auto it = std::filesystem::recursive_directory_iterator(input, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+                    if (it->is_regular_file(error))
+                        files.push_back(it->path());
+                }
+            } else {
+                files.emplace_back(input);
+            }
+        }
+        auto sample = std::vector<std::byte>{};
+        sample.reserve(static_cast<std::size_t>(sample_size));
+        for (auto i = std::size_t{0}; i < files.size(); ++i) {
+            auto stream = std::ifstream(files[i], std::ios::binary);
+            auto const left = sample_size - sample.size();
+            auto const take = static_cast<std::size_t>(std::min(std::max<std::uint64_t>(left / (files.size() - i), 64 * 1024), left));
+            auto const start = sample.size();
+            sample.resize(start + take);
+            stream.read(reinterpret_cast<char*>(sample.data() + start), static_cast<std::streamsize>(take));
+            sample.resize(start + static_cast<std::size_t>(stream.gcount()));
+            if (sample.size() == sample_size)
+                break;
+        }
+        return sample;
+    }
+
+    auto peak_rss(const rusage& usage) -> std::uint64_t
+    {
+#if defined(__APPLE__)
+        return static_cast<std::uint64_t>(usage.ru_maxrss);
+#else
+        return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+    }
+
+    // Runs `measure` in a child process, so that the peak resident size
+    // reported for it is its own and not the highest of every run so far.
+    template <class F>
+    auto isolated(F&& measure) -> std::pair<std::invoke_result_t<F>, std::uint64_t>
+    {
+        using Result = std::invoke_result_t<F>;
+        static_assert(std::is_trivially_copyable_v<Result>);
+        int fds[2];
+        if (::pipe(fds) != 0)
+            throw std::system_error(errno, std::generic_category(), "pipe");
+        auto const pid = ::fork();
+        if (pid < 0)
+            throw std::system_error(errno, std::generic_category(), "fork");
+        if (pid == 0) {
+            ::close(fds[0]);
+            auto result = Result{};
+            try {
+                result = measure();
+            } catch (...) {
+                result = Result{};
+            }
+            [[maybe_unused]] auto const written = ::write(fds[1], &result, sizeof(result));
+            ::_exit(0);
+        }
+        ::close(fds[1]);
+        auto result = Result{};
+        auto received = std::size_t{0};
+        while (received < sizeof(result)) {
+            auto const count = ::read(fds[0], reinterpret_cast<char*>(&result) + received, sizeof(result) - received);
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                break;
+            received += static_cast<std::size_t>(count);
+        }
+        ::close(fds[0]);
+        auto status = 0;
+        auto usage = rusage{};
+        ::wait4(pid, &status, 0, &usage);
+        if (received != sizeof(result))
+            result = Result{};
+        return {result, peak_rss(usage)};
+    }
+
+    // Blocks are independent, each behind a chain of its own.
+    auto compress_block(const zfiles::Codec& codec, int level, std::span<const std::byte> block, std::optional<std::string_view> filter) -> std::vector<std::byte>
+    {
+        if (!filter)
+            return zfiles::compress(codec, level, block);
+        auto chain = zfiles::make_filter_chain(*filter);
+        return zfiles::compress(codec, level, block, chain);
+    }
+    auto decompress_block(std::span<const std::byte> block, std::size_t size, std::optional<std::string_view> filter) -> std::vector<std::byte>
+    {
+        if (!filter)
+            return zfiles::decompress(block, size);
+        auto chain = zfiles::make_filter_chain(*filter);
+        return zfiles::decompress(block, size, chain);
+    }
+
+    // Runs the chain over the whole sample and back, one stage at a time.
+    auto measure_filters(std::string_view filter, std::span<const std::byte> sample) -> std::vector<FilterRow>
+    {
+        auto encoder = zfiles::make_filter_chain(filter);
+        auto decoder = zfiles::make_filter_chain(filter);
+        auto filtered = std::vector<std::byte>{};
+        encoder.encode(sample, true, filtered);
+        auto restored = std::vector<std::byte>{};
+        decoder.decode(filtered, true, restored);
+        if (!std::equal(restored.begin(), restored.end(), sample.begin(), sample.end()))
+            throw zfiles::Error(std::string(filter) + ": filters do not restore the sample");
+        auto rows = std::vector<FilterRow>{};
+        for (auto stage = std::size_t{0}; stage < encoder.size(); ++stage) {
+            rows.push_back(FilterRow{
+                .name = encoder.filter(stage).name(),
+                .encode_mb_s = encoder.throughput(stage).bytes_per_second() / 1e6,
+                .decode_mb_s = decoder.throughput(stage).bytes_per_second() / 1e6,
+            });
+        }
+        return rows;
+    }
+
+    auto measure_level(const zfiles::Codec& codec, int level, std::span<const std::span<const std::byte>> blocks, std::optional<std::string_view> filter) -> Measure
+    {
+        auto result = Measure{};
+        auto compressed = std::vector<std::vector<std::byte>>(blocks.size());
+        auto start = Clock::now();
+        for (auto i = std::size_t{0}; i < blocks.size(); ++i)
+            compressed[i] = compress_block(codec, level, blocks[i], filter);
+        result.compress_seconds = elapsed(start);
+        for (auto const& block : compressed)
+            result.compressed_bytes += block.size();
+
+        start = Clock::now();
+        for (auto i = std::size_t{0}; i < blocks.size(); ++i) {
+            auto const restored = decompress_block(compressed[i], blocks[i].size(), filter);
+            if (!std::equal(restored.begin(), restored.end(), blocks[i].begin(), blocks[i].end()))
+                return Measure{};
+        }
+        result.decompress_seconds = elapsed(start);
+        result.ok = true;
+        return result;
+    }
+
+    // Thread counts 1, 2, 4... up to the number of cores, which is always included.
+    auto thread_counts() -> std::vector<std::size_t>
+    {
+        auto const cores = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+        auto counts = std::vector<std::size_t>{};
+        for (auto threads = std::size_t{1}; threads < cores && counts.size() + 1 < ScalingMeasure{}.seconds.size(); threads *= 2)
+            counts.push_back(threads);
+        counts.push_back(cores);
+        return counts;
+    }
+
+    auto measure_scaling(const zfiles::Codec& codec, std::span<const std::span<const std::byte>> blocks, std::span<const std::size_t> counts, std::optional<std::string_view> filter) -> ScalingMeasure
+    {
+        auto result = ScalingMeasure{};
+        auto compressed = std::vector<std::vector<std::byte>>(blocks.size());
+        for (auto i = std::size_t{0}; i < counts.size(); ++i) {
+            auto scheduler = zfiles::Scheduler(counts[i]);
+            auto const start = Clock::now();
+            for (auto block = std::size_t{0}; block < blocks.size(); ++block) {
+                scheduler.submit([&, block] {
+                    compressed[block] = compress_block(codec, codec.default_level, blocks[block], filter);
+                });
+            }
+            scheduler.wait();
+            result.seconds[i] = elapsed(start);
+        }
+        result.ok = true;
+        return result;
+    }
+
+    // A result is on the front when no other one is both faster and smaller.
+    void mark_pareto(std::vector<Row>& rows, std::uint64_t sample_size)
+    {
+        for (auto& row : rows) {
+            if (!row.measure.ok)
+                continue;
+            auto const speed = 1.0 / row.measure.compress_seconds;
+            auto const ratio = row.ratio(sample_size);
+            row.pareto = std::none_of(rows.begin(), rows.end(), [&](const Row& other) {
+                if (!other.measure.ok || &other == &row)
+                    return false;
+                auto const other_speed = 1.0 / other.measure.compress_seconds;
+                auto const other_ratio = other.ratio(sample_size);
+                return other_speed >= speed && other_ratio >= ratio && (other_speed > speed || other_ratio > ratio);
+            });
+        }
+    }
+
+    void print_text(std::uint64_t sample_size, std::size_t block_count, std::span<const FilterRow> filters, std::span<const Row> rows, std::span<const Scaling> scalings, std::span<const std::size_t> counts)
+    {
+        fmt::print("sample: {} bytes in {} blocks\n\n", sample_size, block_count);
+        if (!filters.empty()) {
+            fmt::print("{:<10} {:>11} {:>11}\n", "filter", "encode MB/s", "decode MB/s");
+            for (auto const& filter : filters)
+                fmt::print("{:<10} {:>11.1f} {:>11.1f}\n", filter.name, filter.encode_mb_s, filter.decode_mb_s);
+            fmt::print("\n");
+        }
+        fmt::print("{:<6} {:>5} {:>7} {:>13} {:>15} {:>12}  {}\n", "codec", "level", "ratio", "compress MB/s", "decompress MB/s", "peak RSS MiB", "pareto");
+        for (auto const& row : rows) {
+            if (!row.measure.ok) {
+                fmt::print("{:<6} {:>5} failed\n", row.codec->name, row.level);
+                continue;
+            }
+            fmt::print("{:<6} {:>5} {:>7.3f} {:>13.1f} {:>15.1f} {:>12.1f}  {}\n",
+                row.codec->name, row.level, row.ratio(sample_size),
+                megabytes_per_second(sample_size, row.measure.compress_seconds),
+                megabytes_per_second(sample_size, row.measure.decompress_seconds),
+                static_cast<double>(row.peak_rss) / (1 << 20), row.pareto ? "*" : "");
+        }
+        fmt::print("\ncompress MB/s at the default level, by threads\n{:<6} {:>5}", "codec", "level");
+        for (auto const threads : counts)
+            fmt::print(" {:>8}", threads);
+        fmt::print("\n");
+        for (auto const& scaling : scalings) {
+            fmt::print("{:<6} {:>5}", scaling.codec->name, scaling.codec->default_level);
+            for (auto i = std::size_t{0}; i < counts.size(); ++i) {
+                if (scaling.measure.ok)
+                    fmt::print(" {:>8.1f}", megabytes_per_second(sample_size, scaling.measure.seconds[i]));
+                else
+                    fmt::print(" {:>8}", "-");
+            }
+            fmt::print("\n");
+        }
+    }
+
+    void print_json(std::uint64_t sample_size, std::size_t block_count, std::span<const FilterRow> filters, std::span<const Row> rows, std::span<const Scaling> scalings, std::span<const std::size_t> counts)
+    {
+        fmt::print("{{\"sample_bytes\":{},\"blocks\":{},\"filters\":[", sample_size, block_count);
+        auto separator = "";
+        for (auto const& filter : filters) {
+            fmt::print("{}{{\"name\":\"{}\",\"encode_mb_s\":{:.2f},\"decode_mb_s\":{:.2f}}}", separator, filter.name, filter.encode_mb_s, filter.decode_mb_s);
+            separator = ",";
+        }
+        fmt::print("],\"results\":[");
+        separator = "";
+        for (auto const& row : rows) {
+            fmt::print("{}{{\"codec\":\"{}\",\"level\":{},\"ok\":{}", separator, row.codec->name, row.level, row.measure.ok);
+            if (row.measure.ok) {
+                fmt::print(",\"ratio\":{:.4f},\"compress_mb_s\":{:.2f},\"decompress_mb_s\":{:.2f},\"peak_rss_bytes\":{},\"pareto\":{}",
+                    row.ratio(sample_size),
+                    megabytes_per_second(sample_size, row.measure.compress_seconds),
+                    megabytes_per_second(sample_size, row.measure.decompress_seconds),
+                    row.peak_rss, row.pareto);
+            }
+            fmt::print("}}");
+            separator = ",";
+        }
+        fmt::print("],\"scaling\":[");
+        separator = "";
+        for (auto const& scaling : scalings) {
+            fmt::print("{}{{\"codec\":\"{}\",\"level\":{},\"compress_mb_s\":{{", separator, scaling.codec->name, scaling.codec->default_level);
+            for (auto i = std::size_t{0}; scaling.measure.ok && i < counts.size(); ++i)
+                fmt::print("{}\"{}\":{:.2f}", i ? "," : "", counts[i], megabytes_per_second(sample_size, scaling.measure.seconds[i]));
+            fmt::print("}}}}");
+            separator = ",";
+        }
+        fmt::print("]}}\n");
+    }
+}
+
+auto run_bench(std::span<const std::string_view> inputs, const BenchOptions& options) -> int
+{
+    auto selected = std::vector<const zfiles::Codec*>{};
+    for (auto const& codec : zfiles::codecs()) {
+        if (!options.codec || codec.name == *options.codec)
+            selected.push_back(&codec);
+    }
+    if (selected.empty()) {
+        fmt::print(stderr, "bench: unknown codec {}\n", options.codec.value_or(""));
+        return 1;
+    }
+    auto const sample = collect_sample(inputs, options.sample_size);
+    if (sample.empty()) {
+        fmt::print(stderr, "bench: no data to sample\n");
+        return 1;
+    }
+    auto blocks = std::vector<std::span<const std::byte>>{};
+    for (auto offset = std::size_t{0}; offset < sample.size(); offset += options.block_size)
+        blocks.push_back(std::span(sample).subspan(offset, std::min(options.block_size, sample.size() - offset)));
+
+    // Peak of a child that only reads the sample, taken off every run's peak.
+    auto const baseline = isolated([&] {
+        auto measure = Measure{};
+        measure.compressed_bytes = std::count(sample.begin(), sample.end(), std::byte{0});
+        return measure;
+    }).second;
+
+    auto const filters = options.filter ? measure_filters(*options.filter, sample) : std::vector<FilterRow>{};
+    auto rows = std::vector<Row>{};
+    for (auto const codec : selected) {
+        for (auto level = codec->min_level; level <= codec->max_level; ++level) {
+            auto const [measure, peak] = isolated([&] { return measure_level(*codec, level, blocks, options.filter); });
+            rows.push_back(Row{ .codec = codec, .level = level, .measure = measure, .peak_rss = peak > baseline ? peak - baseline : 0 });
+        }
+    }
+    mark_pareto(rows, sample.size());
+
+    auto const counts = thread_counts();
+    auto scalings = std::vector<Scaling>{};
+    for (auto const codec : selected)
+        scalings.push_back(Scaling{ .codec = codec, .measure = isolated([&] { return measure_scaling(*codec, blocks, counts, options.filter); }).first });
+
+    if (options.json)
+        print_json(sample.size(), blocks.size(), filters, rows, scalings, counts);
+    else
+        print_text(sample.size(), blocks.size(), filters, rows, scalings, counts);
+    return std::all_of(rows.begin(), rows.end(), [](const Row& row) { return row.measure.ok; }) ? 0 : 1;
+}
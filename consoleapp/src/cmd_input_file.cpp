@@ -0,0 +1,128 @@
+#include <cmd/input_file.h>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr auto block_size = std::size_t{1} << 20;
+
+    // Mapped lists holding a NUL byte among their first block are
+    // NUL-separated: paths cannot contain one, and are much shorter than a block.
+    auto find_separator(std::string_view data) -> char
+    {
+        auto const head = data.substr(0, block_size);
+        return std::memchr(head.data(), '\0', head.size()) ? '\0' : '\n';
+    }
+}
+
+namespace cmd::utils
+{
+    auto InputFile::open(std::string_view path, bool whole) -> std::shared_ptr<InputFile>
+    {
+        auto const is_stdin = path == "-";
+        auto const fd = is_stdin ? STDIN_FILENO : ::open(std::string(path).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return nullptr;
+        auto file = std::make_shared<InputFile>();
+        file->fd = fd;
+        file->owns_fd = !is_stdin;
+        struct stat status;
+        if (::fstat(fd, &status) != 0)
+            return nullptr;
+        if (S_ISREG(status.st_mode) && !file->map(fd, static_cast<std::size_t>(status.st_size)))
+            return nullptr;
+        if (whole) {
+            while (file->more()) {}
+        }
+        return file->read_failed ? nullptr : std::move(file);
+    }
+    InputFile::~InputFile()
+    {
+        if (mapping)
+            ::munmap(mapping, mapping_size);
+        if (owns_fd && fd >= 0)
+            ::close(fd);
+    }
+
+    // Mapped files are read at once: the stream is closed.
+    auto InputFile::map(int fd, std::size_t size) -> bool
+    {
+        // A file list redirected to stdin may have been read from already.
+        auto const offset = ::lseek(fd, 0, SEEK_CUR);
+        if (offset < 0)
+            return false;
+        if (static_cast<std::size_t>(offset) < size) {
+            mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                // Left to be read as a stream
+                mapping = nullptr;
+                return true;
+            }
+            mapping_size = size;
+            ::madvise(mapping, size, MADV_SEQUENTIAL);
+            auto const data = std::string_view(static_cast<const char*>(mapping), size).substr(static_cast<std::size_t>(offset));
+            separator = find_separator(data);
+            blocks.push_back(data);
+        }
+        if (owns_fd)
+            ::close(fd);
+        this->fd = -1;
+        return true;
+    }
+
+    // Each read() publishes the records it completed, so that a consumer of a
+    // pipe gets them as soon as they are written. Reads go into the free end
+    // of the current buffer; once it is full, the unfinished record moves to
+    // a new one.
+    auto InputFile::more() -> bool
+    {
+        while (fd >= 0) {
+            if (filled == capacity) {
+                auto const tail = std::string_view(storage.empty() ? nullptr : storage.back().get() + published, filled - published);
+                capacity = std::max(block_size, tail.size() * 2);
+                storage.push_back(std::make_unique<char[]>(capacity));
+                std::memcpy(storage.back().get(), tail.data(), tail.size());
+                filled = tail.size();
+                published = 0;
+            }
+            auto const buffer = storage.back().get();
+            auto const count = ::read(fd, buffer + filled, capacity - filled);
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0) {
+                read_failed = count < 0;
+                if (owns_fd)
+                    ::close(fd);
+                fd = -1;
+                // The last record may lack its separator.
+                if (read_failed || published == filled)
+                    return false;
+                blocks.emplace_back(buffer + published, filled - published);
+                published = filled;
+                return true;
+            }
+            auto const data = std::string_view(buffer + published, filled + static_cast<std::size_t>(count) - published);
+            filled += static_cast<std::size_t>(count);
+            if (!detected) {
+                // Decided by whichever separator shows up first
+                auto const first = data.find_first_of(std::string_view("\0\n", 2));
+                if (first == std::string_view::npos)
+                    continue;
+                separator = data[first];
+                detected = true;
+            }
+            auto const last = data.rfind(separator);
+            if (last == std::string_view::npos)
+                continue;
+            blocks.push_back(data.substr(0, last + 1));
+            published += last + 1;
+            return true;
+        }
+        return false;
+    }
+}
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include <cmd_parser.h>
+#include <algorithm>
 #include <fmt/format.h>
 #include <string_view>
 
@@ -29,6 +30,7 @@ namespace cmd
             "required parameter(s) missing",
             "syntax error",
             "bad string",
+            "cannot read file",
         };
         auto value = std::string{};
         if (this->value) {
@@ -36,8 +38,83 @@ namespace cmd
         }
         return fmt::format("\"{}\"{}{} : {}", this->argument, value, types[static_cast<std::size_t>(this->type)], codes_text[static_cast<std::size_t>(this->code)]);
     }
-    auto Parser::add_argument(result::Command& result_command, const config::Argument& argument, std::string_view name, const std::string_view value) const -> result::PosExpected<bool>
+    auto Parser::index_options(const config::Command& command) -> OptionIndex
     {
+        // Flags first: a flag wins over an argument of the same name.
+        auto index = OptionIndex{};
+        for (auto i = std::size_t{0}; i < command.flags.size(); ++i)
+            index.add(command.flags[i].longname, command.flags[i].shortname, Option{.kind = Option::Kind::Flag, .position = i});
+        for (auto i = std::size_t{0}; i < command.arguments.size(); ++i)
+            index.add(command.arguments[i].longname, command.arguments[i].shortname, Option{.kind = Option::Kind::Argument, .position = i});
+        index.build();
+        return index;
+    }
+    auto Parser::input_list(const config::Command& command, std::string_view token) -> std::optional<std::string_view>
+    {
+        constexpr auto files_from = std::string_view("--files-from=");
+        if (!command.input_files)
+            return std::nullopt;
+        if (token.starts_with(files_from))
+            return token.substr(files_from.size());
+        // @FILE, a response file listing inputs
+        if (token.size() > 1 && token.starts_with("@"))
+            return token.substr(1);
+        return std::nullopt;
+    }
+    auto Parser::unreadable_file(std::string_view path) -> result::PositionnedError
+    {
+        return result::PositionnedError{
+            .error = result::Error{
+                .argument = path,
+                .value = std::nullopt,
+                .type = result::Error::Type::Input,
+                .code = result::Error::Code::UnreadableFile
+            },
+            .position = 0
+        };
+    }
+    auto Parser::check_required(const config::Command& command, const result::Command& result_command) const -> result::PosExpected<bool>
+    {
+        for (auto i = std::size_t{0}; i < command.arguments.size(); ++i) {
+            if (command.arguments[i].required && result_command.last_arguments[i] == result::Command::none) {
+                return result::make_unexpected(result::PositionnedError{
+                    .error = result::Error{
+                        .argument = command.arguments[i].longname,
+                        .value = std::nullopt,
+                        .type = result::Error::Type::Argument,
+                        .code = result::Error::Code::RequiredArgument
+                    },
+                    .position = 0
+                });
+            }
+        }
+        return true;
+    }
+    auto Parser::get_lookup() const -> const Lookup&
+    {
+        if (lookup)
+            return *lookup;
+        auto built = std::make_shared<Lookup>();
+        for (auto i = std::size_t{0}; i < commands.size(); ++i) {
+            built->commands.add(commands[i].longname, commands[i].shortname, i);
+            built->options.push_back(index_options(commands[i]));
+        }
+        built->commands.build();
+        if (global_command && std::holds_alternative<config::Command>(*global_command))
+            built->global_options = index_options(std::get<config::Command>(*global_command));
+        lookup = std::move(built);
+        return *lookup;
+    }
+    auto Parser::get_options(const config::Command& command) const -> const OptionIndex&
+    {
+        auto const& built = get_lookup();
+        if (!commands.empty() && &command >= commands.data() && &command < commands.data() + commands.size())
+            return built.options[static_cast<std::size_t>(&command - commands.data())];
+        return built.global_options;
+    }
+    auto Parser::add_argument(result::Command& result_command, const config::Command& command, std::size_t position, std::string_view name, const std::string_view value) const -> result::PosExpected<bool>
+    {
+        auto const& argument = command.arguments[position];
         if (argument.validator.has_value() && !argument.validator.value()(value))
             return result::make_unexpected(result::PositionnedError{
                 .error = result::Error{
@@ -48,18 +125,33 @@ namespace cmd
                 },
                 .position = 0
             });
-        result_command.parameters.push_back(result::Parameter{
-            result::Argument{
-                .name = argument.longname,
-                .value = value,
-                .argument_parser = argument
-            }
-        });
+        auto typed = types::Value{};
+        if (argument.type) {
+            auto converted = types::convert(*argument.type, value);
+            if (!converted)
+                return result::make_unexpected(result::PositionnedError{
+                    .error = result::Error{
+                        .argument = name,
+                        .value = value,
+                        .type = result::Error::Type::Argument,
+                        .code = result::Error::Code::InvalidValue
+                    },
+                    .position = 0
+                });
+            typed = *converted;
+        }
+        result_command.add_argument(result::Argument{
+            .name = argument.longname,
+            .value = value,
+            .argument_parser = argument,
+            .typed = typed
+        }, position);
         return true;
     }
-    auto Parser::add_flag(result::Command& result_command, const config::Flag& flag, std::string_view name) const -> result::PosExpected<bool>
+    auto Parser::add_flag(result::Command& result_command, const config::Command& command, std::size_t position, std::string_view name) const -> result::PosExpected<bool>
     {
-        if (result_command.add_flag(flag.longname).occurrence > flag.max)
+        auto const& flag = command.flags[position];
+        if (result_command.add_flag(position) > flag.max)
             return result::make_unexpected(result::PositionnedError{
                 .error = result::Error{
                     .argument = name,
@@ -84,7 +176,27 @@ namespace cmd
                 .position = 0
             });
         }
-        result_command.parameters.push_back(input);
+        result_command.add_input(input);
         return true;
     }
+    auto Parser::add_input_file(result::Command& result_command, const config::Command& command, std::string_view path) const -> result::PosExpected<bool>
+    {
+        auto const file = utils::InputFile::open(path);
+        if (!file)
+            return result::make_unexpected(unreadable_file(path));
+        result_command.input_files.push_back(file);
+        result_command.inputs.reserve(result_command.inputs.size() + file->count());
+        auto added = result::PosExpected<bool>(true);
+        file->for_each([&](std::string_view input) {
+            added = add_input(result_command, command, input);
+            return added.has_value();
+        });
+        if (!added) {
+            // The list goes away with the failed result: the faulty input is copied to the caller's resource.
+            auto& argument = added.error().error.argument;
+            auto const copy = result_command.inputs.get_allocator().allocate_object<char>(argument.size());
+            argument = std::string_view(copy, std::copy(argument.begin(), argument.end(), copy));
+        }
+        return added;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include <compress.h>
+#include <zfiles/writer.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <charconv>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Adds `source` then, for a directory, everything below it in name order.
+    void add_tree(zfiles::Writer& writer, const std::filesystem::path& source, const std::string& name)
+    {
+        auto const status = std::filesystem::symlink_status(source);
+        if (!std::filesystem::is_directory(status)) {
+            writer.add_file(source, name);
+            return;
+        }
+        if (!name.empty())
+            writer.add_file(source, name + "/");
+        auto children = std::vector<std::filesystem::path>{};
+        for (auto const& child : std::filesystem::directory_iterator(source))
+            children.push_back(child.path());
+        std::sort(children.begin(), children.end());
+        for (auto const& child : children)
+            add_tree(writer, child, name.empty() ? child.filename().string() : name + "/" + child.filename().string());
+    }
+
+    // A partial archive would pass for a whole one, and so would its volumes.
+    void remove_archive(const std::filesystem::path& output, bool split)
+    {
+        auto error = std::error_code{};
+        std::filesystem::remove(output, error);
+        if (!split)
+            return;
+        for (auto number = std::size_t{1}; std::filesystem::exists(zfiles::volume_path(output, number), error); ++number)
+            std::filesystem::remove(zfiles::volume_path(output, number), error);
+    }
+}
+
+auto compress_options(const cmd::result::Command& command) -> expected<CompressOptions, std::string>
+{
+    auto options = CompressOptions{};
+    if (auto const level = command.get_argument("level")) {
+        if (*level == "auto")
+            options.adaptive_level = true;
+        else if (auto const [end, error] = std::from_chars(level->data(), level->data() + level->size(), options.level.emplace()); error != std::errc{} || end != level->data() + level->size())
+            return unexpected<std::string>("--level must be \"auto\" or a level, not " + std::string(*level));
+    }
+    if (auto const rate = command.get_integer("target-rate")) {
+        if (!options.adaptive_level)
+            return unexpected<std::string>("--target-rate needs --level=auto");
+        options.target_rate = static_cast<double>(*rate) * 1e6;
+    }
+    if (auto const policy = command.get_argument("policy"))
+        options.policy = zfiles::Policy::find(*policy);
+    options.volume_size = command.get_size("volume-size");
+    if (auto const window = command.get_integer("long"))
+        options.long_window = static_cast<int>(*window);
+    options.memory_limit = command.get_size("memory-limit");
+    options.verbose = command.get_flag("verbose") > 0;
+    return options;
+}
+
+auto run_compress(std::span<const std::string_view> inputs, const std::filesystem::path& output, const CompressOptions& options, zfiles::Scheduler* scheduler) -> int
+{
+    if (!zfiles::Writer::supports(output)) {
+        fmt::print(stderr, "compress: {}: unknown archive type\n", output.string());
+        return 1;
+    }
+    auto writer = std::optional<zfiles::Writer>(std::in_place, output, zfiles::WriteOptions{
+        .level = options.level,
+        .volume_size = options.volume_size,
+        .scheduler = scheduler,
+        .long_window = options.long_window,
+        .memory_limit = options.memory_limit,
+        .adaptive_level = options.adaptive_level,
+        .target_rate = options.target_rate,
+        .policy = options.policy,
+    });
+    try {
+        for (auto const input : inputs) {
+            auto const source = std::filesystem::path(input).lexically_normal();
+            // "dir/" and "." pack the contents of the directory without its name.
+            auto const name = source.filename().string();
+            add_tree(*writer, source, name == "." ? std::string{} : name);
+        }
+        writer->close();
+    } catch (...) {
+        // The writer still writes the end of the archive as it goes.
+        writer.reset();
+        remove_archive(output, options.volume_size.has_value());
+        throw;
+    }
+    if (!options.verbose)
+        return 0;
+    auto const stats = writer->stats();
+    if (writer->window_log() > 0)
+        fmt::print(stderr, "compress: zstd window of 2^{} bytes{}\n", writer->window_log(), options.long_window ? ", long-distance matching" : "");
+    if (options.adaptive_level) {
+        for (auto const& [level, bytes] : stats.bytes_by_level)
+            fmt::print(stderr, "compress: level {}: {} bytes\n", level, bytes);
+    }
+    if (options.policy) {
+        // zip entries are stored or deflated at the archive's level.
+        for (auto const& [content_class, count] : stats.classes) {
+            auto const& rule = options.policy->rule(content_class);
+            auto const how = writer->window_log() == 0 ? std::string(rule.store ? "stored" : "deflated")
+                : fmt::format("level {}", rule.store ? 1 : rule.level);
+            fmt::print(stderr, "compress: {}: {} files, {} bytes, {}\n", zfiles::to_string(content_class), count.files, count.bytes, how);
+        }
+    } else {
+        fmt::print(stderr, "compress: {} incompressible files, {} bytes not compressed further\n", stats.incompressible.files, stats.incompressible.bytes);
+    }
+    return 0;
+}
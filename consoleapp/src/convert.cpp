@@ -0,0 +1,197 @@
+#include <convert.h>
+#include <zfiles/reader.h>
+#include <zfiles/writer.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    // Blocks are gathered into pieces of this size before they are handed over.
+    constexpr auto piece_size = std::size_t{1} << 20;
+
+    struct Message {
+        std::optional<zfiles::Header> header;
+        std::vector<std::byte> data;
+    };
+
+    // Carries entries from the decoding thread to the encoding one, holding
+    // at most `capacity` bytes of data; the producer waits when it is full.
+    class Channel {
+    public:
+        explicit Channel(std::size_t capacity) : capacity(capacity) {}
+
+        // Returns false once the consumer has given up.
+        auto push(Message message) -> bool {
+            auto lock = std::unique_lock(mutex);
+            space.wait(lock, [&] { return cancelled || messages.empty() || used + message.data.size() <= capacity; });
+            if (cancelled)
+                return false;
+            used += message.data.size();
+            messages.push_back(std::move(message));
+            ready.notify_one();
+            return true;
+        }
+        // Returns std::nullopt once the producer has finished and everything was taken.
+        auto pop() -> std::optional<Message> {
+            auto lock = std::unique_lock(mutex);
+            ready.wait(lock, [&] { return finished || !messages.empty(); });
+            if (messages.empty())
+                return std::nullopt;
+            auto message = std::move(messages.front());
+            messages.pop_front();
+            used -= message.data.size();
+            space.notify_one();
+            return message;
+        }
+        void finish() {
+            auto lock = std::lock_guard(mutex);
+            finished = true;
+            ready.notify_all();
+        }
+        void cancel() {
+            auto lock = std::lock_guard(mutex);
+            cancelled = true;
+            space.notify_all();
+        }
+
+        // Data buffers go back and forth instead of being allocated for each piece.
+        void recycle(std::vector<std::byte> buffer) {
+            buffer.clear();
+            auto lock = std::lock_guard(mutex);
+            spare.push_back(std::move(buffer));
+        }
+        auto buffer() -> std::vector<std::byte> {
+            auto lock = std::lock_guard(mutex);
+            if (spare.empty())
+                return {};
+            auto buffer = std::move(spare.back());
+            spare.pop_back();
+            return buffer;
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::condition_variable space;
+        std::deque<Message> messages;
+        std::vector<std::vector<std::byte>> spare;
+        std::size_t capacity;
+        std::size_t used = 0;
+        bool finished = false;
+        bool cancelled = false;
+    };
+
+    void encode(Channel& channel, const std::filesystem::path& destination, std::optional<int> level)
+    {
+        auto writer = zfiles::Writer(destination, { .level = level });
+        while (auto message = channel.pop()) {
+            if (message->header)
+                writer.add(*message->header);
+            if (!message->data.empty()) {
+                writer.write(message->data);
+                channel.recycle(std::move(message->data));
+            }
+        }
+        writer.close();
+    }
+
+    // Returns false if the encoder stopped early.
+    auto decode(Channel& channel, const std::filesystem::path& source, std::optional<zfiles::PathFilter>& filter, std::optional<std::uint64_t> memory_limit) -> bool
+    {
+        auto reader = zfiles::Reader(source, 1 << 20, memory_limit);
+        if (filter)
+            reader.set_filter(std::move(*filter));
+        auto piece = std::vector<std::byte>{};
+        auto send = [&] {
+            if (piece.empty())
+                return true;
+            auto next = channel.buffer();
+            return channel.push(Message{ .header = std::nullopt, .data = std::exchange(piece, std::move(next)) });
+        };
+        // Holes are written out as zeros a piece at a time, so that a large
+        // sparse file never sits in memory; held entries have to anyway.
+        auto zeros = [&](std::uint64_t count, bool held) {
+            while (count > 0) {
+                if (!held && piece.size() >= piece_size && !send())
+                    return false;
+                auto const run = held ? count : std::min<std::uint64_t>(count, piece_size - piece.size());
+                piece.resize(piece.size() + static_cast<std::size_t>(run));
+                count -= run;
+            }
+            return true;
+        };
+        while (reader.next()) {
+            auto header = reader.header();
+            auto const size = header.size();
+            // Formats like tar need the size up front: such entries are held whole.
+            auto const held = !size;
+            if (!held && !channel.push(Message{ .header = std::move(header), .data = {} }))
+                return false;
+            auto end = std::uint64_t{0};
+            while (auto const block = reader.read_block()) {
+                if (block->offset > end && !zeros(block->offset - end, held))
+                    return false;
+                piece.insert(piece.end(), block->data.begin(), block->data.end());
+                end = block->offset + block->data.size();
+                if (!held && piece.size() >= piece_size && !send())
+                    return false;
+            }
+            if (size && *size > end && !zeros(*size - end, held))
+                return false;
+            if (held) {
+                header.set_size(piece.size());
+                if (!channel.push(Message{ .header = std::move(header), .data = {} }))
+                    return false;
+            }
+            if (!send())
+                return false;
+        }
+        return true;
+    }
+}
+
+auto run_convert(const std::filesystem::path& source, const std::filesystem::path& destination, ConvertOptions options) -> int
+{
+    if (!zfiles::Writer::supports(destination)) {
+        fmt::print(stderr, "convert: {}: unknown archive type\n", destination.string());
+        return 1;
+    }
+    if (!options.level && !options.filter && zfiles::Writer::same_layout(source, destination)) {
+        std::filesystem::copy_file(source, destination, std::filesystem::copy_options::overwrite_existing);
+        return 0;
+    }
+
+    auto channel = Channel(options.buffer_size);
+    auto failure = std::exception_ptr{};
+    auto encoder = std::thread([&] {
+        try {
+            encode(channel, destination, options.level);
+        } catch (...) {
+            failure = std::current_exception();
+            channel.cancel();
+        }
+    });
+    try {
+        decode(channel, source, options.filter, options.memory_limit);
+    } catch (...) {
+        channel.cancel();
+        channel.finish();
+        encoder.join();
+        std::filesystem::remove(destination);
+        throw;
+    }
+    channel.finish();
+    encoder.join();
+    if (failure) {
+        std::filesystem::remove(destination);
+        std::rethrow_exception(failure);
+    }
+    return 0;
+}
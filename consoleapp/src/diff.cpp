@@ -0,0 +1,158 @@
+#include <diff.h>
+#include <zfiles/crc32.h>
+#include <zfiles/index.h>
+#include <zfiles/scheduler.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    enum class Change : char {
+        Added = 'A',
+        Removed = 'D',
+        Modified = 'M',
+        // Left to hashing the contents; still unknown afterwards means equal
+        Unknown = '?',
+    };
+
+    struct Difference {
+        Change change;
+        std::size_t left;
+        std::size_t right;
+    };
+
+    // Positions of an index in path order, keeping only the last entry of a
+    // path that appears several times.
+    auto unique_sorted(const zfiles::Index& index) -> std::vector<std::size_t>
+    {
+        auto const& sorted = index.sorted();
+        auto const& entries = index.entries();
+        auto result = std::vector<std::size_t>{};
+        result.reserve(sorted.size());
+        for (auto i = std::size_t{0}; i < sorted.size(); ++i) {
+            if (i + 1 == sorted.size() || entries[sorted[i + 1]].path != entries[sorted[i]].path)
+                result.push_back(sorted[i]);
+        }
+        return result;
+    }
+
+    auto compare(const zfiles::IndexEntry& left, const zfiles::IndexEntry& right) -> std::optional<Change>
+    {
+        if (left.type != right.type || left.link_target != right.link_target)
+            return Change::Modified;
+        if (left.type != zfiles::EntryType::File)
+            return std::nullopt;
+        if (left.size && right.size && *left.size != *right.size)
+            return Change::Modified;
+        if (left.crc32 && right.crc32)
+            return *left.crc32 == *right.crc32 ? std::nullopt : std::optional(Change::Modified);
+        return Change::Unknown;
+    }
+
+    // CRC-32 of the entries at `positions` (sorted), decoding nothing else.
+    auto hash_entries(const std::filesystem::path& path, const std::vector<std::size_t>& positions, std::optional<std::uint64_t> memory_limit) -> std::unordered_map<std::size_t, std::uint32_t>
+    {
+        static constexpr auto zeros = std::array<std::byte, 64 * 1024>{};
+        auto result = std::unordered_map<std::size_t, std::uint32_t>{};
+        if (positions.empty())
+            return result;
+        result.reserve(positions.size());
+        auto reader = zfiles::Reader(path, 1 << 20, memory_limit);
+        auto wanted = positions.begin();
+        for (auto position = std::size_t{0}; wanted != positions.end() && reader.next(); ++position) {
+            if (position != *wanted)
+                continue;
+            auto crc = std::uint32_t{0};
+            auto end = std::uint64_t{0};
+            while (auto const block = reader.read_block()) {
+                for (; end < block->offset; ) {
+                    auto const size = static_cast<std::size_t>(std::min<std::uint64_t>(block->offset - end, zeros.size()));
+                    crc = zfiles::crc32(std::span(zeros).first(size), crc);
+                    end += size;
+                }
+                crc = zfiles::crc32(block->data, crc);
+                end += block->data.size();
+            }
+            result.emplace(position, crc);
+            ++wanted;
+        }
+        return result;
+    }
+}
+
+auto run_diff(const std::filesystem::path& left_path, const std::filesystem::path& right_path, std::FILE* output, std::optional<std::uint64_t> memory_limit) -> int
+{
+    // Both sides are read at the same time, headers first, then the
+    // contents that need hashing.
+    auto scheduler = zfiles::Scheduler(2);
+    auto left = std::optional<zfiles::Index>{};
+    auto right = std::optional<zfiles::Index>{};
+    scheduler.submit([&] { left.emplace(left_path, memory_limit); });
+    scheduler.submit([&] { right.emplace(right_path, memory_limit); });
+    scheduler.wait();
+
+    auto const& left_entries = left->entries();
+    auto const& right_entries = right->entries();
+    auto const left_sorted = unique_sorted(*left);
+    auto const right_sorted = unique_sorted(*right);
+    auto differences = std::vector<Difference>{};
+    auto left_unhashed = std::vector<std::size_t>{};
+    auto right_unhashed = std::vector<std::size_t>{};
+    auto l = left_sorted.begin();
+    auto r = right_sorted.begin();
+    while (l != left_sorted.end() || r != right_sorted.end()) {
+        if (r == right_sorted.end() || (l != left_sorted.end() && left_entries[*l].path < right_entries[*r].path)) {
+            differences.push_back(Difference{Change::Removed, *l++, 0});
+        } else if (l == left_sorted.end() || right_entries[*r].path < left_entries[*l].path) {
+            differences.push_back(Difference{Change::Added, 0, *r++});
+        } else {
+            if (auto const change = compare(left_entries[*l], right_entries[*r])) {
+                differences.push_back(Difference{*change, *l, *r});
+                if (*change == Change::Unknown) {
+                    if (!left_entries[*l].crc32)
+                        left_unhashed.push_back(*l);
+                    if (!right_entries[*r].crc32)
+                        right_unhashed.push_back(*r);
+                }
+            }
+            ++l;
+            ++r;
+        }
+    }
+
+    if (!left_unhashed.empty() || !right_unhashed.empty()) {
+        std::sort(left_unhashed.begin(), left_unhashed.end());
+        std::sort(right_unhashed.begin(), right_unhashed.end());
+        auto left_hashes = std::unordered_map<std::size_t, std::uint32_t>{};
+        auto right_hashes = std::unordered_map<std::size_t, std::uint32_t>{};
+        scheduler.submit([&] { left_hashes = hash_entries(left_path, left_unhashed, memory_limit); });
+        scheduler.submit([&] { right_hashes = hash_entries(right_path, right_unhashed, memory_limit); });
+        scheduler.wait();
+        auto hash = [](const zfiles::IndexEntry& entry, const std::unordered_map<std::size_t, std::uint32_t>& hashes, std::size_t position) {
+            auto const found = hashes.find(position);
+            return entry.crc32 ? entry.crc32 : found != hashes.end() ? std::optional(found->second) : std::nullopt;
+        };
+        for (auto& difference : differences) {
+            if (difference.change != Change::Unknown)
+                continue;
+            auto const left_hash = hash(left_entries[difference.left], left_hashes, difference.left);
+            auto const right_hash = hash(right_entries[difference.right], right_hashes, difference.right);
+            if (!left_hash || !right_hash || *left_hash != *right_hash)
+                difference.change = Change::Modified;
+        }
+    }
+
+    auto changed = false;
+    for (auto const& difference : differences) {
+        if (difference.change == Change::Unknown)
+            continue;
+        auto const& path = difference.change == Change::Added ? right_entries[difference.right].path : left_entries[difference.left].path;
+        fmt::print(output, "{} {}\n", static_cast<char>(difference.change), path);
+        changed = true;
+    }
+    return changed ? 1 : 0;
+}
@@ -0,0 +1,196 @@
+#include <list_writer.h>
+#include <cmd/utf8.h>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <iterator>
+#include <system_error>
+
+namespace
+{
+    using namespace std::string_view_literals;
+
+    void append(fmt::memory_buffer& buffer, std::string_view text)
+    {
+        buffer.append(text.data(), text.data() + text.size());
+    }
+    // Paths are bytes: those that are not UTF-8 come out as U+FFFD, one for
+    // each, so that every line stays valid JSON.
+    void append_json_string(fmt::memory_buffer& buffer, std::string_view text)
+    {
+        buffer.push_back('"');
+        auto run = text.data();
+        auto const end = text.data() + text.size();
+        for (auto it = run; it != end; ++it) {
+            auto const c = static_cast<unsigned char>(*it);
+            if (c >= 0x80) {
+                auto const decoded = cmd::utils::uni::detail::decode(text, static_cast<std::size_t>(it - text.data()));
+                if (decoded) {
+                    it += decoded->length - 1;
+                    continue;
+                }
+                buffer.append(run, it);
+                append(buffer, "\\ufffd");
+                run = it + 1;
+                continue;
+            }
+            if (c >= 0x20 && c != '"' && c != '\\')
+                continue;
+            buffer.append(run, it);
+            switch (c) {
+                case '"': append(buffer, "\\\""); break;
+                case '\\': append(buffer, "\\\\"); break;
+                case '\n': append(buffer, "\\n"); break;
+                case '\r': append(buffer, "\\r"); break;
+                case '\t': append(buffer, "\\t"); break;
+                default: fmt::format_to(std::back_inserter(buffer), "\\u{:04x}", c); break;
+            }
+            run = it + 1;
+        }
+        buffer.append(run, end);
+        buffer.push_back('"');
+    }
+    void append_tsv_field(fmt::memory_buffer& buffer, std::string_view text)
+    {
+        auto run = text.data();
+        auto const end = text.data() + text.size();
+        for (auto it = run; it != end; ++it) {
+            if (*it != '\t' && *it != '\n' && *it != '\r' && *it != '\\')
+                continue;
+            buffer.append(run, it);
+            switch (*it) {
+                case '\t': append(buffer, "\\t"); break;
+                case '\n': append(buffer, "\\n"); break;
+                case '\r': append(buffer, "\\r"); break;
+                default: append(buffer, "\\\\"); break;
+            }
+            run = it + 1;
+        }
+        buffer.append(run, end);
+    }
+
+    auto type_name(zfiles::EntryType type) -> std::string_view
+    {
+        constexpr auto names = std::array{ "file"sv, "directory"sv, "symlink"sv, "other"sv };
+        return names[static_cast<std::size_t>(type)];
+    }
+    // ls-style "drwxr-xr-x"
+    void append_mode(fmt::memory_buffer& buffer, zfiles::EntryType type, std::uint32_t mode)
+    {
+        constexpr auto type_chars = std::array{ '-', 'd', 'l', '?' };
+        buffer.push_back(type_chars[static_cast<std::size_t>(type)]);
+        for (auto shift = 6; shift >= 0; shift -= 3) {
+            buffer.push_back(mode & (4u << shift) ? 'r' : '-');
+            buffer.push_back(mode & (2u << shift) ? 'w' : '-');
+            buffer.push_back(mode & (1u << shift) ? 'x' : '-');
+        }
+    }
+    // UTC "YYYY-MM-DD HH:MM", without going through the C locale functions.
+    void append_time(fmt::memory_buffer& buffer, std::int64_t mtime)
+    {
+        auto const time = std::chrono::sys_seconds{std::chrono::seconds{mtime}};
+        auto const day = std::chrono::floor<std::chrono::days>(time);
+        auto const date = std::chrono::year_month_day{day};
+        auto const clock = std::chrono::hh_mm_ss{time - day};
+        fmt::format_to(std::back_inserter(buffer), "{:04}-{:02}-{:02} {:02}:{:02}",
+            static_cast<int>(date.year()), static_cast<unsigned>(date.month()), static_cast<unsigned>(date.day()),
+            clock.hours().count(), clock.minutes().count());
+    }
+}
+
+auto parse_list_format(std::string_view name) -> std::optional<ListFormat>
+{
+    if (name == "text")
+        return ListFormat::Text;
+    if (name == "ndjson")
+        return ListFormat::Ndjson;
+    if (name == "tsv")
+        return ListFormat::Tsv;
+    return std::nullopt;
+}
+
+ListWriter::ListWriter(std::FILE* output, ListFormat format) : output(output), format(format)
+{
+    buffer.reserve(flush_threshold + 4096);
+}
+ListWriter::~ListWriter()
+{
+    // Errors are left to an explicit flush() to report.
+    try {
+        flush();
+    } catch (const std::exception&) {
+    }
+}
+
+void ListWriter::begin_archive(std::string_view archive)
+{
+    if (format == ListFormat::Text)
+        fmt::format_to(std::back_inserter(buffer), "{}{}:\n", this->archive ? "\n" : "", archive);
+    this->archive = archive;
+}
+
+void ListWriter::write(const zfiles::Entry& entry)
+{
+    auto out = std::back_inserter(buffer);
+    switch (format) {
+        case ListFormat::Text:
+            append_mode(buffer, entry.type, entry.mode);
+            if (entry.size)
+                fmt::format_to(out, " {:>12} ", *entry.size);
+            else
+                append(buffer, "            - ");
+            append_time(buffer, entry.mtime);
+            buffer.push_back(' ');
+            append(buffer, entry.path);
+            if (entry.type == zfiles::EntryType::Symlink) {
+                append(buffer, " -> ");
+                append(buffer, entry.link_target);
+            }
+            buffer.push_back('\n');
+            break;
+        case ListFormat::Ndjson:
+            buffer.push_back('{');
+            if (archive) {
+                append(buffer, "\"archive\":");
+                append_json_string(buffer, *archive);
+                buffer.push_back(',');
+            }
+            append(buffer, "\"path\":");
+            append_json_string(buffer, entry.path);
+            fmt::format_to(out, ",\"type\":\"{}\",\"size\":", type_name(entry.type));
+            if (entry.size)
+                fmt::format_to(out, "{}", *entry.size);
+            else
+                append(buffer, "null");
+            fmt::format_to(out, ",\"mtime\":{},\"mode\":\"{:04o}\"", entry.mtime, entry.mode);
+            if (entry.type == zfiles::EntryType::Symlink) {
+                append(buffer, ",\"target\":");
+                append_json_string(buffer, entry.link_target);
+            }
+            append(buffer, "}\n");
+            break;
+        case ListFormat::Tsv:
+            if (archive) {
+                append_tsv_field(buffer, *archive);
+                buffer.push_back('\t');
+            }
+            append_tsv_field(buffer, entry.path);
+            fmt::format_to(out, "\t{}\t", type_name(entry.type));
+            if (entry.size)
+                fmt::format_to(out, "{}", *entry.size);
+            fmt::format_to(out, "\t{}\t{:04o}\n", entry.mtime, entry.mode);
+            break;
+    }
+    if (buffer.size() >= flush_threshold)
+        flush();
+}
+
+void ListWriter::flush()
+{
+    if (buffer.size() == 0)
+        return;
+    auto const complete = std::fwrite(buffer.data(), 1, buffer.size(), output) == buffer.size();
+    buffer.clear();
+    if (!complete || std::fflush(output) != 0)
+        throw std::system_error(errno, std::generic_category(), "write listing");
+}
@@ -1,59 +1,489 @@
+#include <batch.h>
+#include <bench.h>
+#include <compress.h>
+#include <convert.h>
+#include <diff.h>
 #include <cmd_parser.h>
+#include <cmd/schema.h>
+#include <cmd/validators.h>
+#include <list_writer.h>
+#include <raw_output.h>
+#include <serve.h>
+#include <zfiles/codec.h>
+#include <zfiles/reader.h>
+#include <zfiles/scheduler.h>
 #include <fmt/format.h>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <thread>
+#include <unistd.h>
 #include <span>
 #include <tl/expected.hpp>
 #include <string_view>
 #include <ranges>
 #include <variant>
 
-auto parse_argumnts(int argc, char **argv) -> cmd::result::PosExpected<cmd::result::Result> 
-{
-    cmd::Parser parser;
-    auto& cmd_compress = parser.make_command("compress", 'c').set_description("Compress files and directories");
-    cmd_compress.make_argument("output", 'o').set_description("Output file").set_required(true);
-    cmd_compress
-        .make_argument("check", 'c')
-        .set_validator([](std::string_view value) -> bool {
-            using namespace std::string_view_literals;
-            static auto constexpr types = std::array{"hello"sv, "world"sv};
-            return std::find(types.begin(), types.end(), value) != types.end();
-        })
-        .set_description("Output file");
-    cmd_compress.make_flag("verbose", 'v').set_description("Verbose mode").set_max(3);
-    cmd_compress.make_flag("Flag1", 'a').set_description("Test flag 1");
-    cmd_compress.make_flag("Flag2", 'b').set_description("Test flag 2");
-    parser.set_global_command("compress");
-    parser.make_command("extract", 'x').set_description("Extract files from compressed file");
-    parser.make_command("list", 'l').set_description("Explore compressed file");
-
-    auto result = parser.parse(std::span(argv, argv+argc));
-    return std::move(result);
+namespace
+{
+    namespace schema = cmd::schema;
+    namespace types = cmd::types;
+    namespace validators = cmd::validators;
+    using namespace std::string_view_literals;
+
+    constexpr auto is_level = validators::in_range<0, std::numeric_limits<int>::max()>;
+    constexpr auto check_values = std::array{"hello"sv, "world"sv};
+    constexpr auto policies = std::array{"fast"sv, "balanced"sv, "max"sv};
+    constexpr auto bench_formats = std::array{"text"sv, "json"sv};
+
+    constexpr auto compress_arguments = std::array{
+        schema::Argument{ .longname = "output", .shortname = 'o', .description = "Output file", .required = true },
+        schema::Argument{
+            .longname = "check",
+            .shortname = 'c',
+            .description = "Output file",
+            .validator = validators::one_of<check_values>,
+        },
+        schema::Argument{
+            .longname = "level",
+            .shortname = 'l',
+            .description = "Compression level, or \"auto\" to adapt it to the throughput while compressing",
+            .validator = [](std::string_view value) -> bool {
+                return value == "auto" || is_level(value);
+            },
+        },
+        schema::Argument{
+            .longname = "target-rate",
+            .description = "Throughput in MB/s that --level=auto keeps up with (default: input read rate)",
+            .type = types::Integer{ .min = 1 },
+        },
+        schema::Argument{
+            .longname = "policy",
+            .shortname = 'p',
+            .description = "Pick the level, or storing, per file content in zip and tar.zst: fast, balanced or max",
+            .validator = validators::one_of<policies>,
+        },
+        schema::Argument{
+            .longname = "long",
+            .description = "zstd long-distance matching across files with a window of 2^N bytes (10 to 31)",
+            .type = types::Integer{ .min = 10, .max = 31 },
+        },
+        schema::Argument{
+            .longname = "memory-limit",
+            .description = "Memory cap for the zstd match window, with K, M or G suffix; readers need as much",
+            .type = types::Size{},
+        },
+        schema::Argument{
+            .longname = "volume-size",
+            .description = "Split the archive into volumes OUTPUT.001, OUTPUT.002... of this size, with K, M or G suffix",
+            .type = types::Size{ .min = 1 },
+        },
+    };
+    constexpr auto compress_flags = std::array{
+        schema::Flag{ .longname = "verbose", .shortname = 'v', .description = "Verbose mode", .max = 3 },
+        schema::Flag{ .longname = "Flag1", .shortname = 'a', .description = "Test flag 1" },
+        schema::Flag{ .longname = "Flag2", .shortname = 'b', .description = "Test flag 2" },
+    };
+    constexpr auto list_arguments = std::array{
+        schema::Argument{
+            .longname = "format",
+            .shortname = 'f',
+            .description = "Output format: text, ndjson or tsv",
+            .validator = [](std::string_view value) -> bool {
+                return parse_list_format(value).has_value();
+            },
+        },
+        schema::Argument{ .longname = "output", .shortname = 'o', .description = "Write the listing to this file instead of stdout" },
+        schema::Argument{ .longname = "include", .shortname = 'i', .description = "Only list entries matching this glob (or re:regex); repeatable" },
+        schema::Argument{ .longname = "exclude", .shortname = 'e', .description = "Leave out entries matching this glob (or re:regex); repeatable" },
+        schema::Argument{
+            .longname = "memory-limit",
+            .description = "Refuse zstd archives whose match window needs more memory, with K, M or G suffix (default: 128M)",
+            .type = types::Size{},
+        },
+    };
+    constexpr auto batch_arguments = std::array{
+        schema::Argument{
+            .longname = "jobs",
+            .shortname = 'j',
+            .description = "Number of archives processed at the same time (default: number of cores)",
+            .type = types::Integer{ .min = 1, .max = std::numeric_limits<unsigned>::max() },
+        },
+    };
+    constexpr auto serve_arguments = std::array{
+        schema::Argument{
+            .longname = "cache-size",
+            .description = "Memory kept for decoded entries, with K, M or G suffix (default: 256M)",
+            .type = types::Size{},
+            .default_value = "256M",
+        },
+        schema::Argument{
+            .longname = "memory-limit",
+            .description = "Refuse zstd archives whose match window needs more memory, with K, M or G suffix (default: 128M)",
+            .type = types::Size{},
+        },
+    };
+    constexpr auto diff_arguments = std::array{
+        schema::Argument{
+            .longname = "memory-limit",
+            .description = "Refuse zstd archives whose match window needs more memory, with K, M or G suffix (default: 128M)",
+            .type = types::Size{},
+        },
+    };
+    constexpr auto bench_arguments = std::array{
+        schema::Argument{
+            .longname = "sample-size",
+            .description = "Bytes sampled from the inputs, with K, M or G suffix (default: 16M)",
+            .type = types::Size{},
+        },
+        schema::Argument{
+            .longname = "block-size",
+            .description = "Size of the independently compressed blocks (default: 1M)",
+            .type = types::Size{ .min = 1, .max = std::numeric_limits<std::size_t>::max() },
+        },
+        schema::Argument{
+            .longname = "codec",
+            .description = "Only measure this codec",
+            .validator = [](std::string_view value) -> bool {
+                return zfiles::find_codec(value) != nullptr;
+            },
+        },
+        schema::Argument{
+            .longname = "filter",
+            .description = "Run these filters in front of every codec, e.g. x86, arm64, delta:N, transpose:N or x86,delta:4",
+            .validator = [](std::string_view value) -> bool {
+                try {
+                    zfiles::make_filter_chain(value);
+                    return true;
+                } catch (const zfiles::Error&) {
+                    return false;
+                }
+            },
+        },
+        schema::Argument{
+            .longname = "format",
+            .shortname = 'f',
+            .description = "Output format: text or json",
+            .validator = validators::one_of<bench_formats>,
+        },
+    };
+    constexpr auto convert_arguments = std::array{
+        schema::Argument{
+            .longname = "level",
+            .shortname = 'l',
+            .description = "Compression level of the destination",
+            .type = types::Integer{ .min = 0, .max = std::numeric_limits<int>::max() },
+        },
+        schema::Argument{ .longname = "include", .shortname = 'i', .description = "Only keep entries matching this glob (or re:regex); repeatable" },
+        schema::Argument{ .longname = "exclude", .shortname = 'e', .description = "Leave out entries matching this glob (or re:regex); repeatable" },
+        schema::Argument{
+            .longname = "memory-limit",
+            .description = "Refuse a zstd source whose match window needs more memory, with K, M or G suffix (default: 128M)",
+            .type = types::Size{},
+        },
+    };
+
+    constexpr auto commands = std::array{
+        schema::Command{
+            .longname = "compress",
+            .shortname = 'c',
+            .description = "Compress files and directories",
+            .arguments = compress_arguments,
+            .flags = compress_flags,
+            .input_validator = validators::existing_path,
+            .input_files = true,
+        },
+        schema::Command{ .longname = "extract", .shortname = 'x', .description = "Extract files from compressed file" },
+        schema::Command{ .longname = "list", .shortname = 'l', .description = "Explore compressed file", .arguments = list_arguments, .input_files = true },
+        schema::Command{ .longname = "cat", .description = "Write entries of an archive to standard output: cat ARCHIVE [ENTRY...]", .input_files = true },
+        schema::Command{ .longname = "batch", .shortname = 'b', .description = "Run the commands of a manifest file (or stdin), one per line", .arguments = batch_arguments },
+        schema::Command{ .longname = "serve", .description = "Answer list/stat/read requests on a Unix socket: serve SOCKET", .arguments = serve_arguments },
+        schema::Command{ .longname = "bench", .description = "Measure every codec and level on a sample of the given files", .arguments = bench_arguments, .input_files = true },
+        schema::Command{ .longname = "convert", .description = "Rewrite an archive into another format, e.g. zip to tar.zst: convert SOURCE DESTINATION", .arguments = convert_arguments },
+        schema::Command{ .longname = "diff", .description = "List entries added, removed or changed between two archives: diff OLD NEW", .arguments = diff_arguments },
+    };
+    constexpr auto command_line = schema::Schema{ .commands = commands, .global_command = "compress" };
+}
+
+auto make_parser() -> cmd::Parser
+{
+    return cmd::schema::make_parser<command_line>();
+}
+
+auto run_compress(const cmd::result::Command& command) -> int
+{
+    auto const options = compress_options(command);
+    if (!options) {
+        fmt::print(stderr, "compress: {}\n", options.error());
+        return 1;
+    }
+    auto const inputs = command.get_inputs();
+    if (inputs.empty()) {
+        fmt::print(stderr, "compress: no input given\n");
+        return 1;
+    }
+    // Volumes are written while the next ones are encoded.
+    auto scheduler = std::optional<zfiles::Scheduler>{};
+    if (options->volume_size)
+        scheduler.emplace(4);
+    return run_compress(inputs, std::filesystem::path(command.get_argument("output").value()), *options, scheduler ? &*scheduler : nullptr);
+}
+
+auto run_list(const cmd::result::Command& command) -> int
+{
+    auto const format = parse_list_format(command.get_argument("format").value_or("text")).value();
+    auto const output = command.get_argument("output");
+    auto const archives = command.get_inputs();
+    auto const include = command.get_arguments("include");
+    auto const exclude = command.get_arguments("exclude");
+    auto const memory_limit = command.get_size("memory-limit");
+    if (archives.empty()) {
+        fmt::print(stderr, "list: no archive given\n");
+        return 1;
+    }
+    // Compiled once; every archive gets a copy of the automaton built so far.
+    auto filter = zfiles::PathFilter(include, exclude);
+    auto const file = output ? std::fopen(std::string(*output).c_str(), "wb") : stdout;
+    if (!file) {
+        fmt::print(stderr, "list: {}: cannot open for writing\n", *output);
+        return 1;
+    }
+    auto close = std::unique_ptr<std::FILE, decltype(&std::fclose)>(output ? file : nullptr, &std::fclose);
+    auto writer = ListWriter(file, format);
+    for (auto archive : archives) {
+        if (archives.size() > 1)
+            writer.begin_archive(archive);
+        auto reader = zfiles::Reader(std::filesystem::path(archive), 1 << 20, memory_limit);
+        if (!include.empty() || !exclude.empty())
+            reader.set_filter(filter);
+        while (auto entry = reader.next())
+            writer.write(*entry);
+    }
+    writer.flush();
+    // The last blocks of a file only reach the disk, or fail to, on close.
+    if (close && std::fclose(close.release()) != 0) {
+        fmt::print(stderr, "list: {}: {}\n", *output, std::strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+using ArgumentStream = cmd::Parser::Stream<std::span<char*>>;
+
+// Entries are read from the stream as they are given, so a long list piped
+// in with --files-from=- is served while it is still being written.
+auto run_cat(ArgumentStream& parameters) -> int
+{
+    auto archive = std::optional<std::filesystem::path>{};
+    auto reader = std::optional<zfiles::Reader>{};
+    auto output = RawOutput(STDOUT_FILENO);
+    auto copy_entry = [&](zfiles::Reader& reader, const zfiles::Entry& entry) {
+        if (auto const offset = reader.stored_offset()) {
+            output.copy_from(*archive, *offset, *entry.size);
+            return;
+        }
+        auto position = std::uint64_t{0};
+        while (auto const block = reader.read_block()) {
+            if (block->offset > position)
+                output.write_zeros(block->offset - position);
+            output.write(block->data);
+            position = block->offset + block->data.size();
+        }
+        if (entry.size && *entry.size > position)
+            output.write_zeros(*entry.size - position);
+    };
+
+    // Entries are written in the order asked for; going back to an entry
+    // already passed restarts the scan from the beginning of the archive,
+    // which goes on up to where the search started: one pass in all.
+    auto wanted = false;
+    auto read_count = std::size_t{0};
+    for (auto const& parameter : parameters) {
+        if (!parameter) {
+            fmt::print(stderr, "error parsing arguments: {}\n", parameter.error().to_string());
+            return 1;
+        }
+        auto const input = std::get_if<cmd::result::Input>(&*parameter);
+        if (!input)
+            continue;
+        if (!archive) {
+            archive.emplace(*input);
+            reader.emplace(*archive);
+            continue;
+        }
+        wanted = true;
+        auto const path = *input;
+        auto const search_start = read_count;
+        auto restarted = false;
+        while (true) {
+            if (restarted && read_count == search_start) {
+                fmt::print(stderr, "cat: {}: not found in archive\n", path);
+                return 1;
+            }
+            auto const entry = reader->next();
+            if (!entry) {
+                if (search_start == 0) {
+                    fmt::print(stderr, "cat: {}: not found in archive\n", path);
+                    return 1;
+                }
+                reader.emplace(*archive);
+                read_count = 0;
+                restarted = true;
+                continue;
+            }
+            ++read_count;
+            if (entry->get().path == path) {
+                copy_entry(*reader, *entry);
+                break;
+            }
+        }
+    }
+    if (!archive) {
+        fmt::print(stderr, "cat: no archive given\n");
+        return 1;
+    }
+    if (!wanted) {
+        while (auto entry = reader->next()) {
+            if (entry->get().type == zfiles::EntryType::File)
+                copy_entry(*reader, *entry);
+        }
+    }
+    return 0;
+}
+
+auto run_batch(const cmd::Parser& parser, const cmd::result::Command& command) -> int
+{
+    auto concurrency = std::size_t{std::thread::hardware_concurrency()};
+    if (auto const jobs = command.get_integer("jobs"))
+        concurrency = static_cast<std::size_t>(*jobs);
+    auto const inputs = command.get_inputs();
+    auto const manifest = inputs.empty() ? std::nullopt : std::optional(inputs.back());
+    if (!manifest || *manifest == "-")
+        return run_batch(parser, stdin, concurrency);
+    auto const file = std::unique_ptr<std::FILE, decltype(&std::fclose)>(std::fopen(std::string(*manifest).c_str(), "rb"), &std::fclose);
+    if (!file) {
+        fmt::print(stderr, "batch: {}: cannot open\n", *manifest);
+        return 1;
+    }
+    return run_batch(parser, file.get(), concurrency);
+}
+
+auto run_serve(const cmd::result::Command& command) -> int
+{
+    auto const cache_size = command.get_size("cache-size").value();
+    auto const inputs = command.get_inputs();
+    if (inputs.empty()) {
+        fmt::print(stderr, "serve: no socket path given\n");
+        return 1;
+    }
+    return serve(std::filesystem::path(inputs.back()), cache_size, command.get_size("memory-limit"));
+}
+
+auto run_bench(const cmd::result::Command& command) -> int
+{
+    auto options = BenchOptions{};
+    if (auto const size = command.get_size("sample-size"))
+        options.sample_size = *size;
+    if (auto const size = command.get_size("block-size"))
+        options.block_size = static_cast<std::size_t>(*size);
+    if (auto const codec = command.get_argument("codec"))
+        options.codec = *codec;
+    options.filter = command.get_argument("filter");
+    options.json = command.get_argument("format") == "json";
+    auto const inputs = command.get_inputs();
+    if (inputs.empty()) {
+        fmt::print(stderr, "bench: no input given\n");
+        return 1;
+    }
+    return run_bench(inputs, options);
+}
+
+auto run_diff(const cmd::result::Command& command) -> int
+{
+    auto const inputs = command.get_inputs();
+    if (inputs.size() != 2) {
+        fmt::print(stderr, "diff: two archives expected\n");
+        return 2;
+    }
+    return run_diff(std::filesystem::path(inputs[0]), std::filesystem::path(inputs[1]), stdout, command.get_size("memory-limit"));
+}
+
+auto run_convert(const cmd::result::Command& command) -> int
+{
+    auto options = ConvertOptions{};
+    if (auto const level = command.get_integer("level"))
+        options.level = static_cast<int>(*level);
+    options.memory_limit = command.get_size("memory-limit");
+    auto const inputs = command.get_inputs();
+    auto const include = command.get_arguments("include");
+    auto const exclude = command.get_arguments("exclude");
+    if (inputs.size() != 2) {
+        fmt::print(stderr, "convert: a source and a destination archive are expected\n");
+        return 1;
+    }
+    if (!include.empty() || !exclude.empty())
+        options.filter.emplace(include, exclude);
+    return run_convert(std::filesystem::path(inputs[0]), std::filesystem::path(inputs[1]), std::move(options));
 }
 
 int main(int argc, char** argv)
 {
-    auto arg_result = parse_argumnts(argc, argv);
+    // The parse result refers to the parser's configuration, so it has to outlive it.
+    auto const parser = make_parser();
+    // Parsed parameters are allocated here, in a few growing blocks freed at exit.
+    auto arena = std::pmr::monotonic_buffer_resource(std::size_t{64} << 10);
+    auto const args = std::span(argv, argv+argc);
+    // cat works through its parameters as they are parsed; the other commands get them all at once.
+    if (parser.command_name(args) == "cat") {
+        auto stream = parser.stream(args, &arena);
+        try {
+            return run_cat(stream);
+        } catch (const std::exception& error) {
+            fmt::print(stderr, "error: {}\n", error.what());
+            return 1;
+        }
+    }
+    auto arg_result = parser.parse(args, &arena);
     if (!arg_result) {
         fmt::print("error parsing arguments: {}\n", arg_result.error().to_string());
         return 1;
     } 
     auto arguments = std::move(arg_result.value());
+    try {
+        if (arguments.command.name == "compress")
+            return run_compress(arguments.command);
+        if (arguments.command.name == "list")
+            return run_list(arguments.command);
+        if (arguments.command.name == "batch")
+            return run_batch(parser, arguments.command);
+        if (arguments.command.name == "serve")
+            return run_serve(arguments.command);
+        if (arguments.command.name == "bench")
+            return run_bench(arguments.command);
+        if (arguments.command.name == "diff")
+            return run_diff(arguments.command);
+        if (arguments.command.name == "convert")
+            return run_convert(arguments.command);
+    } catch (const std::exception& error) {
+        fmt::print(stderr, "error: {}\n", error.what());
+        return 1;
+    }
 
     fmt::print("program name: {}\n", arguments.program);
     fmt::print("command: {}\n", arguments.command.name);
-    if (!arguments.command.parameters.empty()) {
+    auto const& command = arguments.command;
+    if (!command.inputs.empty() || !command.arguments.empty() || std::ranges::any_of(command.flag_occurrences, [](auto count) { return count > 0; })) {
         fmt::print("argument(s):\n");
-        for (auto const& parameter : arguments.command.parameters) {
-            if (std::holds_alternative<cmd::result::Flag>(parameter)) {
-                auto const& flag = std::get<cmd::result::Flag>(parameter);
-                fmt::print("  flag {} ({}x)\n", flag.name, flag.occurrence);
-            } else if (std::holds_alternative<cmd::result::Argument>(parameter)) {
-                const auto& argument = std::get<cmd::result::Argument>(parameter);
-                fmt::print("  argument {} = {}\n", argument.name, argument.value);
-            } else {
-                fmt::print("  input: {}\n", std::get<cmd::result::Input>(parameter));
-            }
+        for (auto i = std::size_t{0}; i < command.flag_occurrences.size(); ++i) {
+            if (command.flag_occurrences[i] > 0)
+                fmt::print("  flag {} ({}x)\n", command.config->flags[i].longname, command.flag_occurrences[i]);
         }
+        for (auto const& argument : command.arguments)
+            fmt::print("  argument {} = {}\n", argument.name, argument.value);
+        for (auto const& input : command.inputs)
+            fmt::print("  input: {}\n", input);
     }
     return 0;
 }
\ No newline at end of file
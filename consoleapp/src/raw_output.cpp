@@ -0,0 +1,123 @@
+#include <raw_output.h>
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+namespace
+{
+    constexpr auto buffer_size = std::size_t{1} << 20;
+
+    [[noreturn]] void throw_errno(const char* what)
+    {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+}
+
+RawOutput::RawOutput(int fd) : fd(fd), is_pipe(false)
+{
+    struct stat status;
+    if (::fstat(fd, &status) == 0)
+        is_pipe = S_ISFIFO(status.st_mode);
+#if defined(__linux__)
+    // Larger pipes mean fewer wake-ups of the reader; the kernel may refuse.
+    if (is_pipe)
+        ::fcntl(fd, F_SETPIPE_SZ, static_cast<int>(buffer_size));
+#endif
+}
+RawOutput::~RawOutput()
+{
+    if (source >= 0)
+        ::close(source);
+}
+
+void RawOutput::write(std::span<const std::byte> data)
+{
+    while (!data.empty()) {
+        auto const written = ::write(fd, data.data(), data.size());
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            throw_errno("write");
+        }
+        data = data.subspan(static_cast<std::size_t>(written));
+    }
+}
+
+void RawOutput::write_zeros(std::uint64_t count)
+{
+    static const auto zeros = std::vector<std::byte>(64 * 1024);
+    for (; count > 0; ) {
+        auto const chunk = static_cast<std::size_t>(std::min<std::uint64_t>(count, zeros.size()));
+        write(std::span(zeros).first(chunk));
+        count -= chunk;
+    }
+}
+
+void RawOutput::copy_from(const std::filesystem::path& path, std::uint64_t offset, std::uint64_t length)
+{
+    auto const source_fd = open_source(path);
+    if (kernel_copy(source_fd, offset, length))
+        return;
+    buffer.resize(buffer_size);
+    while (length > 0) {
+        auto const count = ::pread(source_fd, buffer.data(), static_cast<std::size_t>(std::min<std::uint64_t>(length, buffer.size())), static_cast<off_t>(offset));
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            throw_errno("read");
+        }
+        if (count == 0)
+            throw std::system_error(std::make_error_code(std::errc::io_error), "unexpected end of archive");
+        write(std::span(buffer).first(static_cast<std::size_t>(count)));
+        offset += static_cast<std::uint64_t>(count);
+        length -= static_cast<std::uint64_t>(count);
+    }
+}
+
+auto RawOutput::open_source(const std::filesystem::path& path) -> int
+{
+    if (source >= 0 && source_path == path)
+        return source;
+    if (source >= 0)
+        ::close(source);
+    source = ::open(path.c_str(), O_RDONLY);
+    if (source < 0)
+        throw_errno("open");
+    source_path = path;
+    return source;
+}
+
+// Moves as much as the kernel accepts; returns false if the rest has to be
+// copied by hand, leaving `offset` and `length` at what remains.
+auto RawOutput::kernel_copy([[maybe_unused]] int source_fd, [[maybe_unused]] std::uint64_t& offset, [[maybe_unused]] std::uint64_t& length) -> bool
+{
+#if defined(__linux__)
+    while (length > 0) {
+        auto const chunk = static_cast<std::size_t>(std::min<std::uint64_t>(length, std::uint64_t{1} << 30));
+        auto position = static_cast<loff_t>(offset);
+        auto const moved = is_pipe
+            ? ::splice(source_fd, &position, fd, nullptr, chunk, SPLICE_F_MOVE | SPLICE_F_MORE)
+            : ::sendfile(fd, source_fd, &position, chunk);
+        if (moved < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EINVAL || errno == ENOSYS)
+                return false;
+            throw_errno(is_pipe ? "splice" : "sendfile");
+        }
+        if (moved == 0)
+            throw std::system_error(std::make_error_code(std::errc::io_error), "unexpected end of archive");
+        offset += static_cast<std::uint64_t>(moved);
+        length -= static_cast<std::uint64_t>(moved);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
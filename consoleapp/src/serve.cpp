@@ -0,0 +1,578 @@
+#include <serve.h>
+#include <zfiles/index.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    using namespace serve_protocol;
+    using Content = std::shared_ptr<const std::vector<std::byte>>;
+
+    volatile std::sig_atomic_t stop_requested = 0;
+    void request_stop(int) { stop_requested = 1; }
+
+    [[noreturn]] void throw_errno(const char* what)
+    {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    class Decoder {
+    public:
+        explicit Decoder(std::span<const std::byte> data) : data(data) {}
+
+        template <class T>
+        auto number() -> T {
+            auto const bytes = take(sizeof(T));
+            auto value = std::make_unsigned_t<T>{0};
+            for (auto i = sizeof(T); i-- > 0; )
+                value = static_cast<std::make_unsigned_t<T>>((value << 8) | std::to_integer<std::make_unsigned_t<T>>(bytes[i]));
+            return static_cast<T>(value);
+        }
+        auto string() -> std::string_view {
+            auto const bytes = take(number<std::uint32_t>());
+            return std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        }
+        auto empty() const -> bool { return data.empty(); }
+
+    private:
+        auto take(std::size_t size) -> std::span<const std::byte> {
+            if (size > data.size())
+                throw std::runtime_error("truncated request");
+            auto const bytes = data.first(size);
+            data = data.subspan(size);
+            return bytes;
+        }
+
+        std::span<const std::byte> data;
+    };
+
+    class Encoder {
+    public:
+        explicit Encoder(std::vector<std::byte>& output) : output(output) {}
+
+        template <class T>
+        void number(T value) {
+            using Bits = std::make_unsigned_t<T>;
+            auto bits = static_cast<Bits>(value);
+            for (auto i = std::size_t{0}; i < sizeof(T); ++i, bits = static_cast<Bits>(bits >> 8))
+                output.push_back(static_cast<std::byte>(bits & 0xff));
+        }
+        void string(std::string_view text) {
+            number(static_cast<std::uint32_t>(text.size()));
+            bytes(std::as_bytes(std::span(text)));
+        }
+        void bytes(std::span<const std::byte> data) {
+            output.insert(output.end(), data.begin(), data.end());
+        }
+        void entry(const zfiles::IndexEntry& entry) {
+            string(entry.path);
+            number(static_cast<std::uint8_t>(entry.type));
+            number(static_cast<std::uint8_t>(entry.size.has_value()));
+            number(entry.size.value_or(0));
+            number(entry.mtime);
+            number(entry.mode);
+            string(entry.link_target);
+        }
+
+    private:
+        std::vector<std::byte>& output;
+    };
+
+    // Decoded entries, least recently used first out, bounded in bytes.
+    class ContentCache {
+    public:
+        using Key = std::pair<std::uint64_t, std::size_t>;
+
+        explicit ContentCache(std::uint64_t capacity) : capacity(capacity) {}
+
+        // Whether an entry of this size can be kept at all
+        auto fits(std::uint64_t size) const -> bool {
+            return size <= capacity;
+        }
+
+        auto find(const Key& key) -> Content {
+            auto const found = items.find(key);
+            if (found == items.end())
+                return nullptr;
+            order.splice(order.begin(), order, found->second);
+            return found->second->second;
+        }
+        void insert(const Key& key, Content content) {
+            if (content->size() > capacity || items.contains(key))
+                return;
+            used += content->size();
+            order.emplace_front(key, std::move(content));
+            items.emplace(key, order.begin());
+            while (used > capacity) {
+                used -= order.back().second->size();
+                items.erase(order.back().first);
+                order.pop_back();
+            }
+        }
+
+    private:
+        struct KeyHash {
+            auto operator()(const Key& key) const noexcept -> std::size_t {
+                return std::hash<std::uint64_t>{}(key.first * 0x9e3779b97f4a7c15u ^ key.second);
+            }
+        };
+
+        std::uint64_t capacity;
+        std::uint64_t used = 0;
+        std::list<std::pair<Key, Content>> order;
+        std::unordered_map<Key, decltype(order)::iterator, KeyHash> items;
+    };
+
+    struct Archive {
+        // Tells cached contents of this archive apart from those of an earlier version.
+        std::uint64_t id;
+        std::filesystem::path path;
+        std::optional<std::uint64_t> memory_limit;
+        zfiles::Index index;
+        int fd;
+        struct stat identity;
+        // Reader left where the last decode stopped, so that entries read in
+        // archive order, and ranges of an entry read in order, are decoded in one pass.
+        std::optional<zfiles::Reader> cursor;
+        std::size_t next_position = 0;
+        // Block of the entry before `next_position` read but not passed yet,
+        // valid until the next read, and how much of the entry was passed.
+        std::optional<zfiles::Block> block;
+        std::uint64_t passed = 0;
+
+        Archive(std::uint64_t id, const std::filesystem::path& path, std::optional<std::uint64_t> memory_limit, int fd, const struct stat& identity)
+            : id(id), path(path), memory_limit(memory_limit), index(path, memory_limit), fd(fd), identity(identity) {}
+        Archive(const Archive&) = delete;
+        Archive& operator=(const Archive&) = delete;
+        ~Archive() { ::close(fd); }
+    };
+
+    auto same_file(const struct stat& a, const struct stat& b) -> bool
+    {
+        return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_size == b.st_size && a.st_mtime == b.st_mtime;
+    }
+
+    class Service {
+    public:
+        Service(std::uint64_t cache_size, std::optional<std::uint64_t> memory_limit) : cache(cache_size), memory_limit(memory_limit) {}
+
+        // Answers one request frame (without its size) into `output`. Returns
+        // the file descriptor to pass along with the response, or -1.
+        auto handle(std::span<const std::byte> frame, std::vector<std::byte>& output) -> int {
+            auto request = Decoder(frame);
+            auto const id = request.number<std::uint32_t>();
+            auto const start = output.size();
+            auto response = Encoder(output);
+            response.number(std::uint32_t{0});
+            response.number(id);
+            try {
+                response.number(static_cast<std::uint8_t>(Status::Ok));
+                auto const fd = answer(request, response);
+                finish(output, start);
+                return fd;
+            } catch (const std::exception& error) {
+                output.resize(start + 2 * sizeof(std::uint32_t));
+                response.number(static_cast<std::uint8_t>(Status::Error));
+                response.string(error.what());
+                finish(output, start);
+                return -1;
+            }
+        }
+
+    private:
+        static void finish(std::vector<std::byte>& output, std::size_t start) {
+            auto const length = output.size() - start - sizeof(std::uint32_t);
+            if (length > std::numeric_limits<std::uint32_t>::max())
+                throw std::runtime_error("response too large");
+            auto size = static_cast<std::uint32_t>(length);
+            for (auto i = std::size_t{0}; i < sizeof(size); ++i, size >>= 8)
+                output[start + i] = static_cast<std::byte>(size & 0xff);
+        }
+
+        auto answer(Decoder& request, Encoder& response) -> int {
+            auto const operation = static_cast<Operation>(request.number<std::uint8_t>());
+            auto const flags = request.number<std::uint8_t>();
+            auto& archive = open(request.string());
+            if (operation == Operation::List) {
+                auto const& entries = archive.index.entries();
+                response.number(static_cast<std::uint32_t>(entries.size()));
+                for (auto const& entry : entries)
+                    response.entry(entry);
+                return -1;
+            }
+            auto const path = request.string();
+            auto const position = archive.index.find(path);
+            if (!position)
+                throw std::runtime_error(fmt::format("{}: not found in archive", path));
+            auto const& entry = archive.index.entries()[*position];
+            if (operation == Operation::Stat) {
+                response.entry(entry);
+                return -1;
+            }
+            if (operation != Operation::Read)
+                throw std::runtime_error("unknown operation");
+
+            auto const offset = request.number<std::uint64_t>();
+            auto const length = request.number<std::uint64_t>();
+            if (entry.type != zfiles::EntryType::File)
+                throw std::runtime_error(fmt::format("{}: not a file", path));
+            if (entry.stored_offset) {
+                auto const begin = std::min(offset, *entry.size);
+                auto const size = std::min(length, *entry.size - begin);
+                if (flags & accept_fd) {
+                    response.number(std::uint8_t{1});
+                    response.number(*entry.stored_offset + begin);
+                    response.number(size);
+                    return archive.fd;
+                }
+                response.number(std::uint8_t{0});
+                response.number(std::min(size, max_read_size));
+                read_file(archive.fd, *entry.stored_offset + begin, std::min(size, max_read_size), response);
+                return -1;
+            }
+            // Entries too large to cache are decoded up to the range asked for only.
+            if (entry.size && !cache.fits(*entry.size)) {
+                auto const begin = std::min(offset, *entry.size);
+                auto const size = std::min({length, *entry.size - begin, max_read_size});
+                response.number(std::uint8_t{0});
+                response.number(size);
+                read_range(archive, *position, begin, size, response);
+                return -1;
+            }
+            auto const data = content(archive, *position);
+            auto const begin = std::min<std::uint64_t>(offset, data->size());
+            auto const size = std::min<std::uint64_t>({length, data->size() - begin, max_read_size});
+            response.number(std::uint8_t{0});
+            response.number(size);
+            response.bytes(std::span(*data).subspan(begin, size));
+            return -1;
+        }
+
+        // Loads the archive on first use, and again when the file has changed.
+        auto open(std::string_view name) -> Archive& {
+            auto error = std::error_code{};
+            auto path = std::filesystem::weakly_canonical(std::filesystem::path(name), error);
+            if (error)
+                path = name;
+            // A split archive is watched and opened through its first volume.
+            auto const file = zfiles::volume_paths(path).front();
+            struct stat identity;
+            if (::stat(file.c_str(), &identity) != 0)
+                throw_errno(file.c_str());
+            auto& slot = archives[path.string()];
+            if (!slot || !same_file(slot->identity, identity)) {
+                slot.reset();
+                auto const fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0)
+                    throw_errno(file.c_str());
+                try {
+                    slot = std::make_unique<Archive>(next_id++, path, memory_limit, fd, identity);
+                } catch (...) {
+                    ::close(fd);
+                    archives.erase(path.string());
+                    throw;
+                }
+            }
+            return *slot;
+        }
+
+        // Moves the archive's reader to entry `position`, staying where it is
+        // when it has not passed `offset` in that entry yet.
+        static void seek(Archive& archive, std::size_t position, std::uint64_t offset) {
+            if (archive.cursor && archive.next_position == position + 1 && archive.passed <= offset)
+                return;
+            if (!archive.cursor || archive.next_position > position) {
+                archive.cursor.reset();
+                archive.cursor.emplace(archive.path, 1 << 20, archive.memory_limit);
+                archive.next_position = 0;
+            }
+            while (archive.next_position <= position) {
+                if (!archive.cursor->next())
+                    throw std::runtime_error("archive changed while reading");
+                ++archive.next_position;
+            }
+            archive.block.reset();
+            archive.passed = 0;
+        }
+        // Block of the current entry the reader is on, or std::nullopt at its end.
+        static auto next_block(Archive& archive) -> std::optional<zfiles::Block> {
+            if (!archive.block)
+                archive.block = archive.cursor->read_block();
+            return archive.block;
+        }
+        static void pass_block(Archive& archive) {
+            archive.passed = archive.block->offset + archive.block->data.size();
+            archive.block.reset();
+        }
+
+        auto content(Archive& archive, std::size_t position) -> Content {
+            auto const key = ContentCache::Key(archive.id, position);
+            if (auto found = cache.find(key))
+                return found;
+            seek(archive, position, 0);
+            auto data = std::vector<std::byte>();
+            if (auto const size = archive.index.entries()[position].size)
+                data.reserve(*size);
+            while (auto const block = next_block(archive)) {
+                data.resize(block->offset);
+                data.insert(data.end(), block->data.begin(), block->data.end());
+                pass_block(archive);
+            }
+            if (auto const size = archive.index.entries()[position].size; size && *size > data.size())
+                data.resize(*size);
+            auto result = std::make_shared<const std::vector<std::byte>>(std::move(data));
+            cache.insert(key, result);
+            return result;
+        }
+
+        // Bytes [begin, begin + size) of an entry; holes stay zeros. The block
+        // reaching past the range is kept for the read of the next one.
+        static void read_range(Archive& archive, std::size_t position, std::uint64_t begin, std::uint64_t size, Encoder& response) {
+            seek(archive, position, begin);
+            auto data = std::vector<std::byte>(static_cast<std::size_t>(size));
+            auto const end = begin + size;
+            while (auto const block = next_block(archive)) {
+                auto const block_end = block->offset + block->data.size();
+                if (block->offset >= end)
+                    break;
+                if (block_end > begin) {
+                    auto const from = std::max(begin, block->offset);
+                    auto const to = std::min(end, block_end);
+                    std::memcpy(data.data() + (from - begin), block->data.data() + (from - block->offset), static_cast<std::size_t>(to - from));
+                }
+                if (block_end > end)
+                    break;
+                pass_block(archive);
+            }
+            response.bytes(data);
+        }
+
+        static void read_file(int fd, std::uint64_t offset, std::uint64_t size, Encoder& response) {
+            auto buffer = std::vector<std::byte>(static_cast<std::size_t>(size));
+            for (auto done = std::size_t{0}; done < buffer.size(); ) {
+                auto const count = ::pread(fd, buffer.data() + done, buffer.size() - done, static_cast<off_t>(offset + done));
+                if (count < 0 && errno == EINTR)
+                    continue;
+                if (count < 0)
+                    throw_errno("read");
+                if (count == 0)
+                    throw std::runtime_error("unexpected end of archive");
+                done += static_cast<std::size_t>(count);
+            }
+            response.bytes(buffer);
+        }
+
+        std::map<std::string, std::unique_ptr<Archive>> archives;
+        ContentCache cache;
+        std::optional<std::uint64_t> memory_limit;
+        std::uint64_t next_id = 0;
+    };
+
+    // Sends `data` with `fd` attached to its first byte, as far as the socket takes it.
+    auto send_with_fd(int socket, std::span<const std::byte> data, int fd) -> ssize_t
+    {
+        auto io = iovec{const_cast<std::byte*>(data.data()), data.size()};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        auto message = msghdr{};
+        message.msg_iov = &io;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        auto const header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+        return ::sendmsg(socket, &message, 0);
+    }
+
+    // Responses are queued and sent as the socket accepts them, so that a
+    // client slow to read holds up no one else. Past this many bytes waiting,
+    // its further requests are left unread until it catches up.
+    constexpr auto max_pending_output = std::size_t{64} << 20;
+
+    struct Connection {
+        int fd;
+        std::vector<std::byte> input;
+        std::vector<std::byte> output;
+        // Bytes of `output` already sent
+        std::size_t sent = 0;
+        // Descriptors to pass along with the byte of `output` at their offset,
+        // in order; they are duplicates, closed once sent.
+        std::deque<std::pair<std::size_t, int>> attached;
+
+        auto pending() const -> std::size_t {
+            return output.size() - sent;
+        }
+        void close() {
+            for (auto const& [offset, fd] : attached)
+                ::close(fd);
+            ::close(fd);
+        }
+    };
+
+    // Sends what the socket takes without blocking. Returns false if the
+    // connection has to be dropped.
+    auto flush(Connection& connection) -> bool
+    {
+        while (connection.pending() > 0) {
+            // A send stops before the next descriptor, which goes with its own first byte.
+            auto const with_fd = !connection.attached.empty() && connection.attached.front().first == connection.sent;
+            auto end = connection.output.size();
+            for (auto const& [offset, fd] : connection.attached) {
+                if (offset > connection.sent) {
+                    end = offset;
+                    break;
+                }
+            }
+            auto const data = std::span(connection.output).subspan(connection.sent, end - connection.sent);
+            auto const sent = with_fd
+                ? send_with_fd(connection.fd, data, connection.attached.front().second)
+                : ::send(connection.fd, data.data(), data.size(), 0);
+            if (sent < 0 && errno == EINTR)
+                continue;
+            if (sent < 0)
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            if (with_fd) {
+                ::close(connection.attached.front().second);
+                connection.attached.pop_front();
+            }
+            connection.sent += static_cast<std::size_t>(sent);
+        }
+        if (connection.sent == connection.output.size() || connection.sent >= max_pending_output) {
+            connection.output.erase(connection.output.begin(), connection.output.begin() + static_cast<std::ptrdiff_t>(connection.sent));
+            for (auto& [offset, fd] : connection.attached)
+                offset -= connection.sent;
+            connection.sent = 0;
+        }
+        return true;
+    }
+
+    // Answers the complete requests received so far, until too much output
+    // is waiting, then sends what it can. Returns false if the connection
+    // has to be dropped.
+    auto process(Connection& connection, Service& service) -> bool
+    {
+        auto consumed = std::size_t{0};
+        auto const input = std::span(connection.input);
+        while (input.size() - consumed >= sizeof(std::uint32_t) && connection.pending() < max_pending_output) {
+            auto const size = Decoder(input.subspan(consumed)).number<std::uint32_t>();
+            if (size < sizeof(std::uint32_t) || size > max_request_size)
+                return false;
+            if (input.size() - consumed - sizeof(std::uint32_t) < size)
+                break;
+            auto const frame = input.subspan(consumed + sizeof(std::uint32_t), size);
+            consumed += sizeof(std::uint32_t) + size;
+            auto const start = connection.output.size();
+            // The archive may be reopened, and its descriptor closed, before the response is sent.
+            if (auto const fd = service.handle(frame, connection.output); fd >= 0) {
+                auto const copy = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+                if (copy < 0)
+                    throw_errno("dup");
+                connection.attached.emplace_back(start, copy);
+            }
+        }
+        connection.input.erase(connection.input.begin(), connection.input.begin() + static_cast<std::ptrdiff_t>(consumed));
+        return flush(connection);
+    }
+}
+
+auto serve(const std::filesystem::path& socket_path, std::uint64_t cache_size, std::optional<std::uint64_t> memory_limit) -> int
+{
+    auto address = sockaddr_un{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.native().size() >= sizeof(address.sun_path)) {
+        fmt::print(stderr, "serve: {}: socket path too long\n", socket_path.string());
+        return 1;
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.native().size());
+
+    std::signal(SIGPIPE, SIG_IGN);
+    struct sigaction action = {};
+    action.sa_handler = request_stop;
+    ::sigaction(SIGINT, &action, nullptr);
+    ::sigaction(SIGTERM, &action, nullptr);
+
+    auto const listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+        throw_errno("socket");
+    struct stat existing;
+    if (::lstat(socket_path.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode))
+        ::unlink(socket_path.c_str());
+    if (::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listener, SOMAXCONN) != 0) {
+        auto const error = errno;
+        ::close(listener);
+        throw std::system_error(error, std::generic_category(), socket_path.string());
+    }
+
+    auto service = Service(cache_size, memory_limit);
+    auto connections = std::vector<Connection>{};
+    auto polled = std::vector<pollfd>{};
+    auto buffer = std::vector<std::byte>(64 * 1024);
+    while (!stop_requested) {
+        polled.assign(1, pollfd{listener, POLLIN, 0});
+        for (auto const& connection : connections) {
+            auto const events = (connection.pending() < max_pending_output ? POLLIN : 0) | (connection.pending() > 0 ? POLLOUT : 0);
+            polled.push_back(pollfd{connection.fd, static_cast<short>(events), 0});
+        }
+        if (::poll(polled.data(), polled.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            throw_errno("poll");
+        }
+        // Connections accepted now are polled from the next round on.
+        for (auto i = connections.size(); i-- > 0; ) {
+            if (!polled[i + 1].revents)
+                continue;
+            auto& connection = connections[i];
+            auto keep = !(polled[i + 1].revents & (POLLERR | POLLNVAL));
+            if (keep && (polled[i + 1].revents & (POLLIN | POLLHUP))) {
+                auto const received = ::recv(connection.fd, buffer.data(), buffer.size(), 0);
+                keep = received > 0 || (received < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK));
+                if (received > 0)
+                    connection.input.insert(connection.input.end(), buffer.begin(), buffer.begin() + received);
+            }
+            // Sending makes room for the requests left unanswered for lack of it.
+            if (keep) {
+                try {
+                    keep = process(connection, service);
+                } catch (const std::system_error&) {
+                    keep = false;
+                }
+            }
+            if (!keep) {
+                connection.close();
+                connections.erase(connections.begin() + static_cast<std::ptrdiff_t>(i));
+            }
+        }
+        if (polled[0].revents & POLLIN) {
+            if (auto const client = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC); client >= 0)
+                connections.push_back(Connection{ .fd = client, .input = {}, .output = {}, .sent = 0, .attached = {} });
+        }
+    }
+
+    for (auto& connection : connections)
+        connection.close();
+    ::close(listener);
+    ::unlink(socket_path.c_str());
+    return 0;
+}
@@ -3,4 +3,5 @@ target("consoleapp")
     set_languages("cxxlatest", "clatest")
     add_files("src/*.cpp")
     add_includedirs("include")
-    add_packages("fmt", "tl_expected")
\ No newline at end of file
+    add_packages("fmt", "tl_expected")
+    add_deps("zfiles")
\ No newline at end of file
@@ -0,0 +1,22 @@
+#pragma once
+#include "compress.h"
+#include <zfiles/filter.h>
+#include <functional>
+#include <memory>
+
+// Runs a fresh filter chain in front of `codec`.
+class FilteredCompress : public Compress {
+public:
+    FilteredCompress(std::unique_ptr<Compress> codec, std::function<zfiles::FilterChain()> make_chain);
+
+    std::vector<std::byte> compress(std::span<std::byte> data) const override;
+    std::vector<std::byte> decompress(std::span<std::byte> data) const override;
+    std::size_t compressed_size(std::span<std::byte> data) const override { return codec->compressed_size(data); }
+    std::size_t decompressed_size(std::span<std::byte> data) const override { return codec->decompressed_size(data); }
+
+    std::string_view name() const override { return codec->name(); }
+    std::string_view extension() const override { return codec->extension(); }
+private:
+    std::unique_ptr<Compress> codec;
+    std::function<zfiles::FilterChain()> make_chain;
+};
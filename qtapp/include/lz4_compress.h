@@ -0,0 +1,22 @@
+#pragma once
+#include "compress.h"
+
+// Native LZ4 codec producing and reading standard LZ4 frames (magic 0x184D2204).
+// Frames are written with independent 4 MiB blocks, a content size field and a
+// content checksum; any conforming frame, including block-linked ones and
+// skippable frames, can be read back.
+class Lz4Compress : public Compress {
+public:
+    Lz4Compress() = default;
+    ~Lz4Compress() override = default;
+
+    std::vector<std::byte> compress(std::span<std::byte> data) const override;
+    std::vector<std::byte> decompress(std::span<std::byte> data) const override;
+    // Size in bytes of the LZ4 frame(s) at the beginning of `data`.
+    std::size_t compressed_size(std::span<std::byte> data) const override;
+    // Size of the content stored in the LZ4 frame(s) of `data`.
+    std::size_t decompressed_size(std::span<std::byte> data) const override;
+
+    std::string_view name() const override { return "lz4"; }
+    std::string_view extension() const override { return "lz4"; }
+};
@@ -0,0 +1,22 @@
+#include <filtered_compress.h>
+
+FilteredCompress::FilteredCompress(std::unique_ptr<Compress> codec, std::function<zfiles::FilterChain()> make_chain)
+    : codec(std::move(codec)), make_chain(std::move(make_chain))
+{}
+std::vector<std::byte> FilteredCompress::compress(std::span<std::byte> data) const
+{
+    auto chain = make_chain();
+    auto filtered = std::vector<std::byte>{};
+    filtered.reserve(data.size());
+    chain.encode(data, true, filtered);
+    return codec->compress(filtered);
+}
+std::vector<std::byte> FilteredCompress::decompress(std::span<std::byte> data) const
+{
+    auto chain = make_chain();
+    auto raw = codec->decompress(data);
+    auto output = std::vector<std::byte>{};
+    output.reserve(raw.size());
+    chain.decode(raw, true, output);
+    return output;
+}
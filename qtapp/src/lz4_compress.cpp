@@ -0,0 +1,458 @@
+#include <lz4_compress.h>
+#include <zfiles/context_pool.h>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    constexpr auto frame_magic = std::uint32_t{0x184D2204};
+    constexpr auto skippable_magic = std::uint32_t{0x184D2A50};
+    constexpr auto skippable_mask = std::uint32_t{0xFFFFFFF0};
+    constexpr auto block_max_size = std::size_t{4} << 20;
+    constexpr auto min_match = std::size_t{4};
+    constexpr auto last_literals = std::size_t{5};
+    constexpr auto match_find_limit = std::size_t{12};
+    constexpr auto max_distance = std::size_t{65535};
+    constexpr auto hash_log = 12;
+    // A sequence expands to at most about 255 times its encoded size.
+    constexpr auto max_ratio = std::size_t{255};
+    // Decoding copies in 32 byte chunks and may overrun the end of a sequence
+    // by up to this many bytes, so the output buffer always keeps that margin.
+    constexpr auto wild_copy_slack = std::size_t{32};
+
+    namespace flg {
+        constexpr auto version = std::uint8_t{0x40};
+        constexpr auto version_mask = std::uint8_t{0xC0};
+        constexpr auto block_independence = std::uint8_t{0x20};
+        constexpr auto block_checksum = std::uint8_t{0x10};
+        constexpr auto content_size = std::uint8_t{0x08};
+        constexpr auto content_checksum = std::uint8_t{0x04};
+        constexpr auto reserved = std::uint8_t{0x02};
+        constexpr auto dictionary_id = std::uint8_t{0x01};
+    }
+
+    [[noreturn]] void fail(const char* what) {
+        throw std::runtime_error(std::string{"lz4: "} + what);
+    }
+
+    template <class T>
+    auto load(const std::byte* p) noexcept -> T {
+        T value;
+        std::memcpy(&value, p, sizeof(T));
+        return value;
+    }
+    template <class T>
+    auto load_le(const std::byte* p) noexcept -> T {
+        if constexpr (std::endian::native == std::endian::little)
+            return load<T>(p);
+        auto value = T{0};
+        for (auto i = std::size_t{0}; i < sizeof(T); ++i)
+            value |= static_cast<T>(std::to_integer<std::uint8_t>(p[i])) << (8 * i);
+        return value;
+    }
+    template <class T>
+    void store_le(std::byte* p, T value) noexcept {
+        for (auto i = std::size_t{0}; i < sizeof(T); ++i)
+            p[i] = static_cast<std::byte>(value >> (8 * i));
+    }
+    template <class T>
+    void store_le(std::vector<std::byte>& out, T value) {
+        out.resize(out.size() + sizeof(T));
+        store_le(out.data() + out.size() - sizeof(T), value);
+    }
+
+    auto xxh32(const std::byte* data, std::size_t size, std::uint32_t seed = 0) noexcept -> std::uint32_t {
+        constexpr auto p1 = std::uint32_t{2654435761U};
+        constexpr auto p2 = std::uint32_t{2246822519U};
+        constexpr auto p3 = std::uint32_t{3266489917U};
+        constexpr auto p4 = std::uint32_t{668265263U};
+        constexpr auto p5 = std::uint32_t{374761393U};
+        auto round = [](std::uint32_t acc, std::uint32_t input) {
+            return std::rotl(acc + input * p2, 13) * p1;
+        };
+        auto const end = data + size;
+        auto h = std::uint32_t{};
+        if (size >= 16) {
+            auto v1 = seed + p1 + p2;
+            auto v2 = seed + p2;
+            auto v3 = seed;
+            auto v4 = seed - p1;
+            for (; data + 16 <= end; data += 16) {
+                v1 = round(v1, load_le<std::uint32_t>(data));
+                v2 = round(v2, load_le<std::uint32_t>(data + 4));
+                v3 = round(v3, load_le<std::uint32_t>(data + 8));
+                v4 = round(v4, load_le<std::uint32_t>(data + 12));
+            }
+            h = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+        } else {
+            h = seed + p5;
+        }
+        h += static_cast<std::uint32_t>(size);
+        for (; data + 4 <= end; data += 4)
+            h = std::rotl(h + load_le<std::uint32_t>(data) * p3, 17) * p4;
+        for (; data < end; ++data)
+            h = std::rotl(h + std::to_integer<std::uint32_t>(*data) * p5, 11) * p1;
+        h ^= h >> 15;
+        h *= p2;
+        h ^= h >> 13;
+        h *= p3;
+        h ^= h >> 16;
+        return h;
+    }
+
+    auto hash(std::uint32_t sequence) noexcept -> std::uint32_t {
+        return (sequence * 2654435761U) >> (32 - hash_log);
+    }
+
+    // Number of equal bytes between `ip` and `ref` (ref < ip), stopping at `limit`.
+    auto match_length(const std::byte* ip, const std::byte* ref, const std::byte* limit) noexcept -> std::size_t {
+        auto const start = ip;
+#if defined(__AVX2__)
+        for (; ip + 32 <= limit; ip += 32, ref += 32) {
+            auto const a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ip));
+            auto const b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ref));
+            auto const mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)));
+            if (mask != 0xFFFFFFFFu)
+                return static_cast<std::size_t>(ip - start) + std::countr_one(mask);
+        }
+#endif
+#if defined(__SSE2__)
+        for (; ip + 16 <= limit; ip += 16, ref += 16) {
+            auto const a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ip));
+            auto const b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ref));
+            auto const mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)));
+            if (mask != 0xFFFFu)
+                return static_cast<std::size_t>(ip - start) + std::countr_one(mask);
+        }
+#endif
+        for (; ip + 8 <= limit; ip += 8, ref += 8) {
+            auto const diff = load<std::uint64_t>(ip) ^ load<std::uint64_t>(ref);
+            if (diff != 0) {
+                auto const bits = std::endian::native == std::endian::little ? std::countr_zero(diff) : std::countl_zero(diff);
+                return static_cast<std::size_t>(ip - start) + bits / 8;
+            }
+        }
+        for (; ip < limit && *ip == *ref; ++ip, ++ref)
+            ;
+        return static_cast<std::size_t>(ip - start);
+    }
+
+    auto write_length(std::byte* op, std::size_t length) noexcept -> std::byte* {
+        for (; length >= 255; length -= 255)
+            *op++ = std::byte{255};
+        *op++ = static_cast<std::byte>(length);
+        return op;
+    }
+    // Writes one sequence. A `match` of 0 writes the final, literals-only sequence.
+    auto write_sequence(std::byte* op, const std::byte* literals, std::size_t literal_length, std::size_t offset, std::size_t match) noexcept -> std::byte* {
+        auto const token = op++;
+        auto token_value = static_cast<unsigned>(std::min<std::size_t>(literal_length, 15)) << 4;
+        if (literal_length >= 15)
+            op = write_length(op, literal_length - 15);
+        std::memcpy(op, literals, literal_length);
+        op += literal_length;
+        if (match != 0) {
+            *op++ = static_cast<std::byte>(offset & 0xFF);
+            *op++ = static_cast<std::byte>(offset >> 8);
+            auto const match_code = match - min_match;
+            token_value |= static_cast<unsigned>(std::min<std::size_t>(match_code, 15));
+            if (match_code >= 15)
+                op = write_length(op, match_code - 15);
+        }
+        *token = static_cast<std::byte>(token_value);
+        return op;
+    }
+
+    auto compress_bound(std::size_t size) noexcept -> std::size_t {
+        return size + size / 255 + 16;
+    }
+
+    // Hash tables kept by each thread between frames; compress_block clears them.
+    struct HashTable {
+        using Context = std::vector<std::uint32_t>;
+        static constexpr auto name = "lz4 hash table";
+        static auto create() -> Context* { return new Context(std::size_t{1} << hash_log); }
+        static void reset(Context*) noexcept {}
+        static void destroy(Context* context) noexcept { delete context; }
+    };
+    using HashTablePool = zfiles::ContextPool<HashTable>;
+
+    // Greedy single-probe compressor, format-equivalent to LZ4_compress_default.
+    // `dst` must hold at least compress_bound(size) bytes.
+    auto compress_block(const std::byte* src, std::size_t size, std::byte* dst, std::vector<std::uint32_t>& table) noexcept -> std::size_t {
+        std::fill(table.begin(), table.end(), 0);
+        auto op = dst;
+        auto anchor = src;
+        auto const end = src + size;
+        if (size > match_find_limit) {
+            auto const match_limit = end - last_literals;
+            auto const find_limit = end - match_find_limit;
+            auto ip = src;
+            while (ip <= find_limit) {
+                auto const sequence = load<std::uint32_t>(ip);
+                auto& slot = table[hash(sequence)];
+                auto const ref = src + slot;
+                slot = static_cast<std::uint32_t>(ip - src);
+                if (ref >= ip || static_cast<std::size_t>(ip - ref) > max_distance || load<std::uint32_t>(ref) != sequence) {
+                    ip += 1 + (static_cast<std::size_t>(ip - anchor) >> 6);
+                    continue;
+                }
+                auto start = ip;
+                auto match = ref;
+                for (; start > anchor && match > src && start[-1] == match[-1]; --start, --match)
+                    ;
+                auto const length = min_match + match_length(ip + min_match, ref + min_match, match_limit);
+                op = write_sequence(op, anchor, static_cast<std::size_t>(start - anchor), static_cast<std::size_t>(ip - ref), length + static_cast<std::size_t>(ip - start));
+                ip += length;
+                anchor = ip;
+                if (ip <= find_limit)
+                    table[hash(load<std::uint32_t>(ip - 2))] = static_cast<std::uint32_t>(ip - 2 - src);
+            }
+        }
+        op = write_sequence(op, anchor, static_cast<std::size_t>(end - anchor), 0, 0);
+        return static_cast<std::size_t>(op - dst);
+    }
+
+    auto read_length(const std::byte*& ip, const std::byte* end, std::size_t length) -> std::size_t {
+        if (length != 15)
+            return length;
+        auto byte = std::uint8_t{};
+        do {
+            if (ip == end)
+                fail("truncated sequence length");
+            byte = std::to_integer<std::uint8_t>(*ip++);
+            length += byte;
+        } while (byte == 255);
+        return length;
+    }
+    // Copies a match whose source overlaps the destination when offset < length.
+    // Writes up to wild_copy_slack bytes past `op + length`.
+    void copy_match(std::byte* op, std::size_t offset, std::size_t length) noexcept {
+        auto const end = op + length;
+        auto src = op - offset;
+        if (offset < 8) {
+            // Expand the pattern until its period is at least 8 bytes, then copy it wide.
+            auto const period = offset * ((8 + offset - 1) / offset);
+            for (auto const expanded = std::min(end, op + (period - offset)); op < expanded; ++op, ++src)
+                *op = *src;
+            src = op - period;
+            offset = period;
+        }
+        if (offset >= 32) {
+            for (; op < end; op += 32, src += 32)
+                std::memcpy(op, src, 32);
+        } else if (offset >= 16) {
+            for (; op < end; op += 16, src += 16)
+                std::memcpy(op, src, 16);
+        } else {
+            for (; op < end; op += 8, src += 8)
+                std::memcpy(op, src, 8);
+        }
+    }
+    // Decodes one compressed block at `op`. `out_begin` is where the frame's
+    // content starts (linked blocks may reference earlier blocks) and `out_end`
+    // the last writable byte before the wild-copy margin.
+    auto decompress_block(std::span<const std::byte> block, std::byte* out_begin, std::byte* op, std::byte* out_end) -> std::byte* {
+        auto ip = block.data();
+        auto const end = ip + block.size();
+        while (true) {
+            if (ip == end)
+                fail("truncated block");
+            auto const token = std::to_integer<std::size_t>(*ip++);
+            auto const literal_length = read_length(ip, end, token >> 4);
+            if (literal_length > static_cast<std::size_t>(end - ip) || literal_length > static_cast<std::size_t>(out_end - op))
+                fail("literals out of bounds");
+            if (literal_length <= 16 && end - ip >= 16)
+                std::memcpy(op, ip, 16);
+            else
+                std::memcpy(op, ip, literal_length);
+            ip += literal_length;
+            op += literal_length;
+            if (ip == end)
+                return op;
+            if (end - ip < 2)
+                fail("truncated offset");
+            auto const offset = load_le<std::uint16_t>(ip);
+            ip += 2;
+            if (offset == 0 || offset > static_cast<std::size_t>(op - out_begin))
+                fail("invalid match offset");
+            auto const length = read_length(ip, end, token & 15) + min_match;
+            if (length > static_cast<std::size_t>(out_end - op))
+                fail("match out of bounds");
+            copy_match(op, offset, length);
+            op += length;
+        }
+    }
+
+    auto block_size_from_id(std::uint8_t bd) -> std::size_t {
+        auto const id = (bd >> 4) & 0x7;
+        if (id < 4 || (bd & 0x8F) != 0)
+            fail("invalid block descriptor");
+        return std::size_t{1} << (8 + 2 * id);
+    }
+
+    struct FrameSummary {
+        std::size_t compressed_size = 0;
+        std::optional<std::uint64_t> content_size = 0;
+    };
+    // Walks every frame of `data`. Blocks are decoded into `out` when it is
+    // given, otherwise only headers are read.
+    auto read_frames(std::span<const std::byte> data, std::vector<std::byte>* out) -> FrameSummary {
+        auto summary = FrameSummary{};
+        auto pos = std::size_t{0};
+        auto need = [&](std::size_t count) {
+            if (data.size() - pos < count)
+                fail("truncated frame");
+        };
+        while (pos < data.size()) {
+            need(4);
+            auto const magic = load_le<std::uint32_t>(data.data() + pos);
+            pos += 4;
+            if ((magic & skippable_mask) == skippable_magic) {
+                need(4);
+                auto const skip = load_le<std::uint32_t>(data.data() + pos);
+                pos += 4;
+                need(skip);
+                pos += skip;
+                continue;
+            }
+            if (magic != frame_magic)
+                fail("bad frame magic");
+            need(3);
+            auto const descriptor = data.data() + pos;
+            auto const flags = std::to_integer<std::uint8_t>(descriptor[0]);
+            if ((flags & flg::version_mask) != flg::version || (flags & flg::reserved) != 0)
+                fail("unsupported frame version");
+            auto const block_size = block_size_from_id(std::to_integer<std::uint8_t>(descriptor[1]));
+            auto descriptor_size = std::size_t{2};
+            auto content_size = std::optional<std::uint64_t>{};
+            if (flags & flg::content_size) {
+                need(descriptor_size + 8 + 1);
+                content_size = load_le<std::uint64_t>(descriptor + descriptor_size);
+                descriptor_size += 8;
+            }
+            if (flags & flg::dictionary_id)
+                fail("dictionaries are not supported");
+            need(descriptor_size + 1);
+            if (std::to_integer<std::uint8_t>(descriptor[descriptor_size]) != ((xxh32(descriptor, descriptor_size) >> 8) & 0xFF))
+                fail("header checksum mismatch");
+            pos += descriptor_size + 1;
+
+            auto const content_begin = out ? out->size() : std::size_t{0};
+            auto produced = content_begin;
+            // The header is not trusted with the buffer size: it is checked for
+            // overflow, the first allocation is capped by what the remaining input
+            // can expand to, and the buffer grows a block at a time from there.
+            auto content_end = std::optional<std::size_t>{};
+            if (content_size) {
+                if (*content_size > std::numeric_limits<std::size_t>::max() - wild_copy_slack - content_begin)
+                    fail("content size too large");
+                content_end = content_begin + static_cast<std::size_t>(*content_size);
+                if (out)
+                    out->reserve(content_begin + std::min<std::size_t>(*content_end - content_begin, (data.size() - pos) * max_ratio) + wild_copy_slack);
+            }
+            while (true) {
+                need(4);
+                auto const header = load_le<std::uint32_t>(data.data() + pos);
+                pos += 4;
+                if (header == 0)
+                    break;
+                auto const stored = (header & 0x80000000u) != 0;
+                auto const size = std::size_t{header & 0x7FFFFFFFu};
+                if (size > block_size)
+                    fail("block exceeds maximum size");
+                need(size + ((flags & flg::block_checksum) ? 4 : 0));
+                auto const block = data.subspan(pos, size);
+                if ((flags & flg::block_checksum) && xxh32(block.data(), size) != load_le<std::uint32_t>(data.data() + pos + size))
+                    fail("block checksum mismatch");
+                pos += size + ((flags & flg::block_checksum) ? 4 : 0);
+                if (!out)
+                    continue;
+                auto const limit = content_end ? std::min(*content_end, produced + block_size) : produced + block_size;
+                if (out->size() < limit + wild_copy_slack)
+                    out->resize(limit + wild_copy_slack);
+                auto const base = out->data();
+                if (stored) {
+                    if (size > limit - produced)
+                        fail("block exceeds content size");
+                    std::memcpy(base + produced, block.data(), size);
+                    produced += size;
+                } else {
+                    auto const op = decompress_block(block, base + content_begin, base + produced, base + limit);
+                    produced = static_cast<std::size_t>(op - base);
+                }
+            }
+            if (out)
+                out->resize(produced);
+            if (flags & flg::content_checksum) {
+                need(4);
+                if (out && xxh32(out->data() + content_begin, produced - content_begin) != load_le<std::uint32_t>(data.data() + pos))
+                    fail("content checksum mismatch");
+                pos += 4;
+            }
+            if (out && content_size && *content_size != produced - content_begin)
+                fail("content size mismatch");
+            if (summary.content_size && content_size)
+                *summary.content_size += *content_size;
+            else
+                summary.content_size = std::nullopt;
+        }
+        summary.compressed_size = pos;
+        return summary;
+    }
+}
+
+std::vector<std::byte> Lz4Compress::compress(std::span<std::byte> data) const
+{
+    auto out = std::vector<std::byte>{};
+    out.reserve(19 + compress_bound(data.size()) + 4 * (data.size() / block_max_size + 2));
+    store_le(out, frame_magic);
+    auto const descriptor_begin = out.size();
+    out.push_back(static_cast<std::byte>(flg::version | flg::block_independence | flg::content_size | flg::content_checksum));
+    out.push_back(std::byte{0x70}); // 4 MiB blocks
+    store_le(out, static_cast<std::uint64_t>(data.size()));
+    out.push_back(static_cast<std::byte>((xxh32(out.data() + descriptor_begin, out.size() - descriptor_begin) >> 8) & 0xFF));
+
+    auto const table = HashTablePool::acquire();
+    for (auto offset = std::size_t{0}; offset < data.size(); offset += block_max_size) {
+        auto const size = std::min(block_max_size, data.size() - offset);
+        auto const header_pos = out.size();
+        out.resize(header_pos + 4 + compress_bound(size));
+        auto compressed = compress_block(data.data() + offset, size, out.data() + header_pos + 4, *table);
+        auto header = static_cast<std::uint32_t>(compressed);
+        if (compressed >= size) {
+            std::memcpy(out.data() + header_pos + 4, data.data() + offset, size);
+            compressed = size;
+            header = static_cast<std::uint32_t>(size) | 0x80000000u;
+        }
+        store_le(out.data() + header_pos, header);
+        out.resize(header_pos + 4 + compressed);
+    }
+    store_le(out, std::uint32_t{0});
+    store_le(out, xxh32(data.data(), data.size()));
+    return out;
+}
+std::vector<std::byte> Lz4Compress::decompress(std::span<std::byte> data) const
+{
+    auto out = std::vector<std::byte>{};
+    read_frames(data, &out);
+    return out;
+}
+std::size_t Lz4Compress::compressed_size(std::span<std::byte> data) const
+{
+    return read_frames(data, nullptr).compressed_size;
+}
+std::size_t Lz4Compress::decompressed_size(std::span<std::byte> data) const
+{
+    if (auto const content_size = read_frames(data, nullptr).content_size)
+        return static_cast<std::size_t>(*content_size);
+    return decompress(data).size();
+}
@@ -0,0 +1,110 @@
+#include <zfiles/codec.h>
+#include <zfiles/context_pool.h>
+#include <zfiles/reader.h>
+#include <gtest/gtest.h>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    auto sample(std::size_t size) -> std::vector<std::byte>
+    {
+        auto data = std::vector<std::byte>(size);
+        auto random = std::mt19937(size);
+        for (auto i = std::size_t{0}; i < size; ++i)
+            data[i] = random() % 4 == 0 ? static_cast<std::byte>(random()) : static_cast<std::byte>('a' + i % 13);
+        return data;
+    }
+}
+
+TEST(ContextPool, ReusesContextsOfTheThread)
+{
+    using zfiles::ZstdCompressorPool;
+    auto const before = ZstdCompressorPool::idle_count();
+    const void* first = nullptr;
+    {
+        auto const lease = ZstdCompressorPool::acquire();
+        first = lease.get();
+    }
+    EXPECT_EQ(ZstdCompressorPool::idle_count(), std::max<std::size_t>(before, 1));
+    {
+        auto const lease = ZstdCompressorPool::acquire();
+        EXPECT_EQ(lease.get(), first);
+        // A second context at the same time is another one.
+        auto const other = ZstdCompressorPool::acquire();
+        EXPECT_NE(other.get(), first);
+    }
+    // Other threads keep their own.
+    auto seen = std::size_t{0};
+    std::thread([&] { seen = ZstdCompressorPool::idle_count(); }).join();
+    EXPECT_EQ(seen, 0u);
+
+    // Only a few are kept.
+    {
+        auto leases = std::vector<ZstdCompressorPool::Lease>{};
+        for (auto i = 0; i < 10; ++i)
+            leases.push_back(ZstdCompressorPool::acquire());
+    }
+    EXPECT_EQ(ZstdCompressorPool::idle_count(), 4u);
+}
+
+TEST(Codec, ZstdRoundTrip)
+{
+    auto const codec = zfiles::find_codec("zstd");
+    ASSERT_TRUE(codec);
+    for (auto const size : { std::size_t{0}, std::size_t{1}, std::size_t{5000}, std::size_t{1} << 20 }) {
+        auto const data = sample(size);
+        auto const fast = zfiles::compress(*codec, 1, data);
+        auto const strong = zfiles::compress(*codec, 19, data);
+        EXPECT_EQ(zfiles::decompress(fast), data) << size;
+        EXPECT_EQ(zfiles::decompress(strong, size), data) << size;
+        if (size > 5000) {
+            EXPECT_LT(strong.size(), fast.size());
+        }
+    }
+    // The parameters of one call do not leak into the next on the same context.
+    auto const data = sample(100'000);
+    auto const first = zfiles::compress(*codec, 3, data);
+    zfiles::compress(*codec, 19, data);
+    EXPECT_EQ(zfiles::compress(*codec, 3, data), first);
+}
+
+TEST(Codec, ZstdFramesAndErrors)
+{
+    auto const codec = zfiles::find_codec("zstd");
+    ASSERT_TRUE(codec);
+    auto const data = sample(70'000);
+    auto const frame = zfiles::compress(*codec, 3, data);
+    auto frames = frame;
+    frames.insert(frames.end(), frame.begin(), frame.end());
+    auto const decoded = zfiles::decompress(frames);
+    ASSERT_EQ(decoded.size(), 2 * data.size());
+    EXPECT_TRUE(std::equal(data.begin(), data.end(), decoded.begin() + static_cast<std::ptrdiff_t>(data.size())));
+
+    auto const truncated = std::span(frame).first(frame.size() - 10);
+    EXPECT_THROW(zfiles::decompress(truncated), zfiles::Error);
+}
+
+TEST(Codec, GzipAndXzRoundTrip)
+{
+    for (auto const name : { "gzip", "xz" }) {
+        auto const codec = zfiles::find_codec(name);
+        if (!codec)
+            continue;
+        for (auto const size : { std::size_t{0}, std::size_t{5000}, std::size_t{1} << 20 }) {
+            auto const data = sample(size);
+            auto const frame = zfiles::compress(*codec, codec->max_level, data);
+            EXPECT_EQ(zfiles::decompress(frame), data) << name << " " << size;
+            // Level of the previous call left behind on the pooled stream
+            EXPECT_EQ(zfiles::decompress(zfiles::compress(*codec, codec->min_level, data), size), data) << name << " " << size;
+            if (size > 5000) {
+                auto twice = frame;
+                twice.insert(twice.end(), frame.begin(), frame.end());
+                EXPECT_EQ(zfiles::decompress(twice).size(), 2 * size) << name;
+                auto const truncated = std::span(frame).first(frame.size() - 10);
+                EXPECT_THROW(zfiles::decompress(truncated), zfiles::Error) << name;
+            }
+        }
+    }
+}
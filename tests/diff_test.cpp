@@ -0,0 +1,194 @@
+#include <diff.h>
+#include <zfiles/crc32.h>
+#include <zfiles/index.h>
+#include <zfiles/writer.h>
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct ZipEntry {
+        std::string name;
+        std::string data;
+    };
+
+    void append_le(std::string& out, std::uint64_t value, std::size_t size)
+    {
+        for (auto i = std::size_t{0}; i < size; ++i)
+            out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+
+    auto crc_of(std::string_view data) -> std::uint32_t
+    {
+        return zfiles::crc32(std::as_bytes(std::span(data.data(), data.size())));
+    }
+
+    // Zip of stored entries, names written as given without the UTF-8 flag
+    // (so read as CP437), the central directory in `directory_order`.
+    void write_zip(const std::filesystem::path& path, const std::vector<ZipEntry>& entries, std::vector<std::size_t> directory_order = {})
+    {
+        if (directory_order.empty()) {
+            for (auto i = std::size_t{0}; i < entries.size(); ++i)
+                directory_order.push_back(i);
+        }
+        auto zip = std::string{};
+        auto offsets = std::vector<std::size_t>{};
+        for (auto const& entry : entries) {
+            offsets.push_back(zip.size());
+            append_le(zip, 0x04034b50, 4);
+            append_le(zip, 10, 2);
+            append_le(zip, 0, 2);
+            append_le(zip, 0, 2);
+            append_le(zip, 0, 4);
+            append_le(zip, crc_of(entry.data), 4);
+            append_le(zip, entry.data.size(), 4);
+            append_le(zip, entry.data.size(), 4);
+            append_le(zip, entry.name.size(), 2);
+            append_le(zip, 0, 2);
+            zip += entry.name;
+            zip += entry.data;
+        }
+        auto const directory = zip.size();
+        for (auto const i : directory_order) {
+            auto const& entry = entries[i];
+            append_le(zip, 0x02014b50, 4);
+            append_le(zip, 0x031e, 2);
+            append_le(zip, 10, 2);
+            append_le(zip, 0, 2);
+            append_le(zip, 0, 2);
+            append_le(zip, 0, 4);
+            append_le(zip, crc_of(entry.data), 4);
+            append_le(zip, entry.data.size(), 4);
+            append_le(zip, entry.data.size(), 4);
+            append_le(zip, entry.name.size(), 2);
+            append_le(zip, 0, 2);
+            append_le(zip, 0, 2);
+            append_le(zip, 0, 2);
+            append_le(zip, 0, 2);
+            append_le(zip, 0100644u << 16, 4);
+            append_le(zip, offsets[i], 4);
+            zip += entry.name;
+        }
+        auto const directory_size = zip.size() - directory;
+        append_le(zip, 0x06054b50, 4);
+        append_le(zip, 0, 4);
+        append_le(zip, entries.size(), 2);
+        append_le(zip, entries.size(), 2);
+        append_le(zip, directory_size, 4);
+        append_le(zip, directory, 4);
+        append_le(zip, 0, 2);
+        std::ofstream(path, std::ios::binary) << zip;
+    }
+
+    void write_tar(const std::filesystem::path& path, const std::vector<ZipEntry>& entries)
+    {
+        auto writer = zfiles::Writer(path);
+        for (auto const& entry : entries) {
+            auto const source = path.parent_path() / "source";
+            std::ofstream(source, std::ios::binary) << entry.data;
+            writer.add_file(source, entry.name);
+        }
+        writer.close();
+    }
+
+    class Diff : public testing::Test {
+    protected:
+        void SetUp() override {
+            directory = std::filesystem::temp_directory_path() / ("diff_test_" + std::to_string(::testing::UnitTest::GetInstance()->random_seed()) + "_" + testing::UnitTest::GetInstance()->current_test_info()->name());
+            std::filesystem::create_directories(directory);
+        }
+        void TearDown() override {
+            std::filesystem::remove_all(directory);
+        }
+        auto diff(const std::filesystem::path& left, const std::filesystem::path& right) -> std::pair<int, std::string> {
+            auto const output = std::tmpfile();
+            auto const status = run_diff(left, right, output);
+            std::rewind(output);
+            auto text = std::string{};
+            for (int c; (c = std::fgetc(output)) != EOF; )
+                text.push_back(static_cast<char>(c));
+            std::fclose(output);
+            return {status, text};
+        }
+
+        std::filesystem::path directory;
+    };
+}
+
+TEST_F(Diff, ReportsAddedRemovedAndModified)
+{
+    write_tar(directory / "old.tar", { {"same", "1"}, {"gone", "2"}, {"changed", "3"}, {"resized", "4"} });
+    write_tar(directory / "new.tar", { {"same", "1"}, {"changed", "x"}, {"resized", "44"}, {"new", "5"} });
+    auto const [status, text] = diff(directory / "old.tar", directory / "new.tar");
+    EXPECT_EQ(status, 1);
+    EXPECT_EQ(text, "M changed\nD gone\nA new\nM resized\n");
+    EXPECT_EQ(diff(directory / "old.tar", directory / "old.tar"), std::pair(0, std::string{}));
+}
+
+TEST_F(Diff, ComparesAcrossFormats)
+{
+    write_tar(directory / "a.tar", { {"one", "hello"}, {"two", "world"} });
+    write_zip(directory / "b.zip", { {"one", "hello"}, {"two", "World"} });
+    EXPECT_EQ(diff(directory / "a.tar", directory / "b.zip"), std::pair(1, std::string("M two\n")));
+}
+
+TEST_F(Diff, ZipChecksumsFollowEntriesNotNames)
+{
+    // "\x81" is u-umlaut in CP437, which the reader may convert depending on
+    // the locale: checksums must not depend on the name it ends up with.
+    write_zip(directory / "a.zip", { {"caf\x81", "first"}, {"dup", "old"}, {"dup", "new"}, {"plain", "text"} }, {3, 2, 0, 1});
+    auto const index = zfiles::Index(directory / "a.zip");
+    auto const& entries = index.entries();
+    ASSERT_EQ(entries.size(), 4u);
+    EXPECT_EQ(entries[0].crc32, crc_of("first"));
+    EXPECT_EQ(entries[1].crc32, crc_of("old"));
+    EXPECT_EQ(entries[2].crc32, crc_of("new"));
+    EXPECT_EQ(entries[3].crc32, crc_of("text"));
+    EXPECT_EQ(index.find("dup"), 2u);
+}
+
+TEST_F(Diff, LastDuplicateWins)
+{
+    write_zip(directory / "dup.zip", { {"dup", "old"}, {"dup", "new"} });
+    write_zip(directory / "new.zip", { {"dup", "new"} });
+    write_zip(directory / "old.zip", { {"dup", "old"} });
+    EXPECT_EQ(diff(directory / "dup.zip", directory / "new.zip"), std::pair(0, std::string{}));
+    EXPECT_EQ(diff(directory / "dup.zip", directory / "old.zip"), std::pair(1, std::string("M dup\n")));
+}
+
+TEST_F(Diff, SplitZipsAndLongWindows)
+{
+    // A split zip keeps its central directory in the last volume.
+    auto writer = zfiles::Writer(directory / "split.zip", { .volume_size = 4096 });
+    auto const source = directory / "source";
+    auto random = std::mt19937(1);
+    auto contents = std::vector<std::string>{};
+    for (auto const name : { "one", "two", "three" }) {
+        auto& data = contents.emplace_back(3000, '\0');
+        for (auto& c : data)
+            c = static_cast<char>(random());
+        std::ofstream(source, std::ios::binary) << data;
+        writer.add_file(source, name);
+    }
+    writer.close();
+    ASSERT_TRUE(std::filesystem::exists(zfiles::volume_path(directory / "split.zip", 2)));
+    auto const index = zfiles::Index(directory / "split.zip");
+    ASSERT_EQ(index.entries().size(), 3u);
+    EXPECT_EQ(index.entries()[1].crc32, crc_of(contents[1]));
+
+    // A window past the default limit needs the memory limit to be read.
+    auto long_window = zfiles::Writer(directory / "long.tar.zst", { .long_window = 28 });
+    long_window.add_file(source, "three");
+    long_window.close();
+    EXPECT_THROW(zfiles::Index(directory / "long.tar.zst"), zfiles::Error);
+    EXPECT_EQ(zfiles::Index(directory / "long.tar.zst", std::uint64_t{1} << 28).entries().size(), 1u);
+    write_tar(directory / "b.tar", { {"three", contents[2]} });
+    auto const output = std::tmpfile();
+    EXPECT_EQ(run_diff(directory / "long.tar.zst", directory / "b.tar", output, std::uint64_t{1} << 28), 0);
+    std::fclose(output);
+}
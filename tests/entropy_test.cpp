@@ -0,0 +1,49 @@
+#include <zfiles/entropy.h>
+#include <gtest/gtest.h>
+#include <random>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    using namespace std::string_view_literals;
+
+    auto bytes(std::string_view text) -> std::vector<std::byte>
+    {
+        auto const data = std::as_bytes(std::span(text.data(), text.size()));
+        return {data.begin(), data.end()};
+    }
+}
+
+TEST(Entropy, ByteHistogram)
+{
+    EXPECT_EQ(zfiles::byte_entropy(std::vector<std::byte>(1000, std::byte{'a'})), 0.0);
+    auto every = std::vector<std::byte>{};
+    for (auto round = 0; round < 4; ++round) {
+        for (auto value = 0; value < 256; ++value)
+            every.push_back(static_cast<std::byte>(value));
+    }
+    // Not a multiple of the 8 bytes counted at once
+    every.push_back(std::byte{0});
+    EXPECT_NEAR(zfiles::byte_entropy(std::span(every).first(1024)), 8.0, 1e-9);
+    EXPECT_LT(zfiles::byte_entropy(every), 8.0);
+    EXPECT_NEAR(zfiles::byte_entropy(bytes("abababab")), 1.0, 1e-9);
+}
+
+TEST(Entropy, Incompressible)
+{
+    EXPECT_EQ(zfiles::compressed_format(bytes("\x89PNG\r\n\x1A\n....")), "png");
+    EXPECT_EQ(zfiles::compressed_format(bytes("\0\0\0\x18" "ftypisom"sv)), "mp4");
+    EXPECT_FALSE(zfiles::compressed_format(bytes("PK")));
+    EXPECT_TRUE(zfiles::is_incompressible(bytes("\x1F\x8B\x08\0 text after a gzip magic")));
+
+    auto random = std::mt19937(1);
+    auto noise = std::vector<std::byte>(1 << 20);
+    for (auto& byte : noise)
+        byte = static_cast<std::byte>(random());
+    EXPECT_TRUE(zfiles::is_incompressible(noise));
+    auto text = std::string{};
+    while (text.size() < (1 << 16))
+        text += "some words of text, ";
+    EXPECT_FALSE(zfiles::is_incompressible(bytes(text)));
+}
@@ -0,0 +1,99 @@
+#include <filtered_compress.h>
+#include <lz4_compress.h>
+#include <zfiles/codec.h>
+#include <zfiles/filter.h>
+#include <zfiles/reader.h>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Machine code lookalike: calls and jumps, ARM64 BL and ADRP words, and noise.
+    auto sample(std::size_t size) -> std::vector<std::byte>
+    {
+        auto data = std::vector<std::byte>(size);
+        auto random = std::mt19937(static_cast<unsigned>(size));
+        for (auto i = std::size_t{0}; i < size; ++i) {
+            switch (random() % 6) {
+                case 0: data[i] = std::byte{0xE8}; break;
+                case 1: data[i] = std::byte{0x94}; break;
+                case 2: data[i] = std::byte{0x90}; break;
+                default: data[i] = static_cast<std::byte>(random() % 16); break;
+            }
+        }
+        return data;
+    }
+
+    // Encodes `data` in pieces of `piece` bytes, then decodes it likewise.
+    auto round_trip(std::string_view spec, std::span<const std::byte> data, std::size_t piece) -> std::pair<std::vector<std::byte>, std::vector<std::byte>>
+    {
+        auto encoder = zfiles::make_filter_chain(spec);
+        auto filtered = std::vector<std::byte>{};
+        for (auto offset = std::size_t{0}; offset < data.size(); offset += piece)
+            encoder.encode(data.subspan(offset, std::min(piece, data.size() - offset)), false, filtered);
+        encoder.encode({}, true, filtered);
+        auto decoder = zfiles::make_filter_chain(spec);
+        auto restored = std::vector<std::byte>{};
+        for (auto offset = std::size_t{0}; offset < filtered.size(); offset += piece)
+            decoder.decode(std::span(filtered).subspan(offset, std::min(piece, filtered.size() - offset)), false, restored);
+        decoder.decode({}, true, restored);
+        return {filtered, restored};
+    }
+}
+
+TEST(Filter, StagesRoundTripInPieces)
+{
+    auto const data = sample(100'003);
+    for (auto const spec : {"x86", "arm64", "delta:1", "delta:4", "delta:256", "transpose:12", "x86,delta:2,transpose:8"}) {
+        for (auto const piece : { std::size_t{1}, std::size_t{7}, std::size_t{4096}, data.size() }) {
+            auto const [filtered, restored] = round_trip(spec, data, piece);
+            EXPECT_EQ(filtered.size(), data.size()) << spec << " " << piece;
+            EXPECT_NE(filtered, data) << spec << " " << piece;
+            EXPECT_EQ(restored, data) << spec << " " << piece;
+        }
+        // Every stage makes all of its input final once it is the last.
+        EXPECT_EQ(round_trip(spec, {}, 1).second, std::vector<std::byte>{}) << spec;
+    }
+}
+
+TEST(Filter, KnownOutputs)
+{
+    // A CALL at offset 0 to rel32 0 becomes the absolute target 5.
+    auto call = std::vector<std::byte>{std::byte{0xE8}, std::byte{0}, std::byte{0}, std::byte{0}, std::byte{0}};
+    EXPECT_EQ(round_trip("x86", call, call.size()).first, (std::vector<std::byte>{std::byte{0xE8}, std::byte{5}, std::byte{0}, std::byte{0}, std::byte{0}}));
+    auto const ramp = std::vector<std::byte>{std::byte{1}, std::byte{2}, std::byte{3}, std::byte{5}};
+    EXPECT_EQ(round_trip("delta:1", ramp, 1).first, (std::vector<std::byte>{std::byte{1}, std::byte{1}, std::byte{1}, std::byte{2}}));
+    // Two records of three bytes, column by column
+    auto const records = std::vector<std::byte>{std::byte{1}, std::byte{2}, std::byte{3}, std::byte{4}, std::byte{5}, std::byte{6}};
+    EXPECT_EQ(round_trip("transpose:3", records, records.size()).first, (std::vector<std::byte>{std::byte{1}, std::byte{4}, std::byte{2}, std::byte{5}, std::byte{3}, std::byte{6}}));
+}
+
+TEST(Filter, ChainSpecs)
+{
+    auto const chain = zfiles::make_filter_chain("x86,delta:4");
+    ASSERT_EQ(chain.size(), 2u);
+    EXPECT_EQ(chain.filter(0).name(), "x86");
+    EXPECT_EQ(chain.filter(1).name(), "delta");
+    EXPECT_EQ(zfiles::make_filter_chain("").size(), 0u);
+    for (auto const bad : {"zip", "delta:0", "delta:257", "transpose", "x86:2", "delta:4x", "x86,"})
+        EXPECT_THROW(zfiles::make_filter_chain(bad), zfiles::Error) << bad;
+}
+
+TEST(Filter, InFrontOfCodecs)
+{
+    auto data = sample(300'000);
+    auto const codec = zfiles::find_codec("gzip");
+    ASSERT_NE(codec, nullptr);
+    auto encoder = zfiles::make_filter_chain("x86,delta:1");
+    auto const compressed = zfiles::compress(*codec, 6, data, encoder);
+    EXPECT_EQ(encoder.throughput(0).bytes, data.size());
+    auto decoder = zfiles::make_filter_chain("x86,delta:1");
+    EXPECT_EQ(zfiles::decompress(compressed, data.size(), decoder), data);
+
+    auto const filtered = FilteredCompress(std::make_unique<Lz4Compress>(), [] { return zfiles::make_filter_chain("arm64"); });
+    auto frame = filtered.compress(data);
+    EXPECT_EQ(filtered.decompress(frame), data);
+    EXPECT_EQ(filtered.name(), "lz4");
+}
@@ -0,0 +1,90 @@
+// Throughput of the native LZ4 codec against the lz4 filter of libarchive,
+// on the files given as arguments or, without any, on generated text-like
+// data. Run with `xmake run bench_lz4 [files...]`.
+#include <lz4_compress.h>
+#include <zfiles/codec.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+    constexpr auto runs = 5;
+
+    auto generated(std::size_t size) -> std::vector<std::byte>
+    {
+        auto data = std::vector<std::byte>(size);
+        auto random = std::mt19937(1);
+        constexpr auto words = std::string_view("the quick brown fox jumps over the lazy dog ");
+        for (auto i = std::size_t{0}; i < size; ++i)
+            data[i] = random() % 8 == 0 ? static_cast<std::byte>(random()) : static_cast<std::byte>(words[i % words.size()]);
+        return data;
+    }
+
+    auto load(const std::filesystem::path& path) -> std::vector<std::byte>
+    {
+        auto file = std::ifstream(path, std::ios::binary);
+        auto const bytes = std::vector<char>(std::istreambuf_iterator<char>(file), {});
+        auto data = std::vector<std::byte>(bytes.size());
+        std::transform(bytes.begin(), bytes.end(), data.begin(), [](char c) { return static_cast<std::byte>(c); });
+        return data;
+    }
+
+    // Best time of a few runs, in seconds
+    auto best_of(const std::function<void()>& run) -> double
+    {
+        auto best = 0.0;
+        for (auto i = 0; i < runs; ++i) {
+            auto const start = Clock::now();
+            run();
+            auto const seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            best = i == 0 ? seconds : std::min(best, seconds);
+        }
+        return best;
+    }
+
+    void measure(std::string_view sample, std::vector<std::byte> data)
+    {
+        auto const megabytes = static_cast<double>(data.size()) / 1e6;
+        auto const print = [&](std::string_view codec, std::size_t compressed, double compress, double decompress) {
+            fmt::print("{:<24} {:<10} {:>8.3f} {:>14.1f} {:>16.1f}\n", sample, codec, static_cast<double>(data.size()) / static_cast<double>(compressed), megabytes / compress, megabytes / decompress);
+        };
+
+        auto const native = Lz4Compress{};
+        auto frame = native.compress(data);
+        if (native.decompress(frame) != data) {
+            fmt::print(stderr, "{}: native round trip failed\n", sample);
+            return;
+        }
+        print("native", frame.size(), best_of([&] { native.compress(data); }), best_of([&] { native.decompress(frame); }));
+
+        auto const codec = zfiles::find_codec("lz4");
+        if (!codec) {
+            fmt::print("{:<24} libarchive has no lz4 filter\n", sample);
+            return;
+        }
+        auto const archive_frame = zfiles::compress(*codec, codec->default_level, data);
+        print("libarchive", archive_frame.size(), best_of([&] { zfiles::compress(*codec, codec->default_level, data); }), best_of([&] { zfiles::decompress(archive_frame, data.size()); }));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    fmt::print("{:<24} {:<10} {:>8} {:>14} {:>16}\n", "sample", "codec", "ratio", "compress MB/s", "decompress MB/s");
+    if (argc < 2) {
+        measure("generated 64 MiB", generated(std::size_t{64} << 20));
+        return 0;
+    }
+    for (auto i = 1; i < argc; ++i)
+        measure(std::filesystem::path(argv[i]).filename().string(), load(argv[i]));
+    return 0;
+}
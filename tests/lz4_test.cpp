@@ -0,0 +1,185 @@
+#include <lz4_compress.h>
+#include <lz4frame.h>
+#include <gtest/gtest.h>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    auto sample(std::size_t size) -> std::vector<std::byte>
+    {
+        // Text-like runs mixed with noise, so that blocks hold both matches and literals.
+        auto data = std::vector<std::byte>(size);
+        auto random = std::mt19937(size);
+        constexpr auto words = std::string_view("the quick brown fox jumps over the lazy dog ");
+        for (auto i = std::size_t{0}; i < size; ++i)
+            data[i] = random() % 8 == 0 ? static_cast<std::byte>(random()) : static_cast<std::byte>(words[i % words.size()]);
+        return data;
+    }
+
+    auto reference_compress(std::span<const std::byte> data, const LZ4F_preferences_t& preferences) -> std::vector<std::byte>
+    {
+        auto out = std::vector<std::byte>(LZ4F_compressFrameBound(data.size(), &preferences));
+        auto const size = LZ4F_compressFrame(out.data(), out.size(), data.data(), data.size(), &preferences);
+        if (LZ4F_isError(size))
+            throw std::runtime_error(LZ4F_getErrorName(size));
+        out.resize(size);
+        return out;
+    }
+
+    auto reference_decompress(std::span<const std::byte> frame) -> std::vector<std::byte>
+    {
+        LZ4F_dctx* context = nullptr;
+        if (LZ4F_isError(LZ4F_createDecompressionContext(&context, LZ4F_VERSION)))
+            throw std::runtime_error("cannot create lz4 context");
+        auto out = std::vector<std::byte>{};
+        auto buffer = std::vector<std::byte>(1 << 16);
+        auto in = frame.data();
+        auto left = frame.size();
+        auto status = std::size_t{1};
+        while (left > 0 && status != 0) {
+            auto produced = buffer.size();
+            auto consumed = left;
+            status = LZ4F_decompress(context, buffer.data(), &produced, in, &consumed, nullptr);
+            if (LZ4F_isError(status)) {
+                LZ4F_freeDecompressionContext(context);
+                throw std::runtime_error(LZ4F_getErrorName(status));
+            }
+            out.insert(out.end(), buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(produced));
+            in += consumed;
+            left -= consumed;
+        }
+        LZ4F_freeDecompressionContext(context);
+        return out;
+    }
+
+    // Header checksum of a frame descriptor: second byte of its XXH32.
+    auto header_checksum(std::span<const std::byte> descriptor) -> std::byte
+    {
+        constexpr auto p1 = std::uint32_t{2654435761U};
+        constexpr auto p2 = std::uint32_t{2246822519U};
+        constexpr auto p3 = std::uint32_t{3266489917U};
+        constexpr auto p4 = std::uint32_t{668265263U};
+        constexpr auto p5 = std::uint32_t{374761393U};
+        auto h = p5 + static_cast<std::uint32_t>(descriptor.size());
+        auto i = std::size_t{0};
+        for (; i + 4 <= descriptor.size(); i += 4) {
+            auto word = std::uint32_t{0};
+            for (auto k = 0; k < 4; ++k)
+                word |= std::to_integer<std::uint32_t>(descriptor[i + k]) << (8 * k);
+            h = std::rotl(h + word * p3, 17) * p4;
+        }
+        for (; i < descriptor.size(); ++i)
+            h = std::rotl(h + std::to_integer<std::uint32_t>(descriptor[i]) * p5, 11) * p1;
+        h ^= h >> 15;
+        h *= p2;
+        h ^= h >> 13;
+        h *= p3;
+        h ^= h >> 16;
+        return static_cast<std::byte>(h >> 8);
+    }
+
+    void append_le(std::vector<std::byte>& out, std::uint64_t value, std::size_t size)
+    {
+        for (auto i = std::size_t{0}; i < size; ++i)
+            out.push_back(static_cast<std::byte>(value >> (8 * i)));
+    }
+
+    // Frame with a content size field and a single stored block of `payload` bytes.
+    auto stored_frame(std::uint64_t content_size, std::size_t payload) -> std::vector<std::byte>
+    {
+        auto frame = std::vector<std::byte>{};
+        append_le(frame, 0x184D2204, 4);
+        auto const descriptor = frame.size();
+        frame.push_back(std::byte{0x68}); // version 1, independent blocks, content size
+        frame.push_back(std::byte{0x40}); // 64 KiB blocks
+        append_le(frame, content_size, 8);
+        frame.push_back(header_checksum(std::span(frame).subspan(descriptor)));
+        append_le(frame, 0x80000000u | payload, 4);
+        frame.insert(frame.end(), payload, std::byte{'x'});
+        append_le(frame, 0, 4);
+        return frame;
+    }
+}
+
+TEST(Lz4, RoundTrip)
+{
+    auto const codec = Lz4Compress{};
+    for (auto const size : { std::size_t{0}, std::size_t{1}, std::size_t{12}, std::size_t{13}, std::size_t{100'000}, (std::size_t{4} << 20) + 17 }) {
+        auto data = sample(size);
+        auto frame = codec.compress(data);
+        EXPECT_EQ(codec.decompress(frame), data) << size;
+        EXPECT_EQ(codec.compressed_size(frame), frame.size());
+        EXPECT_EQ(codec.decompressed_size(frame), size);
+    }
+}
+
+TEST(Lz4, ReferenceReadsOurFrames)
+{
+    auto const codec = Lz4Compress{};
+    for (auto const size : { std::size_t{0}, std::size_t{5}, std::size_t{70'000}, (std::size_t{4} << 20) + 1 }) {
+        auto data = sample(size);
+        EXPECT_EQ(reference_decompress(codec.compress(data)), data) << size;
+    }
+}
+
+TEST(Lz4, ReadsReferenceFrames)
+{
+    auto const codec = Lz4Compress{};
+    auto data = sample(300'000);
+    auto preferences = LZ4F_preferences_t{};
+    // Linked 64 KiB blocks without a content size: the default of the lz4 tool
+    preferences.frameInfo.blockSizeID = LZ4F_max64KB;
+    preferences.frameInfo.blockMode = LZ4F_blockLinked;
+    auto linked = reference_compress(data, preferences);
+    EXPECT_EQ(codec.decompress(linked), data);
+
+    preferences.frameInfo.blockSizeID = LZ4F_max256KB;
+    preferences.frameInfo.blockMode = LZ4F_blockIndependent;
+    preferences.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+    preferences.frameInfo.blockChecksumFlag = LZ4F_blockChecksumEnabled;
+    preferences.frameInfo.contentSize = data.size();
+    preferences.compressionLevel = 9;
+    auto frame = reference_compress(data, preferences);
+    EXPECT_EQ(codec.decompress(frame), data);
+    EXPECT_EQ(codec.decompressed_size(frame), data.size());
+
+    // Concatenated frames decode to the concatenation of their contents.
+    auto twice = frame;
+    twice.insert(twice.end(), frame.begin(), frame.end());
+    auto const decoded = codec.decompress(twice);
+    ASSERT_EQ(decoded.size(), 2 * data.size());
+    EXPECT_TRUE(std::equal(data.begin(), data.end(), decoded.begin() + static_cast<std::ptrdiff_t>(data.size())));
+}
+
+TEST(Lz4, RejectsCorruptFrames)
+{
+    auto const codec = Lz4Compress{};
+    auto data = sample(10'000);
+    auto frame = codec.compress(data);
+    auto truncated = std::vector(frame.begin(), frame.end() - 6);
+    EXPECT_THROW(codec.decompress(truncated), std::runtime_error);
+    auto flipped = frame;
+    flipped[frame.size() / 2] ^= std::byte{0x55};
+    EXPECT_THROW(codec.decompress(flipped), std::runtime_error);
+}
+
+TEST(Lz4, DoesNotTrustContentSize)
+{
+    auto const codec = Lz4Compress{};
+    // Size that wraps around once the decoder margin is added
+    auto wrapping = stored_frame(~std::uint64_t{0}, 1000);
+    EXPECT_THROW(codec.decompress(wrapping), std::runtime_error);
+    // Size far larger than the input could expand to, which must not be allocated up front
+    auto huge = stored_frame(std::uint64_t{1} << 45, 1000);
+    EXPECT_THROW(codec.decompress(huge), std::runtime_error);
+    // Block larger than the content size
+    auto short_content = stored_frame(10, 1000);
+    EXPECT_THROW(codec.decompress(short_content), std::runtime_error);
+    auto exact = stored_frame(1000, 1000);
+    EXPECT_EQ(codec.decompress(exact), std::vector<std::byte>(1000, std::byte{'x'}));
+}
@@ -0,0 +1,82 @@
+#include <zfiles/matcher.h>
+#include <zfiles/reader.h>
+#include <gtest/gtest.h>
+#include <array>
+#include <string_view>
+
+namespace
+{
+    using namespace std::string_view_literals;
+
+    auto set(std::initializer_list<std::string_view> patterns) -> zfiles::PatternSet
+    {
+        return zfiles::PatternSet(std::span(patterns.begin(), patterns.size()));
+    }
+}
+
+TEST(PatternSet, Globs)
+{
+    auto patterns = set({"*.txt", "src/**/*.h", "doc/?.md", "build", "[a-c]x[!0-9]", "lit\\*"});
+    EXPECT_TRUE(patterns.matches("a.txt"));
+    // Without a '/', at any depth
+    EXPECT_TRUE(patterns.matches("deep/down/a.txt"));
+    EXPECT_FALSE(patterns.matches("a.txt.gz"));
+    EXPECT_TRUE(patterns.matches("src/a/b/c.h"));
+    EXPECT_TRUE(patterns.matches("src/c.h"));
+    EXPECT_FALSE(patterns.matches("lib/src/c.h"));
+    EXPECT_TRUE(patterns.matches("doc/1.md"));
+    EXPECT_FALSE(patterns.matches("doc/12.md"));
+    EXPECT_FALSE(patterns.matches("doc/sub/1.md"));
+    // A matching directory takes what is below it.
+    EXPECT_TRUE(patterns.matches("build/obj/a.o"));
+    EXPECT_TRUE(patterns.matches("bxy"));
+    EXPECT_FALSE(patterns.matches("bx1"));
+    EXPECT_FALSE(patterns.matches("dxy"));
+    EXPECT_TRUE(patterns.matches("lit*"));
+    EXPECT_FALSE(patterns.matches("litx"));
+    // Same answers once the automaton has been built
+    EXPECT_TRUE(patterns.matches("other/b.txt"));
+    EXPECT_FALSE(patterns.matches("other/b.tx"));
+}
+
+TEST(PatternSet, TrailingSlashNamesADirectory)
+{
+    auto patterns = set({"build/", "src/gen/"});
+    EXPECT_TRUE(patterns.matches("build/"));
+    EXPECT_TRUE(patterns.matches("build/foo.o"));
+    EXPECT_TRUE(patterns.matches("src/build/x"));
+    EXPECT_FALSE(patterns.matches("build"));
+    EXPECT_FALSE(patterns.matches("rebuild/x"));
+    EXPECT_TRUE(patterns.matches("src/gen/a/b.h"));
+    EXPECT_FALSE(patterns.matches("lib/src/gen/a.h"));
+    EXPECT_FALSE(patterns.matches("src/generated/a.h"));
+}
+
+TEST(PatternSet, Regexes)
+{
+    auto patterns = set({"re:^logs/[0-9]+\\.log$", "re:tmp"});
+    EXPECT_TRUE(patterns.matches("logs/12.log"));
+    EXPECT_FALSE(patterns.matches("logs/x.log"));
+    EXPECT_FALSE(patterns.matches("old/logs/12.log"));
+    EXPECT_TRUE(patterns.matches("a/tmp/b"));
+    EXPECT_FALSE(set({}).matches("anything"));
+    EXPECT_TRUE(set({}).empty());
+    EXPECT_THROW(set({"re:("}), zfiles::Error);
+    EXPECT_THROW(set({"[abc"}), zfiles::Error);
+}
+
+TEST(PathFilter, IncludeThenExclude)
+{
+    constexpr auto include = std::array{"src/**"sv, "*.md"sv};
+    constexpr auto exclude = std::array{"*.o"sv, "re:/test/"sv};
+    auto filter = zfiles::PathFilter(include, exclude);
+    EXPECT_TRUE(filter.matches("src/main.cpp"));
+    EXPECT_TRUE(filter.matches("README.md"));
+    EXPECT_FALSE(filter.matches("lib/main.cpp"));
+    EXPECT_FALSE(filter.matches("src/main.o"));
+    EXPECT_FALSE(filter.matches("src/test/a.cpp"));
+    // No include pattern: everything not excluded
+    auto everything = zfiles::PathFilter({}, exclude);
+    EXPECT_TRUE(everything.matches("lib/main.cpp"));
+    EXPECT_FALSE(everything.matches("lib/main.o"));
+}
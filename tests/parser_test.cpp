@@ -0,0 +1,203 @@
+#include <cmd_parser.h>
+#include <cmd/schema.h>
+#include <cmd/validators.h>
+#include <gtest/gtest.h>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+    namespace schema = cmd::schema;
+    namespace types = cmd::types;
+    using Code = cmd::result::Error::Code;
+    using namespace std::string_view_literals;
+
+    constexpr auto modes = std::array{"fast"sv, "slow"sv};
+    constexpr auto run_arguments = std::array{
+        schema::Argument{ .longname = "output", .shortname = 'o' },
+        schema::Argument{ .longname = "jobs", .shortname = 'j', .type = types::Integer{ .min = 1, .max = 64 } },
+        schema::Argument{ .longname = "size", .type = types::Size{}, .default_value = "4K" },
+        schema::Argument{ .longname = "timeout", .type = types::Duration{} },
+        schema::Argument{ .longname = "mode", .type = types::Choice{ .values = modes } },
+        schema::Argument{ .longname = "name", .validator = cmd::validators::one_of<modes> },
+        schema::Argument{ .longname = "include", .shortname = 'i' },
+    };
+    constexpr auto run_flags = std::array{
+        schema::Flag{ .longname = "verbose", .shortname = 'v', .max = 2 },
+        schema::Flag{ .longname = "quiet", .shortname = 'q' },
+    };
+    constexpr auto need_arguments = std::array{
+        schema::Argument{ .longname = "key", .required = true },
+    };
+    constexpr auto commands = std::array{
+        schema::Command{ .longname = "run", .shortname = 'r', .arguments = run_arguments, .flags = run_flags, .input_files = true },
+        schema::Command{ .longname = "need", .arguments = need_arguments },
+    };
+    constexpr auto test_schema = schema::Schema{ .commands = commands, .global_command = "run" };
+    constexpr auto no_global_schema = schema::Schema{ .commands = commands };
+
+    // Validators are kept by pointer: a callable with state, which the
+    // parser would only refer to, is rejected.
+    static_assert(std::is_constructible_v<cmd::config::Validator, bool (*)(std::string_view)>);
+    static_assert(std::is_constructible_v<cmd::config::Validator, decltype([](std::string_view) { return true; })>);
+    static_assert(!std::is_constructible_v<cmd::config::Validator, decltype([n = std::size_t{1}](std::string_view value) { return value.size() == n; })>);
+    static_assert(!std::is_constructible_v<cmd::config::Validator, std::function<bool(std::string_view)>>);
+
+    auto parse(const cmd::Parser& parser, std::vector<std::string_view> arguments)
+    {
+        arguments.insert(arguments.begin(), "program");
+        return parser.parse(std::span(arguments));
+    }
+}
+
+TEST(Parser, ColumnsAndTypedArguments)
+{
+    auto const parser = schema::make_parser<test_schema>();
+    auto const result = parse(parser, {"run", "a", "-vv", "--jobs=8", "-o", "out", "b", "--timeout=2m", "--mode=slow", "-i", "x", "--include=y", "-q"});
+    ASSERT_TRUE(result) << result.error().to_string();
+    auto const& command = result->command;
+    EXPECT_EQ(result->program, "program");
+    EXPECT_EQ(command.name, "run");
+    EXPECT_EQ(std::vector(command.get_inputs().begin(), command.get_inputs().end()), (std::vector{"a"sv, "b"sv}));
+    EXPECT_EQ(command.get_flag("verbose"), 2u);
+    EXPECT_EQ(command.get_flag("quiet"), 1u);
+    EXPECT_EQ(command.get_argument("output"), "out");
+    EXPECT_EQ(command.get_integer("jobs"), 8);
+    EXPECT_EQ(command.get_duration("timeout"), std::chrono::minutes(2));
+    EXPECT_EQ(command.get_choice("mode"), 1u);
+    EXPECT_EQ(command.get_arguments("include"), (std::vector{"x"sv, "y"sv}));
+    // Default values, typed on request
+    EXPECT_EQ(command.get_argument("size"), "4K");
+    EXPECT_EQ(command.get_size("size"), 4096u);
+    EXPECT_EQ(command.get_argument("timeout"), "2m");
+    EXPECT_FALSE(command.get_argument("name"));
+    EXPECT_FALSE(command.get_argument("verbose"));
+}
+
+TEST(Parser, GlobalCommandAndErrors)
+{
+    auto const parser = schema::make_parser<test_schema>();
+    auto const global = parse(parser, {"input", "--jobs=2"});
+    ASSERT_TRUE(global);
+    EXPECT_EQ(global->command.name, "run");
+    EXPECT_EQ(global->command.get_integer("jobs"), 2);
+
+    auto const expect_error = [&](std::vector<std::string_view> arguments, Code code, std::ptrdiff_t position) {
+        auto const result = parse(parser, arguments);
+        ASSERT_FALSE(result) << arguments.back();
+        EXPECT_EQ(result.error().error.code, code) << result.error().to_string();
+        EXPECT_EQ(result.error().position, position) << result.error().to_string();
+    };
+    expect_error({"run", "--jobs=0"}, Code::InvalidValue, 2);
+    expect_error({"run", "a", "--jobs=x"}, Code::InvalidValue, 3);
+    expect_error({"run", "--mode=medium"}, Code::InvalidValue, 2);
+    expect_error({"run", "--name=other"}, Code::InvalidValue, 2);
+    expect_error({"run", "--size=1T"}, Code::InvalidValue, 2);
+    expect_error({"run", "-vvv"}, Code::TooManyFlags, 2);
+    expect_error({"run", "--unknown"}, Code::UnknownParameter, 2);
+    expect_error({"need"}, Code::RequiredArgument, 2);
+}
+
+TEST(Parser, InputLists)
+{
+    auto const directory = std::filesystem::temp_directory_path() / ("parser_test_" + std::to_string(::testing::UnitTest::GetInstance()->random_seed()));
+    std::filesystem::create_directories(directory);
+    auto const lines = (directory / "lines").string();
+    auto const records = (directory / "records").string();
+    std::ofstream(lines) << "one\r\n\ntwo words\nthree";
+    std::ofstream(records, std::ios::binary) << std::string("four\0five\nsix\0", 14);
+
+    auto const parser = schema::make_parser<test_schema>();
+    auto const at = "@" + lines;
+    auto const files_from = "--files-from=" + records;
+    auto const result = parse(parser, {"run", "first", at, files_from, "last"});
+    ASSERT_TRUE(result) << result.error().to_string();
+    auto const inputs = result->command.get_inputs();
+    EXPECT_EQ(std::vector(inputs.begin(), inputs.end()), (std::vector{"first"sv, "one"sv, "two words"sv, "three"sv, "four"sv, "five\nsix"sv, "last"sv}));
+
+    auto const missing = "@" + (directory / "missing").string();
+    auto const failed = parse(parser, {"run", missing});
+    ASSERT_FALSE(failed);
+    EXPECT_EQ(failed.error().error.code, Code::UnreadableFile);
+    // Commands that do not take lists read the token as an input
+    auto const need = parse(parser, {"need", "--key=k", at});
+    ASSERT_TRUE(need);
+    EXPECT_EQ(need->command.get_inputs().front(), at);
+    std::filesystem::remove_all(directory);
+}
+
+TEST(Parser, CommandName)
+{
+    auto const parser = schema::make_parser<test_schema>();
+    auto const name = [&](std::vector<std::string_view> arguments) {
+        arguments.insert(arguments.begin(), "program");
+        return parser.command_name(std::span(arguments));
+    };
+    EXPECT_EQ(name({"need", "--key=k"}), "need");
+    EXPECT_EQ(name({"r", "input"}), "run");
+    EXPECT_EQ(name({"input"}), "run");
+    EXPECT_EQ(name({"--jobs=2"}), "run");
+    EXPECT_EQ(name({}), "run");
+    auto const no_global = schema::make_parser<no_global_schema>();
+    auto arguments = std::vector<std::string_view>{"program", "input"};
+    EXPECT_EQ(no_global.command_name(std::span(arguments)), "");
+}
+
+TEST(Parser, StreamYieldsParametersInOrder)
+{
+    auto const directory = std::filesystem::temp_directory_path() / ("parser_stream_" + std::to_string(::testing::UnitTest::GetInstance()->random_seed()));
+    std::filesystem::create_directories(directory);
+    auto const list = (directory / "list").string();
+    std::ofstream(list) << "one\ntwo\n";
+
+    auto const parser = schema::make_parser<test_schema>();
+    auto const at = "@" + list;
+    auto arguments = std::vector<std::string_view>{"program", "run", "first", "-v", at, "--jobs=3", "last"};
+    auto stream = parser.stream(std::span(arguments));
+    EXPECT_EQ(stream.command().name, "run");
+    auto seen = std::vector<std::string>{};
+    for (auto const& parameter : stream) {
+        ASSERT_TRUE(parameter) << parameter.error().to_string();
+        if (auto const input = std::get_if<cmd::result::Input>(&*parameter))
+            seen.emplace_back(*input);
+        else if (auto const flag = std::get_if<cmd::result::Flag>(&*parameter))
+            seen.push_back("flag " + std::string(flag->name));
+        else
+            seen.push_back("argument " + std::string(std::get<cmd::result::Argument>(*parameter).name));
+    }
+    EXPECT_EQ(seen, (std::vector<std::string>{"first", "flag verbose", "one", "two", "argument jobs", "last"}));
+    EXPECT_EQ(stream.command().get_integer("jobs"), 3);
+
+    // The first error ends the range.
+    auto bad = std::vector<std::string_view>{"program", "run", "first", "--jobs=0", "last"};
+    auto failing = parser.stream(std::span(bad));
+    auto count = 0;
+    for (auto const& parameter : failing) {
+        if (++count == 2) {
+            ASSERT_FALSE(parameter);
+            EXPECT_EQ(parameter.error().position, 3);
+        }
+    }
+    EXPECT_EQ(count, 2);
+    std::filesystem::remove_all(directory);
+}
+
+TEST(Parser, BuiltValidators)
+{
+    auto parser = cmd::Parser{};
+    auto& command = parser.make_command("check").set_input_validator([](std::string_view input) { return input.starts_with("in"); });
+    command.make_argument("level").set_validator(cmd::validators::in_range<1, 9>);
+    auto valid = std::vector<std::string_view>{"program", "check", "input", "--level=9"};
+    EXPECT_TRUE(parser.parse(std::span(valid)));
+    auto bad_level = std::vector<std::string_view>{"program", "check", "input", "--level=10"};
+    EXPECT_FALSE(parser.parse(std::span(bad_level)));
+    auto bad_input = std::vector<std::string_view>{"program", "check", "output"};
+    EXPECT_FALSE(parser.parse(std::span(bad_input)));
+}
@@ -0,0 +1,62 @@
+#include <cmd/utf8.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <string_view>
+
+namespace
+{
+    namespace uni = cmd::utils::uni;
+    using namespace std::string_view_literals;
+
+    // Same checks at compile time, where the vector path is not taken
+    static_assert(*uni::utf8_length("h\xC3\xA9llo") == 5);
+    static_assert(!uni::utf8_length("\xC0\xAF"));
+    static_assert(*uni::codepoint("\xF0\x9F\x98\x80") == U'\U0001F600');
+
+    auto error_position(std::string_view str) -> std::size_t
+    {
+        auto const length = uni::utf8_length(str);
+        return length ? std::string_view::npos : length.error().pos;
+    }
+}
+
+TEST(Utf8, CountsCodepoints)
+{
+    EXPECT_EQ(uni::utf8_length(""), 0u);
+    EXPECT_EQ(uni::utf8_length("plain ascii"), 11u);
+    EXPECT_EQ(uni::utf8_length("caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80"), 8u);
+    EXPECT_EQ(uni::utf8_char_length("\xE2\x82\xAC"), 3u);
+    EXPECT_EQ(uni::codepoint("\xE2\x82\xAC"), U'€');
+    auto pos = std::size_t{1};
+    EXPECT_EQ(uni::next_codepoint("a\xC3\xA9z", pos), U'é');
+    EXPECT_EQ(pos, 3u);
+}
+
+TEST(Utf8, RejectsMalformedSequences)
+{
+    for (auto const bad : {
+        "\x80"sv,                  // stray continuation byte
+        "\xC3"sv,                  // truncated
+        "\xC3\x28"sv,              // missing continuation byte
+        "\xC1\xBF"sv,              // overlong, two bytes
+        "\xE0\x80\xAF"sv,          // overlong, three bytes
+        "\xF0\x8F\xBF\xBF"sv,      // overlong, four bytes
+        "\xED\xA0\x80"sv,          // surrogate
+        "\xF4\x90\x80\x80"sv,      // past U+10FFFF
+        "\xF5\x80\x80\x80"sv,
+        "\xFF"sv,
+    })
+        EXPECT_FALSE(uni::utf8_length(bad)) << testing::PrintToString(std::string(bad));
+    EXPECT_TRUE(uni::utf8_length("\xED\x9F\xBF\xF4\x8F\xBF\xBF"));
+}
+
+TEST(Utf8, VectorPathFindsErrorsAnywhere)
+{
+    // Errors on each side of the 32-, 16- and 8-byte blocks of the ASCII scan
+    for (auto const size : { 0, 7, 8, 15, 16, 31, 32, 33, 63, 64, 100 }) {
+        auto const prefix = std::string(static_cast<std::size_t>(size), 'a');
+        EXPECT_EQ(error_position(prefix + "\x80" + std::string(40, 'b')), prefix.size()) << size;
+        EXPECT_EQ(error_position(prefix + "\xC3\xA9" + std::string(40, 'b') + "\xE2\x82"), prefix.size() + 42) << size;
+        EXPECT_EQ(uni::utf8_length(prefix + "\xC3\xA9" + std::string(70, 'b') + "\xF0\x9F\x98\x80"), prefix.size() + 72) << size;
+    }
+}
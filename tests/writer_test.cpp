@@ -0,0 +1,214 @@
+#include <zfiles/adaptive_level.h>
+#include <zfiles/reader.h>
+#include <zfiles/scheduler.h>
+#include <zfiles/writer.h>
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    auto random_bytes(std::size_t size, unsigned seed) -> std::string
+    {
+        auto data = std::string(size, '\0');
+        auto random = std::mt19937(seed);
+        for (auto& c : data)
+            c = static_cast<char>(random());
+        return data;
+    }
+
+    class Writer : public testing::Test {
+    protected:
+        void SetUp() override {
+            directory = std::filesystem::temp_directory_path() / ("writer_test_" + std::to_string(::testing::UnitTest::GetInstance()->random_seed()) + "_" + testing::UnitTest::GetInstance()->current_test_info()->name());
+            std::filesystem::create_directories(directory);
+        }
+        void TearDown() override {
+            std::filesystem::remove_all(directory);
+        }
+        // Archive at `name` holding the given files, each written from memory
+        auto write(const std::string& name, const std::vector<std::pair<std::string, std::string>>& files, const zfiles::WriteOptions& options = {}) -> std::filesystem::path {
+            auto const path = directory / name;
+            auto writer = zfiles::Writer(path, options);
+            for (auto const& [file, data] : files) {
+                auto const source = directory / "source";
+                std::ofstream(source, std::ios::binary) << data;
+                writer.add_file(source, file);
+            }
+            writer.close();
+            window_log = writer.window_log();
+            stats = writer.stats();
+            return path;
+        }
+        static auto read(const std::filesystem::path& path, std::optional<std::uint64_t> memory_limit = std::nullopt) -> std::vector<std::pair<std::string, std::string>> {
+            auto files = std::vector<std::pair<std::string, std::string>>{};
+            auto reader = zfiles::Reader(path, 1 << 16, memory_limit);
+            while (auto const entry = reader.next()) {
+                auto& [name, data] = files.emplace_back(std::string(entry->get().path), std::string{});
+                while (auto const block = reader.read_block())
+                    data.append(reinterpret_cast<const char*>(block->data.data()), block->data.size());
+            }
+            return files;
+        }
+
+        std::filesystem::path directory;
+        int window_log = 0;
+        zfiles::WriteStats stats;
+    };
+}
+
+TEST_F(Writer, ZstdRoundTrip)
+{
+    auto const files = std::vector<std::pair<std::string, std::string>>{
+        {"empty", ""},
+        {"text", std::string(100'000, 'a') + "end"},
+        {"noise", random_bytes(300'000, 1)},
+    };
+    auto const archive = write("a.tar.zst", files, { .level = 5 });
+    EXPECT_EQ(window_log, 21);
+    EXPECT_EQ(read(archive), files);
+    // Split into volumes, read back as one stream
+    auto const split = write("split.tar.zst", files, { .volume_size = 50'000 });
+    EXPECT_TRUE(std::filesystem::exists(zfiles::volume_path(split, 2)));
+    EXPECT_EQ(read(split), files);
+}
+
+TEST_F(Writer, VolumesOnASharedScheduler)
+{
+    auto const files = std::vector<std::pair<std::string, std::string>>{{"noise", random_bytes(std::size_t{20} << 20, 6)}};
+    // Written from a task of the scheduler that writes the volumes: the only
+    // worker is busy with the writer, which has to write its pieces itself.
+    auto scheduler = zfiles::Scheduler(1);
+    auto archive = std::filesystem::path{};
+    scheduler.submit([&] { archive = write("a.tar.zst", files, { .volume_size = 3'000'000, .scheduler = &scheduler }); });
+    scheduler.wait();
+    EXPECT_TRUE(std::filesystem::exists(zfiles::volume_path(archive, 7)));
+    EXPECT_EQ(read(archive), files);
+    auto const zip = write("a.zip", files, { .volume_size = 5'000'000, .scheduler = &scheduler });
+    EXPECT_EQ(read(zip), files);
+}
+
+TEST_F(Writer, LongWindowNeedsTheMemoryToRead)
+{
+    // Two copies of data further apart than the default window
+    auto const block = random_bytes(std::size_t{3} << 20, 2);
+    auto const files = std::vector<std::pair<std::string, std::string>>{{"first", block}, {"second", block}};
+    auto const plain = write("plain.tar.zst", files, { .level = 1 });
+    auto const long_distance = write("long.tar.zst", files, { .level = 1, .long_window = 27 });
+    EXPECT_EQ(window_log, 27);
+    EXPECT_LT(std::filesystem::file_size(long_distance), std::filesystem::file_size(plain) * 2 / 3);
+    EXPECT_EQ(read(long_distance), files);
+    EXPECT_THROW(read(long_distance, std::uint64_t{1} << 26), zfiles::Error);
+
+    // The memory limit cuts the window down, and readers with that limit can read it.
+    auto const capped = write("capped.tar.zst", files, { .level = 1, .long_window = 27, .memory_limit = std::uint64_t{5} << 20 });
+    EXPECT_EQ(window_log, 22);
+    EXPECT_EQ(read(capped, std::uint64_t{4} << 20), files);
+}
+
+TEST_F(Writer, LongWindowOnlyForZstd)
+{
+    EXPECT_THROW(zfiles::Writer(directory / "a.tar.gz", { .long_window = 20 }), zfiles::Error);
+    EXPECT_THROW(zfiles::Writer(directory / "a.zip", { .memory_limit = 1 << 20 }), zfiles::Error);
+}
+
+TEST(AdaptiveLevel, FollowsTheSlowerSide)
+{
+    using std::chrono::milliseconds;
+    // Codec twice as fast as the input: room for a higher level
+    auto level = zfiles::AdaptiveLevel(1, 19, 3);
+    EXPECT_EQ(level.update(1 << 20, milliseconds(20), milliseconds(10)), 4);
+    // Codec slower than the input: back down, not below the minimum
+    EXPECT_EQ(level.update(1 << 20, milliseconds(10), milliseconds(20)), 3);
+    auto low = zfiles::AdaptiveLevel(1, 19, 1);
+    EXPECT_EQ(low.update(1 << 20, milliseconds(10), milliseconds(20)), 1);
+    // Within the margin the level stays
+    auto steady = zfiles::AdaptiveLevel(1, 19, 5);
+    EXPECT_EQ(steady.update(1 << 20, milliseconds(12), milliseconds(10)), 5);
+    // A target rate replaces the input rate: 1 MiB in 10 ms is about 100 MB/s.
+    auto target = zfiles::AdaptiveLevel(1, 19, 5, 1e9);
+    EXPECT_EQ(target.update(1 << 20, milliseconds(1000), milliseconds(10)), 4);
+}
+
+TEST_F(Writer, AdaptiveLevelChangesFrames)
+{
+    auto text = std::string{};
+    while (text.size() < (std::size_t{6} << 20))
+        text += "line " + std::to_string(text.size() % 7919) + " of some repetitive text\n";
+    auto const files = std::vector<std::pair<std::string, std::string>>{{"text", text}, {"noise", random_bytes(1 << 20, 3)}};
+    // Any codec is faster than one byte per second: the level only goes up.
+    auto const archive = write("adaptive.tar.zst", files, { .level = 1, .adaptive_level = true, .target_rate = 1.0 });
+    EXPECT_GT(stats.bytes_by_level.size(), 2u);
+    EXPECT_EQ(stats.bytes_by_level.begin()->first, 1);
+    EXPECT_EQ(read(archive), files);
+
+    EXPECT_THROW(zfiles::Writer(directory / "a.tar.gz", { .adaptive_level = true }), zfiles::Error);
+    EXPECT_THROW(zfiles::Writer(directory / "b.tar.zst", { .long_window = 24, .adaptive_level = true }), zfiles::Error);
+}
+
+TEST_F(Writer, IncompressibleFilesAreNotCompressedAgain)
+{
+    auto const noise = random_bytes(200'000, 4);
+    auto const files = std::vector<std::pair<std::string, std::string>>{
+        {"text", std::string(100'000, 'a')},
+        {"noise", noise},
+        // Too small to be worth a check
+        {"small", noise.substr(0, 1000)},
+        {"gzip", "\x1F\x8B" + std::string(20'000, 'b')},
+    };
+    auto const zstd = write("a.tar.zst", files, { .level = 9 });
+    EXPECT_EQ(stats.incompressible.files, 2u);
+    EXPECT_EQ(stats.incompressible.bytes, 220'002u);
+    ASSERT_TRUE(stats.bytes_by_level.contains(1));
+    EXPECT_GE(stats.bytes_by_level[1], 220'002u);
+    EXPECT_EQ(read(zstd), files);
+
+    auto const zip = write("a.zip", files);
+    EXPECT_EQ(stats.incompressible.files, 2u);
+    // The gzip lookalike is stored as it is, not deflated.
+    EXPECT_GT(std::filesystem::file_size(zip), 220'002u);
+    EXPECT_EQ(read(zip), files);
+    auto const deflated = write("b.zip", files, { .skip_incompressible = false });
+    EXPECT_EQ(stats.incompressible.files, 0u);
+    EXPECT_LT(std::filesystem::file_size(deflated), std::filesystem::file_size(zip));
+}
+
+TEST_F(Writer, PolicyPicksLevelsByContent)
+{
+    auto text = std::string{};
+    while (text.size() < 100'000)
+        text += "words of text " + std::to_string(text.size()) + "\n";
+    auto const files = std::vector<std::pair<std::string, std::string>>{
+        {"text", text},
+        {"image.png", "\x89PNG\r\n\x1A\n" + random_bytes(50'000, 5)},
+        {"table.csv", "a,b,c\n1,2,3\n" + std::string(30'000, '4')},
+        {"small", "tiny"},
+    };
+    auto const policy = zfiles::Policy::find("balanced");
+    ASSERT_TRUE(policy);
+    auto const zstd = write("a.tar.zst", files, { .policy = policy });
+    using zfiles::ContentClass;
+    EXPECT_EQ(stats.classes.size(), 3u);
+    EXPECT_EQ(stats.classes[ContentClass::Text].files, 1u);
+    EXPECT_EQ(stats.classes[ContentClass::Media].bytes, 50'008u);
+    EXPECT_EQ(stats.classes[ContentClass::Structured].files, 1u);
+    // Text at 12, media kept at 1, the table at 9
+    EXPECT_TRUE(stats.bytes_by_level.contains(12));
+    EXPECT_TRUE(stats.bytes_by_level.contains(1));
+    EXPECT_TRUE(stats.bytes_by_level.contains(9));
+    EXPECT_EQ(stats.incompressible.files, 0u);
+    EXPECT_EQ(read(zstd), files);
+
+    auto const zip = write("a.zip", files, { .policy = policy });
+    EXPECT_GT(std::filesystem::file_size(zip), 50'008u);
+    EXPECT_EQ(read(zip), files);
+
+    EXPECT_THROW(zfiles::Writer(directory / "a.tar.gz", { .policy = policy }), zfiles::Error);
+    EXPECT_THROW(zfiles::Writer(directory / "b.tar.zst", { .long_window = 24, .policy = policy }), zfiles::Error);
+    EXPECT_FALSE(zfiles::Policy::find("slow"));
+}
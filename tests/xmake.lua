@@ -0,0 +1,104 @@
+-- Behaviour tests, run with `xmake test`.
+target("test_lz4")
+    set_kind("binary")
+    set_default(false)
+    set_group("tests")
+    set_languages("cxxlatest", "clatest")
+    add_files("lz4_test.cpp", "../qtapp/src/lz4_compress.cpp")
+    add_includedirs("../qtapp/include")
+    add_packages("gtest", "lz4")
+    add_deps("zfiles")
+    add_tests("default")
+
+target("test_diff")
+    set_kind("binary")
+    set_default(false)
+    set_group("tests")
+    set_languages("cxxlatest", "clatest")
+    add_files("diff_test.cpp", "../consoleapp/src/diff.cpp")
+    add_includedirs("../consoleapp/include")
+    add_packages("gtest", "fmt")
+    add_deps("zfiles")
+    add_tests("default")
+
+target("test_parser")
+    set_kind("binary")
+    set_default(false)
+    set_group("tests")
+    set_languages("cxxlatest", "clatest")
+    add_files("parser_test.cpp", "../consoleapp/src/cmd_parser.cpp", "../consoleapp/src/cmd_input_file.cpp")
+    add_includedirs("../consoleapp/include")
+    add_packages("gtest", "fmt", "tl_expected")
+    add_tests("default")
+
+target("test_writer")
+    set_kind("binary")
+    set_default(false)
+    set_group("tests")
+    set_languages("cxxlatest", "clatest")
+    add_files("writer_test.cpp")
+    add_packages("gtest")
+    add_deps("zfiles")
+    add_tests("default")
+
+target("test_entropy")
+    set_kind("binary")
+    set_default(false)
+    set_group("tests")
+    set_languages("cxxlatest", "clatest")
+    add_files("entropy_test.cpp")
+    add_packages("gtest")
+    add_deps("zfiles")
+    add_tests("default")
+
+target("test_filter")
+    set_kind("binary")
+    set_default(false)
+    set_group("tests")
+    set_languages("cxxlatest", "clatest")
+    add_files("filter_test.cpp", "../qtapp/src/filtered_compress.cpp", "../qtapp/src/lz4_compress.cpp")
+    add_includedirs("../qtapp/include")
+    add_packages("gtest", "lz4")
+    add_deps("zfiles")
+    add_tests("default")
+
+target("test_codec")
+    set_kind("binary")
+    set_default(false)
+    set_group("tests")
+    set_languages("cxxlatest", "clatest")
+    add_files("codec_test.cpp")
+    add_packages("gtest")
+    add_deps("zfiles")
+    add_tests("default")
+
+target("test_utf8")
+    set_kind("binary")
+    set_default(false)
+    set_group("tests")
+    set_languages("cxxlatest", "clatest")
+    add_files("utf8_test.cpp")
+    add_includedirs("../consoleapp/include")
+    add_packages("gtest", "tl_expected")
+    add_tests("default")
+
+target("test_matcher")
+    set_kind("binary")
+    set_default(false)
+    set_group("tests")
+    set_languages("cxxlatest", "clatest")
+    add_files("matcher_test.cpp")
+    add_packages("gtest")
+    add_deps("zfiles")
+    add_tests("default")
+
+-- Benchmarks, run by hand with `xmake run`.
+target("bench_lz4")
+    set_kind("binary")
+    set_default(false)
+    set_group("benchmarks")
+    set_languages("cxxlatest", "clatest")
+    add_files("lz4_bench.cpp", "../qtapp/src/lz4_compress.cpp")
+    add_includedirs("../qtapp/include")
+    add_packages("fmt")
+    add_deps("zfiles")
@@ -4,7 +4,12 @@ add_rules("mode.debug", "mode.release")
 add_requires("libarchive")
 add_requires("fmt")
 add_requires("tl_expected")
+add_requires("gtest", {configs = {main = true}})
+add_requires("lz4")
+add_requires("zstd")
+add_requires("zlib")
+add_requires("xz")
 
 llvm_toolchain("LLVM15.0.0", "macosx")
 
-includes("qtapp", "glap", "consoleapp", "zfiles")
\ No newline at end of file
+includes("qtapp", "glap", "consoleapp", "zfiles", "tests")
\ No newline at end of file
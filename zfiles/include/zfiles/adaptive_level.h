@@ -0,0 +1,65 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <optional>
+
+namespace zfiles {
+
+    // Picks the compression level of the next block from measured throughput.
+    // Without a target rate the codec is kept just faster than the input is read,
+    // so that compression never becomes the bottleneck; with one (bytes/s) the
+    // codec is kept at or above that rate.
+    class AdaptiveLevel {
+    public:
+        AdaptiveLevel(int min_level, int max_level, int start_level, std::optional<double> target_rate = std::nullopt)
+            : min_level(min_level), max_level(max_level), current(std::clamp(start_level, min_level, max_level)), target_rate(target_rate)
+        {}
+
+        // Records one block and returns the level to use for the next one.
+        int update(std::size_t bytes, std::chrono::nanoseconds read_time, std::chrono::nanoseconds compress_time) {
+            if (bytes == 0)
+                return current;
+            input_rate = average(input_rate, rate(bytes, read_time));
+            codec_rate = average(codec_rate, rate(bytes, compress_time));
+            auto const target = target_rate.value_or(input_rate);
+            if (target <= 0.0)
+                return current;
+            if (codec_rate < target) {
+                current = std::max(current - 1, min_level);
+                codec_rate = 0.0;
+            } else if (codec_rate > target * raise_margin) {
+                current = std::min(current + 1, max_level);
+                codec_rate = 0.0;
+            }
+            return current;
+        }
+        int level() const noexcept { return current; }
+        double input_bytes_per_second() const noexcept { return input_rate; }
+        double codec_bytes_per_second() const noexcept { return codec_rate; }
+
+    private:
+        // A higher level must leave this much headroom before it is tried, which
+        // keeps the level from oscillating between two neighbours.
+        static constexpr double raise_margin = 1.5;
+        static constexpr double smoothing = 0.25;
+
+        static double rate(std::size_t bytes, std::chrono::nanoseconds time) noexcept {
+            auto const seconds = std::chrono::duration<double>(time).count();
+            return seconds <= 0.0 ? 0.0 : static_cast<double>(bytes) / seconds;
+        }
+        // The codec rate restarts after each level change, since the previous
+        // level's measurements no longer apply.
+        static double average(double previous, double sample) noexcept {
+            return previous == 0.0 ? sample : previous + smoothing * (sample - previous);
+        }
+
+        int min_level;
+        int max_level;
+        int current;
+        std::optional<double> target_rate;
+        double input_rate = 0.0;
+        double codec_rate = 0.0;
+    };
+
+} // namespace zfiles
@@ -0,0 +1,32 @@
+#pragma once
+#include <zfiles/filter.h>
+#include <cstddef>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace zfiles {
+
+    // Stream compressor known to libarchive, usable on its own (no archive format).
+    struct Codec {
+        std::string_view name;
+        int min_level;
+        int max_level;
+        int default_level;
+    };
+
+    // Codecs this build of libarchive can write without an external program.
+    auto codecs() -> std::span<const Codec>;
+    auto find_codec(std::string_view name) -> const Codec*;
+
+    auto compress(const Codec& codec, int level, std::span<const std::byte> data) -> std::vector<std::byte>;
+    // Decodes data written by any codec; `size_hint` is the expected output size.
+    auto decompress(std::span<const std::byte> data, std::size_t size_hint = 0) -> std::vector<std::byte>;
+
+    // Same, with the filters of `chain` in front of the codec: run in order on
+    // `data` before it is compressed, and undone after it is decompressed. The
+    // chain has to be fresh or reset; its throughput counters keep adding up.
+    auto compress(const Codec& codec, int level, std::span<const std::byte> data, FilterChain& chain) -> std::vector<std::byte>;
+    auto decompress(std::span<const std::byte> data, std::size_t size_hint, FilterChain& chain) -> std::vector<std::byte>;
+
+} // namespace zfiles
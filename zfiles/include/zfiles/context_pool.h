@@ -0,0 +1,110 @@
+#pragma once
+#include <zfiles/error.h>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+
+namespace zfiles {
+
+    // Codec contexts reused from one call to the next. Each thread keeps the
+    // contexts its calls gave back, up to `capacity`, so that a call on a warm
+    // thread allocates none: with many small entries, setting up a context
+    // costs more than the data. Traits give the Context type, its name, and
+    // create(), reset() (back to default parameters) and destroy().
+    template <class Traits>
+    class ContextPool {
+    public:
+        using Context = typename Traits::Context;
+
+        // A context for as long as the lease lives, given back when it ends
+        class Lease {
+        public:
+            explicit Lease(Context* context) : context(context) {}
+            Lease(Lease&& other) noexcept : context(std::exchange(other.context, nullptr)) {}
+            Lease& operator=(Lease&& other) noexcept {
+                std::swap(context, other.context);
+                return *this;
+            }
+            Lease(const Lease&) = delete;
+            Lease& operator=(const Lease&) = delete;
+            ~Lease() {
+                if (context)
+                    release(context);
+            }
+
+            auto get() const noexcept -> Context* { return context; }
+            auto operator*() const noexcept -> Context& { return *context; }
+            auto operator->() const noexcept -> Context* { return context; }
+
+        private:
+            Context* context;
+        };
+
+        static auto acquire() -> Lease {
+            auto& contexts = idle().contexts;
+            if (contexts.empty()) {
+                auto const context = Traits::create();
+                if (!context)
+                    throw Error("cannot allocate " + std::string(Traits::name));
+                return Lease(context);
+            }
+            auto const context = contexts.back();
+            contexts.pop_back();
+            return Lease(context);
+        }
+
+        // Contexts kept by the calling thread
+        static auto idle_count() -> std::size_t {
+            return idle().contexts.size();
+        }
+
+    private:
+        static constexpr std::size_t capacity = 4;
+
+        struct Idle {
+            Idle() { contexts.reserve(capacity); }
+            Idle(const Idle&) = delete;
+            Idle& operator=(const Idle&) = delete;
+            ~Idle() {
+                for (auto const context : contexts)
+                    Traits::destroy(context);
+            }
+            std::vector<Context*> contexts;
+        };
+
+        static auto idle() -> Idle& {
+            thread_local auto pool = Idle{};
+            return pool;
+        }
+        static void release(Context* context) noexcept {
+            Traits::reset(context);
+            auto& contexts = idle().contexts;
+            if (contexts.size() < capacity)
+                contexts.push_back(context);
+            else
+                Traits::destroy(context);
+        }
+    };
+
+    struct ZstdCompressor {
+        using Context = ZSTD_CCtx_s;
+        static constexpr auto name = "zstd compressor";
+        static auto create() -> Context*;
+        static void reset(Context* context) noexcept;
+        static void destroy(Context* context) noexcept;
+    };
+    struct ZstdDecompressor {
+        using Context = ZSTD_DCtx_s;
+        static constexpr auto name = "zstd decompressor";
+        static auto create() -> Context*;
+        static void reset(Context* context) noexcept;
+        static void destroy(Context* context) noexcept;
+    };
+    using ZstdCompressorPool = ContextPool<ZstdCompressor>;
+    using ZstdDecompressorPool = ContextPool<ZstdDecompressor>;
+
+} // namespace zfiles
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace zfiles {
+
+    // CRC-32 as stored by zip and gzip. Pass the previous result to continue
+    // over data split in pieces.
+    auto crc32(std::span<const std::byte> data, std::uint32_t crc = 0) -> std::uint32_t;
+
+} // namespace zfiles
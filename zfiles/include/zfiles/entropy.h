@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string_view>
+
+namespace zfiles {
+
+    // Prefix of the data the checks below look at.
+    inline constexpr std::size_t entropy_sample_size = 64 * 1024;
+
+    // Shannon entropy of the byte histogram of `data`, in bits per byte (0 to 8).
+    double byte_entropy(std::span<const std::byte> data) noexcept;
+
+    // Name of the compressed container or media format `data` starts with, if any
+    // (zip, gzip, xz, zstd, jpeg, png, mp4, ...).
+    std::optional<std::string_view> compressed_format(std::span<const std::byte> data) noexcept;
+
+    // True when compressing `data` is not worth the time: it starts with a known
+    // compressed format, or its first 64 KiB are close to random.
+    bool is_incompressible(std::span<const std::byte> data) noexcept;
+
+} // namespace zfiles
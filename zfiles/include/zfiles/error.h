@@ -0,0 +1,11 @@
+#pragma once
+#include <stdexcept>
+
+namespace zfiles {
+
+    class Error : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+} // namespace zfiles
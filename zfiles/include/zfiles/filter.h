@@ -0,0 +1,139 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace zfiles {
+
+    // Reversible in-place transform applied to a stream before it reaches a codec.
+    class Filter {
+    public:
+        virtual ~Filter() = default;
+
+        // Filters `data` in place and returns how many leading bytes are final.
+        // The remaining bytes must be passed again in front of the next input.
+        // When `last` is set, every byte is final.
+        virtual std::size_t encode(std::span<std::byte> data, bool last) = 0;
+        virtual std::size_t decode(std::span<std::byte> data, bool last) = 0;
+        virtual void reset() = 0;
+
+        virtual std::string_view name() const = 0;
+    };
+
+    // x86 branch converter (CALL/JMP rel32 to absolute), same output as xz --x86.
+    class X86Filter : public Filter {
+    public:
+        std::size_t encode(std::span<std::byte> data, bool last) override;
+        std::size_t decode(std::span<std::byte> data, bool last) override;
+        void reset() override;
+
+        std::string_view name() const override { return "x86"; }
+    private:
+        std::size_t convert(std::span<std::byte> data, bool last, bool is_encoder);
+
+        std::uint32_t position = 0;
+        std::uint32_t prev_mask = 0;
+        std::uint32_t prev_pos = static_cast<std::uint32_t>(-5);
+    };
+
+    // ARM64 BL/ADRP converter, same output as xz --arm64.
+    class Arm64Filter : public Filter {
+    public:
+        std::size_t encode(std::span<std::byte> data, bool last) override;
+        std::size_t decode(std::span<std::byte> data, bool last) override;
+        void reset() override;
+
+        std::string_view name() const override { return "arm64"; }
+    private:
+        std::size_t convert(std::span<std::byte> data, bool last, bool is_encoder);
+
+        std::uint32_t position = 0;
+    };
+
+    // Byte delta with a distance of 1 to 256 bytes, same output as xz --delta.
+    class DeltaFilter : public Filter {
+    public:
+        explicit DeltaFilter(std::size_t distance = 1);
+
+        std::size_t encode(std::span<std::byte> data, bool last) override;
+        std::size_t decode(std::span<std::byte> data, bool last) override;
+        void reset() override;
+
+        std::string_view name() const override { return "delta"; }
+    private:
+        std::size_t distance;
+        // Last `distance` bytes of the previous call, in stream order.
+        std::array<std::byte, 256> history{};
+    };
+
+    // Splits fixed-size records into byte columns, one block of records at a time,
+    // so that the n-th byte of every record ends up next to each other.
+    class TransposeFilter : public Filter {
+    public:
+        explicit TransposeFilter(std::size_t record_size, std::size_t records_per_block = 4096);
+
+        std::size_t encode(std::span<std::byte> data, bool last) override;
+        std::size_t decode(std::span<std::byte> data, bool last) override;
+        void reset() override {}
+
+        std::string_view name() const override { return "transpose"; }
+    private:
+        std::size_t convert(std::span<std::byte> data, bool last, bool is_encoder);
+
+        std::size_t record_size;
+        std::size_t records_per_block;
+        std::vector<std::byte> scratch;
+    };
+
+    // Filters run in order when encoding and in reverse order when decoding. Each
+    // stage works in place on a shared buffer and only sees the bytes the stage
+    // before it has made final.
+    class FilterChain {
+    public:
+        struct Throughput {
+            std::uint64_t bytes = 0;
+            std::chrono::nanoseconds elapsed{};
+
+            double bytes_per_second() const {
+                return elapsed.count() == 0 ? 0.0 : static_cast<double>(bytes) * 1e9 / static_cast<double>(elapsed.count());
+            }
+        };
+
+        FilterChain& add(std::unique_ptr<Filter> filter);
+        template <class F, class... Args>
+        FilterChain& make(Args&&... args) {
+            return add(std::make_unique<F>(std::forward<Args>(args)...));
+        }
+
+        // Appends the bytes that are final to `output`.
+        void encode(std::span<const std::byte> input, bool last, std::vector<std::byte>& output);
+        void decode(std::span<const std::byte> input, bool last, std::vector<std::byte>& output);
+        void reset();
+
+        std::size_t size() const { return stages.size(); }
+        const Filter& filter(std::size_t stage) const { return *stages[stage].filter; }
+        const Throughput& throughput(std::size_t stage) const { return stages[stage].throughput; }
+    private:
+        struct Stage {
+            std::unique_ptr<Filter> filter;
+            // Bytes of `pending` this stage has already made final.
+            std::size_t mark = 0;
+            Throughput throughput;
+        };
+        void run(std::span<const std::byte> input, bool last, std::vector<std::byte>& output, bool is_encoder);
+
+        std::vector<Stage> stages;
+        std::vector<std::byte> pending;
+    };
+
+    // Chain built from a comma-separated list of stages: "x86", "arm64",
+    // "delta:N" (distance N bytes) and "transpose:N" (records of N bytes),
+    // e.g. "x86,delta:4". Throws Error on an unknown stage.
+    auto make_filter_chain(std::string_view spec) -> FilterChain;
+
+} // namespace zfiles
@@ -0,0 +1,45 @@
+#pragma once
+#include <zfiles/reader.h>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace zfiles {
+
+    struct IndexEntry {
+        std::string path;
+        EntryType type;
+        std::optional<std::uint64_t> size;
+        std::int64_t mtime;
+        std::uint32_t mode;
+        std::string link_target;
+        // See Reader::stored_offset()
+        std::optional<std::uint64_t> stored_offset;
+        // CRC-32 of the content, when the archive stores one (zip)
+        std::optional<std::uint32_t> crc32;
+    };
+
+    // Headers of every entry of an archive, read in one pass and kept in
+    // archive order, with lookup by path. `memory_limit` is the Reader's.
+    class Index {
+    public:
+        explicit Index(const std::filesystem::path& path, std::optional<std::uint64_t> memory_limit = std::nullopt);
+
+        auto entries() const noexcept -> const std::vector<IndexEntry>& { return items; }
+        // Position of the entry with this path in archive order. When a path
+        // appears several times, the last one wins, as when extracting.
+        auto find(std::string_view path) const -> std::optional<std::size_t>;
+        // Positions of all entries, sorted by path then position.
+        auto sorted() const noexcept -> const std::vector<std::size_t>& { return by_path; }
+
+    private:
+        std::vector<IndexEntry> items;
+        // Positions in `items`, sorted by path then position.
+        std::vector<std::size_t> by_path;
+    };
+
+} // namespace zfiles
@@ -0,0 +1,79 @@
+#pragma once
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <map>
+#include <regex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace zfiles {
+
+    // Set of path patterns compiled into one automaton, so that testing a path
+    // costs one table lookup per byte however many patterns there are.
+    //
+    // Globs: `*` and `?` match within a path segment, `**` across segments,
+    // `[a-z]` and `[!a-z]` match one byte, `\` escapes. A glob without a '/'
+    // (or only a trailing one) matches at any depth, and a glob matching a
+    // directory also matches everything below it; one ending in '/' matches
+    // only the directory and what is below it, not a file of that name. Patterns starting with "re:" are ECMAScript regexes
+    // searched in the path; those starting with "^literal" are only run on
+    // paths beginning with that literal.
+    //
+    // The automaton is built lazily while matching: a set is not safe to share
+    // between threads.
+    class PatternSet {
+    public:
+        PatternSet() = default;
+        // Throws Error on a malformed pattern.
+        explicit PatternSet(std::span<const std::string_view> patterns);
+
+        auto empty() const noexcept -> bool { return !has_globs && regexes.empty(); }
+        auto matches(std::string_view path) -> bool;
+
+    private:
+        struct NfaState {
+            std::bitset<256> on;
+            std::uint32_t next = 0;
+            std::vector<std::uint32_t> epsilon;
+            bool accept = false;
+        };
+        struct Regex {
+            std::string prefix;
+            std::regex expression;
+        };
+        static constexpr std::int32_t unknown = -1;
+
+        void compile_glob(std::string_view pattern);
+        auto add_state() -> std::uint32_t;
+        auto dfa_state(std::vector<std::uint32_t> states) -> std::int32_t;
+        auto step(std::int32_t state, unsigned char byte) -> std::int32_t;
+
+        bool has_globs = false;
+        std::vector<NfaState> nfa{NfaState{}};
+        std::vector<Regex> regexes;
+        // Lazily built DFA, each state being a set of NFA states.
+        std::vector<std::array<std::int32_t, 256>> transitions;
+        std::vector<bool> accepting;
+        std::map<std::vector<std::uint32_t>, std::int32_t> dfa_ids;
+        std::vector<std::vector<std::uint32_t>> dfa_sets;
+    };
+
+    // Paths matching an include pattern (any path when there is none) and no exclude pattern.
+    class PathFilter {
+    public:
+        PathFilter(std::span<const std::string_view> include, std::span<const std::string_view> exclude)
+            : include(include), exclude(exclude) {}
+
+        auto matches(std::string_view path) -> bool {
+            return (include.empty() || include.matches(path)) && (exclude.empty() || !exclude.matches(path));
+        }
+
+    private:
+        PatternSet include;
+        PatternSet exclude;
+    };
+
+} // namespace zfiles
@@ -0,0 +1,53 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string_view>
+
+namespace zfiles {
+
+    enum class ContentClass {
+        Text,
+        Executable,
+        Compressed,
+        Media,
+        Structured,
+        Binary,
+    };
+    inline constexpr std::size_t content_class_count = 6;
+
+    std::string_view to_string(ContentClass content_class) noexcept;
+
+    // Sniffs the first bytes of a file to tell which kind of content it holds.
+    ContentClass classify(std::span<const std::byte> data) noexcept;
+
+    // How one class of content is written. A Writer can only vary this much
+    // from one entry to the next.
+    struct CodecRule {
+        // zstd level of the entry in tar.zst
+        int level;
+        // Kept as it is: stored in zip, at zstd level 1 in tar.zst
+        bool store = false;
+    };
+
+    // Rule table mapping every content class to a level, or to storing.
+    class Policy {
+    public:
+        constexpr Policy(std::string_view name, std::array<CodecRule, content_class_count> rules) : policy_name(name), rules(rules)
+        {}
+
+        // Built-in policies: "fast", "balanced" and "max".
+        static std::optional<Policy> find(std::string_view name) noexcept;
+
+        constexpr std::string_view name() const noexcept { return policy_name; }
+        constexpr const CodecRule& rule(ContentClass content_class) const noexcept {
+            return rules[static_cast<std::size_t>(content_class)];
+        }
+
+    private:
+        std::string_view policy_name;
+        std::array<CodecRule, content_class_count> rules;
+    };
+
+} // namespace zfiles
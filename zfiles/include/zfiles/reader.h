@@ -0,0 +1,125 @@
+#pragma once
+#include <zfiles/error.h>
+#include <zfiles/matcher.h>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+struct archive;
+struct archive_entry;
+
+namespace zfiles {
+
+    enum class EntryType {
+        File,
+        Directory,
+        Symlink,
+        Other,
+    };
+
+    // Header of the entry a Reader stands on. The views stay valid until the
+    // reader moves to the next entry.
+    struct Entry {
+        std::string_view path;
+        EntryType type;
+        std::optional<std::uint64_t> size;
+        std::int64_t mtime;
+        // Permission bits
+        std::uint32_t mode;
+        std::string_view link_target;
+    };
+
+    // Piece of entry data, pointing into the reader's own buffer. `offset` is
+    // its position in the entry; gaps between blocks are holes of zeros.
+    struct Block {
+        std::span<const std::byte> data;
+        std::uint64_t offset;
+    };
+
+    // Copy of an entry header with every attribute its format carries
+    // (owner, xattrs...), kept after the reader has moved on.
+    class Header {
+    public:
+        Header(Header&& other) noexcept;
+        Header& operator=(Header&& other) noexcept;
+        Header(const Header&) = delete;
+        Header& operator=(const Header&) = delete;
+        ~Header();
+
+        auto size() const -> std::optional<std::uint64_t>;
+        void set_size(std::uint64_t size);
+
+    private:
+        friend class Reader;
+        friend class Writer;
+        explicit Header(archive_entry* handle) : handle(handle) {}
+
+        archive_entry* handle;
+    };
+
+    // Name of volume `number` (counting from 1) of an archive split at `base`:
+    // base.001, base.002...
+    auto volume_path(const std::filesystem::path& base, std::size_t number) -> std::filesystem::path;
+    // Files holding the archive at `path`: the file itself, or every volume of
+    // a split archive when `path` names its first volume or its base name.
+    auto volume_paths(const std::filesystem::path& path) -> std::vector<std::filesystem::path>;
+
+    // Sequential reader over any archive format and filter libarchive supports.
+    // Volumes of a split archive are read as one stream, seeks included.
+    //
+    // zstd is decoded here rather than by libarchive, so that the memory its
+    // window takes can be capped: archives whose window is larger than
+    // `memory_limit` (by default 128 MiB, as for the zstd tool) are refused.
+    class Reader {
+    public:
+        explicit Reader(const std::filesystem::path& path, std::size_t block_size = 1 << 20, std::optional<std::uint64_t> memory_limit = std::nullopt);
+        Reader(Reader&& other) noexcept;
+        Reader& operator=(Reader&& other) noexcept;
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+        ~Reader();
+
+        // Only entries whose path passes `filter` are returned from now on. The
+        // others are skipped on their header, without decoding their data.
+        void set_filter(PathFilter filter);
+        // Moves to the next entry, or returns std::nullopt after the last one.
+        auto next() -> std::optional<std::reference_wrapper<const Entry>>;
+        // Reads data of the current entry into `buffer`; returns 0 at its end.
+        auto read(std::span<std::byte> buffer) -> std::size_t;
+        // Reads the next block of the current entry without copying it, or
+        // returns std::nullopt at its end.
+        auto read_block() -> std::optional<Block>;
+        // Skips the rest of the current entry without decoding it when the format allows.
+        void skip();
+        // Offset of the current entry's data in the archive file, when the data
+        // is stored there as is and in one piece (uncompressed tar, not split),
+        // so that it can be copied straight from the file.
+        auto stored_offset() const -> std::optional<std::uint64_t>;
+        // libarchive's name for the archive format, known once an entry was read.
+        auto format_name() const -> std::string_view;
+        // Full header of the current entry.
+        auto header() const -> Header;
+
+    private:
+        class Volumes;
+        class Decoder;
+
+        void check(int status) const;
+
+        archive* handle;
+        // Stream stitched from the volumes of a split archive, or the file a decoder reads
+        std::unique_ptr<Volumes> volumes;
+        std::unique_ptr<Decoder> decoder;
+        archive_entry* current = nullptr;
+        Entry entry{};
+        std::optional<std::uint64_t> data_offset;
+        std::optional<PathFilter> filter;
+    };
+
+} // namespace zfiles
@@ -0,0 +1,42 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace zfiles {
+
+    // Fixed pool of worker threads shared by every archive job of a process.
+    // At most `concurrency` tasks run at once; the others wait in submission order.
+    class Scheduler {
+    public:
+        explicit Scheduler(std::size_t concurrency = std::thread::hardware_concurrency());
+        Scheduler(const Scheduler&) = delete;
+        Scheduler& operator=(const Scheduler&) = delete;
+        ~Scheduler();
+
+        void submit(std::function<void()> task);
+        // Blocks until every submitted task has finished, then rethrows the
+        // first exception a task let escape, if any.
+        void wait();
+
+        auto concurrency() const noexcept -> std::size_t { return workers.size(); }
+
+    private:
+        void work();
+
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::condition_variable idle;
+        std::deque<std::function<void()>> tasks;
+        std::size_t running = 0;
+        bool stopping = false;
+        std::exception_ptr failure;
+        std::vector<std::thread> workers;
+    };
+
+} // namespace zfiles
@@ -0,0 +1,119 @@
+#pragma once
+#include <zfiles/policy.h>
+#include <zfiles/reader.h>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace zfiles {
+
+    class Scheduler;
+
+    struct WriteOptions {
+        // Codec level, else the codec's default
+        std::optional<int> level = std::nullopt;
+        // Cut the archive into volumes of this many bytes
+        std::optional<std::uint64_t> volume_size = std::nullopt;
+        // Runs the writes of the volumes while the next ones are encoded; it
+        // has to outlive the writer. Without one, volumes are written in turn.
+        Scheduler* scheduler = nullptr;
+        // zstd only: long-distance matching with a window of 2^long_window bytes
+        std::optional<int> long_window = std::nullopt;
+        // zstd only: memory the match window may take, which is cut down to fit.
+        // A reader needs as much to decode the archive.
+        std::optional<std::uint64_t> memory_limit = std::nullopt;
+        // zstd only: the level follows the throughput (see AdaptiveLevel),
+        // starting from `level`; not with long-distance matching.
+        bool adaptive_level = false;
+        // Throughput in bytes/s the adaptive level keeps up with, else the input rate
+        std::optional<double> target_rate = std::nullopt;
+        // Files added from disk that look compressed already (see is_incompressible)
+        // are stored in zip, and written at the fastest level in tar.zst.
+        bool skip_incompressible = true;
+        // zip and tar.zst only: files added from disk are classified and written
+        // as the policy's rule for their class says, instead of the check above.
+        // Not with long-distance matching nor an adaptive level.
+        std::optional<Policy> policy = std::nullopt;
+    };
+
+    struct FileCount {
+        std::size_t files = 0;
+        std::uint64_t bytes = 0;
+    };
+
+    // What a writer did, for reports
+    struct WriteStats {
+        // Bytes of the archive stream compressed at each zstd level
+        std::map<int, std::uint64_t> bytes_by_level;
+        // Files found incompressible
+        FileCount incompressible;
+        // Files classified by the policy
+        std::map<ContentClass, FileCount> classes;
+    };
+
+    // Sequential archive writer. Format and compression follow the file name:
+    // .tar, .tar.gz/.tgz, .tar.bz2/.tbz2, .tar.xz/.txz, .tar.zst/.tzst,
+    // .tar.lz4, .zip/.jar, .7z and .cpio.
+    //
+    // With a volume size, the archive is cut into files of that many bytes
+    // named path.001, path.002... (see volume_paths()). A volume's place in the
+    // stream is known in advance, so its pieces can be written by the tasks of
+    // a scheduler while the next ones are being encoded.
+    //
+    // zstd is encoded here rather than by libarchive, so that the window can
+    // be chosen: 2^window_log() bytes, which the reader has to be allowed.
+    // A level change ends the zstd frame, and starts the next at the new level.
+    class Writer {
+    public:
+        explicit Writer(const std::filesystem::path& path, const WriteOptions& options = {});
+        Writer(Writer&& other) noexcept;
+        Writer& operator=(Writer&& other) noexcept;
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+        ~Writer();
+
+        // Whether the file name maps to a format Writer can produce.
+        static auto supports(const std::filesystem::path& path) -> bool;
+        // Whether both names map to the same format and compression.
+        static auto same_layout(const std::filesystem::path& a, const std::filesystem::path& b) -> bool;
+
+        // Starts an entry; its data, if any, follows through write(). Sparse
+        // maps are dropped: holes have to be written out as zeros.
+        void add(Header& header);
+        void write(std::span<const std::byte> data);
+        // Adds the file, directory or symlink at `source` under `name`, data included.
+        void add_file(const std::filesystem::path& source, std::string_view name);
+        // Finishes the archive; errors on the last blocks are only reported here.
+        void close();
+        // log2 of the zstd window, 0 for other codecs
+        auto window_log() const -> int;
+        auto stats() const -> WriteStats;
+
+    private:
+        class Volumes;
+        class Encoder;
+
+        void check(int status) const;
+
+        archive* handle;
+        // Reads headers of files added from disk.
+        archive* disk = nullptr;
+        std::unique_ptr<Volumes> volumes;
+        std::unique_ptr<Encoder> encoder;
+        std::vector<std::byte> buffer;
+        // Whether add_file() looks for incompressible files, and for zip
+        bool sniff = false;
+        bool zip = false;
+        std::optional<Policy> policy;
+        // zstd level of files with no rule
+        int level = 0;
+        WriteStats statistics;
+    };
+
+} // namespace zfiles
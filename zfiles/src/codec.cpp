@@ -0,0 +1,356 @@
+#include <zfiles/codec.h>
+#include <zfiles/context_pool.h>
+#include <zfiles/error.h>
+#include <archive.h>
+#include <archive_entry.h>
+#include <lzma.h>
+#include <zlib.h>
+#include <zstd.h>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <memory>
+#include <string>
+
+namespace zfiles {
+
+    namespace {
+        constexpr auto known_codecs = std::array{
+            Codec{ .name = "gzip", .min_level = 1, .max_level = 9, .default_level = 6 },
+            Codec{ .name = "bzip2", .min_level = 1, .max_level = 9, .default_level = 9 },
+            Codec{ .name = "xz", .min_level = 0, .max_level = 9, .default_level = 6 },
+            Codec{ .name = "zstd", .min_level = 1, .max_level = 19, .default_level = 3 },
+            Codec{ .name = "lz4", .min_level = 1, .max_level = 9, .default_level = 1 },
+        };
+
+        using ArchivePtr = std::unique_ptr<archive, int (*)(archive*)>;
+
+        void check(archive* handle, int status)
+        {
+            if (status != ARCHIVE_OK)
+                throw Error(archive_error_string(handle) ? archive_error_string(handle) : "archive error");
+        }
+
+        auto append(archive*, void* output, const void* data, std::size_t size) -> la_ssize_t
+        {
+            auto& bytes = *static_cast<std::vector<std::byte>*>(output);
+            auto const begin = static_cast<const std::byte*>(data);
+            bytes.insert(bytes.end(), begin, begin + size);
+            return static_cast<la_ssize_t>(size);
+        }
+
+        auto starts_with(std::span<const std::byte> data, std::initializer_list<unsigned char> magic) -> bool
+        {
+            return data.size() >= magic.size() && std::equal(magic.begin(), magic.end(), data.begin(), [](unsigned char m, std::byte b) { return std::byte{m} == b; });
+        }
+
+        // zstd is run directly on a context of the thread, rather than through
+        // a libarchive handle set up for each call: blocks are often small
+        // enough for that setup to cost more than the compression.
+        void check_zstd(std::size_t status)
+        {
+            if (ZSTD_isError(status))
+                throw Error(std::string("zstd: ") + ZSTD_getErrorName(status));
+        }
+
+        auto zstd_compress(int level, std::span<const std::byte> data) -> std::vector<std::byte>
+        {
+            auto const context = ZstdCompressorPool::acquire();
+            check_zstd(ZSTD_CCtx_setParameter(context.get(), ZSTD_c_compressionLevel, level));
+            auto output = std::vector<std::byte>(ZSTD_compressBound(data.size()));
+            auto const size = ZSTD_compress2(context.get(), output.data(), output.size(), data.data(), data.size());
+            check_zstd(size);
+            output.resize(size);
+            return output;
+        }
+
+        // Frames one after the other decode to the concatenation of their contents.
+        auto zstd_decompress(std::span<const std::byte> data, std::size_t size_hint) -> std::vector<std::byte>
+        {
+            auto const context = ZstdDecompressorPool::acquire();
+            auto output = std::vector<std::byte>(std::max<std::size_t>(size_hint + 1, 64 * 1024));
+            auto in = ZSTD_inBuffer{ data.data(), data.size(), 0 };
+            auto size = std::size_t{0};
+            auto left = std::size_t{0};
+            while (in.pos < in.size || left != 0) {
+                if (size == output.size())
+                    output.resize(output.size() * 2);
+                auto out = ZSTD_outBuffer{ output.data() + size, output.size() - size, 0 };
+                left = ZSTD_decompressStream(context.get(), &out, &in);
+                check_zstd(left);
+                size += out.pos;
+                // Room left in the output, yet the frame needs more input than there is
+                if (left != 0 && in.pos == in.size && out.pos < out.size)
+                    throw Error("zstd: truncated frame");
+            }
+            output.resize(size);
+            return output;
+        }
+
+        // gzip and xz streams are kept the same way. bzip2 is not: libbz2 has
+        // no way to reset a stream, each one allocates its blocks anew.
+        struct Deflater {
+            using Context = z_stream;
+            static constexpr auto name = "zlib compressor";
+            static auto create() -> Context* {
+                auto context = std::make_unique<z_stream>();
+                // 15 + 16: largest window, gzip wrapper
+                if (deflateInit2(context.get(), Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+                    return nullptr;
+                return context.release();
+            }
+            static void reset(Context* context) noexcept { deflateReset(context); }
+            static void destroy(Context* context) noexcept {
+                deflateEnd(context);
+                delete context;
+            }
+        };
+        struct Inflater {
+            using Context = z_stream;
+            static constexpr auto name = "zlib decompressor";
+            static auto create() -> Context* {
+                auto context = std::make_unique<z_stream>();
+                // 15 + 32: largest window, zlib or gzip wrapper
+                if (inflateInit2(context.get(), 15 + 32) != Z_OK)
+                    return nullptr;
+                return context.release();
+            }
+            static void reset(Context* context) noexcept { inflateReset(context); }
+            static void destroy(Context* context) noexcept {
+                inflateEnd(context);
+                delete context;
+            }
+        };
+        // The coder is set up by each call: liblzma reuses the memory of the
+        // previous one when it can.
+        template <int Kind>
+        struct LzmaStream {
+            using Context = lzma_stream;
+            static constexpr auto name = "lzma stream";
+            static auto create() -> Context* { return new lzma_stream LZMA_STREAM_INIT; }
+            static void reset(Context*) noexcept {}
+            static void destroy(Context* context) noexcept {
+                lzma_end(context);
+                delete context;
+            }
+        };
+        using DeflaterPool = ContextPool<Deflater>;
+        using InflaterPool = ContextPool<Inflater>;
+        using LzmaEncoderPool = ContextPool<LzmaStream<0>>;
+        using LzmaDecoderPool = ContextPool<LzmaStream<1>>;
+
+        // Runs `step` with all of `data` as input until it reports the end,
+        // growing `output` as it fills up; `step(in, in_size, out, out_size)`
+        // returns whether the stream is over and updates the four counts.
+        template <class Step>
+        auto drain(std::span<const std::byte> data, std::size_t size_hint, Step step) -> std::vector<std::byte>
+        {
+            auto output = std::vector<std::byte>(std::max<std::size_t>(size_hint + 1, 64 * 1024));
+            auto in = data.data();
+            auto in_left = data.size();
+            auto size = std::size_t{0};
+            while (true) {
+                if (size == output.size())
+                    output.resize(output.size() * 2);
+                auto out_left = output.size() - size;
+                auto const done = step(in, in_left, output.data() + size, out_left);
+                size = output.size() - out_left;
+                if (done)
+                    break;
+            }
+            output.resize(size);
+            return output;
+        }
+
+        auto gzip_compress(int level, std::span<const std::byte> data) -> std::vector<std::byte>
+        {
+            auto const context = DeflaterPool::acquire();
+            if (deflateParams(context.get(), level, Z_DEFAULT_STRATEGY) != Z_OK)
+                throw Error("zlib: bad level " + std::to_string(level));
+            return drain(data, deflateBound(context.get(), data.size()), [&](const std::byte*& in, std::size_t& in_left, std::byte* out, std::size_t& out_left) {
+                // zlib counts in uInt: feed it at most that much at once.
+                constexpr auto most = std::size_t{std::numeric_limits<uInt>::max()};
+                auto const in_size = std::min(in_left, most);
+                auto const out_size = std::min(out_left, most);
+                context->next_in = reinterpret_cast<Bytef*>(const_cast<std::byte*>(in));
+                context->avail_in = static_cast<uInt>(in_size);
+                context->next_out = reinterpret_cast<Bytef*>(out);
+                context->avail_out = static_cast<uInt>(out_size);
+                auto const status = deflate(context.get(), in_size == in_left ? Z_FINISH : Z_NO_FLUSH);
+                if (status == Z_STREAM_ERROR)
+                    throw Error("zlib: cannot compress");
+                in += in_size - context->avail_in;
+                in_left -= in_size - context->avail_in;
+                out_left -= out_size - context->avail_out;
+                return status == Z_STREAM_END;
+            });
+        }
+
+        // Members one after the other decode to the concatenation of their contents.
+        auto gzip_decompress(std::span<const std::byte> data, std::size_t size_hint) -> std::vector<std::byte>
+        {
+            auto const context = InflaterPool::acquire();
+            return drain(data, size_hint, [&](const std::byte*& in, std::size_t& in_left, std::byte* out, std::size_t& out_left) {
+                constexpr auto most = std::size_t{std::numeric_limits<uInt>::max()};
+                auto const in_size = std::min(in_left, most);
+                auto const out_size = std::min(out_left, most);
+                context->next_in = reinterpret_cast<Bytef*>(const_cast<std::byte*>(in));
+                context->avail_in = static_cast<uInt>(in_size);
+                context->next_out = reinterpret_cast<Bytef*>(out);
+                context->avail_out = static_cast<uInt>(out_size);
+                auto const status = inflate(context.get(), Z_NO_FLUSH);
+                in += in_size - context->avail_in;
+                in_left -= in_size - context->avail_in;
+                out_left -= out_size - context->avail_out;
+                if (status == Z_STREAM_END) {
+                    if (in_left == 0)
+                        return true;
+                    inflateReset(context.get());
+                    return false;
+                }
+                if (status == Z_BUF_ERROR && in_left == 0 && context->avail_out != 0)
+                    throw Error("zlib: truncated stream");
+                if (status != Z_OK && status != Z_BUF_ERROR)
+                    throw Error(std::string("zlib: ") + (context->msg ? context->msg : "corrupt stream"));
+                return false;
+            });
+        }
+
+        auto run_lzma(lzma_stream& stream, std::span<const std::byte> data, std::size_t size_hint) -> std::vector<std::byte>
+        {
+            return drain(data, size_hint, [&](const std::byte*& in, std::size_t& in_left, std::byte* out, std::size_t& out_left) {
+                stream.next_in = reinterpret_cast<const std::uint8_t*>(in);
+                stream.avail_in = in_left;
+                stream.next_out = reinterpret_cast<std::uint8_t*>(out);
+                stream.avail_out = out_left;
+                auto const status = lzma_code(&stream, LZMA_FINISH);
+                in += in_left - stream.avail_in;
+                in_left = stream.avail_in;
+                out_left = stream.avail_out;
+                if (status == LZMA_STREAM_END)
+                    return true;
+                if (status == LZMA_BUF_ERROR && in_left == 0)
+                    throw Error("xz: truncated stream");
+                if (status != LZMA_OK && status != LZMA_BUF_ERROR)
+                    throw Error("xz: error " + std::to_string(status));
+                return false;
+            });
+        }
+
+        auto xz_compress(int level, std::span<const std::byte> data) -> std::vector<std::byte>
+        {
+            auto const context = LzmaEncoderPool::acquire();
+            if (lzma_easy_encoder(context.get(), static_cast<std::uint32_t>(level), LZMA_CHECK_CRC64) != LZMA_OK)
+                throw Error("xz: cannot set up level " + std::to_string(level));
+            return run_lzma(*context, data, lzma_stream_buffer_bound(data.size()));
+        }
+
+        auto xz_decompress(std::span<const std::byte> data, std::size_t size_hint) -> std::vector<std::byte>
+        {
+            auto const context = LzmaDecoderPool::acquire();
+            if (lzma_stream_decoder(context.get(), std::numeric_limits<std::uint64_t>::max(), LZMA_CONCATENATED) != LZMA_OK)
+                throw Error("xz: cannot set up the decoder");
+            return run_lzma(*context, data, size_hint);
+        }
+    }
+
+    auto codecs() -> std::span<const Codec>
+    {
+        static auto const available = [] {
+            auto result = std::vector<Codec>{};
+            for (auto const& codec : known_codecs) {
+                auto const handle = ArchivePtr(archive_write_new(), archive_write_free);
+                if (archive_write_add_filter_by_name(handle.get(), std::string(codec.name).c_str()) == ARCHIVE_OK)
+                    result.push_back(codec);
+            }
+            return result;
+        }();
+        return available;
+    }
+
+    auto find_codec(std::string_view name) -> const Codec*
+    {
+        auto const list = codecs();
+        auto const found = std::find_if(list.begin(), list.end(), [name](const Codec& codec) { return codec.name == name; });
+        return found == list.end() ? nullptr : &*found;
+    }
+
+    auto compress(const Codec& codec, int level, std::span<const std::byte> data) -> std::vector<std::byte>
+    {
+        if (codec.name == "zstd")
+            return zstd_compress(level, data);
+        if (codec.name == "gzip")
+            return gzip_compress(level, data);
+        if (codec.name == "xz")
+            return xz_compress(level, data);
+        auto output = std::vector<std::byte>{};
+        output.reserve(data.size() / 2 + 1024);
+        auto const handle = ArchivePtr(archive_write_new(), archive_write_free);
+        auto const writer = handle.get();
+        check(writer, archive_write_add_filter_by_name(writer, std::string(codec.name).c_str()));
+        check(writer, archive_write_set_filter_option(writer, nullptr, "compression-level", std::to_string(level).c_str()));
+        check(writer, archive_write_set_format_raw(writer));
+        // No padding of the last block: the output is the compressed stream only.
+        check(writer, archive_write_set_bytes_in_last_block(writer, 1));
+        check(writer, archive_write_open2(writer, &output, nullptr, append, nullptr, nullptr));
+
+        auto const entry = std::unique_ptr<archive_entry, void (*)(archive_entry*)>(archive_entry_new(), archive_entry_free);
+        archive_entry_set_filetype(entry.get(), AE_IFREG);
+        archive_entry_set_size(entry.get(), static_cast<la_int64_t>(data.size()));
+        check(writer, archive_write_header(writer, entry.get()));
+        if (archive_write_data(writer, data.data(), data.size()) != static_cast<la_ssize_t>(data.size()))
+            throw Error(archive_error_string(writer));
+        check(writer, archive_write_close(writer));
+        return output;
+    }
+
+    auto decompress(std::span<const std::byte> data, std::size_t size_hint) -> std::vector<std::byte>
+    {
+        if (starts_with(data, {0x28, 0xB5, 0x2F, 0xFD}))
+            return zstd_decompress(data, size_hint);
+        if (starts_with(data, {0x1F, 0x8B}))
+            return gzip_decompress(data, size_hint);
+        if (starts_with(data, {0xFD, '7', 'z', 'X', 'Z', 0x00}))
+            return xz_decompress(data, size_hint);
+        auto const handle = ArchivePtr(archive_read_new(), archive_read_free);
+        auto const reader = handle.get();
+        archive_read_support_filter_all(reader);
+        archive_read_support_format_raw(reader);
+        check(reader, archive_read_open_memory(reader, data.data(), data.size()));
+        archive_entry* entry = nullptr;
+        check(reader, archive_read_next_header(reader, &entry));
+
+        auto output = std::vector<std::byte>(std::max<std::size_t>(size_hint + 1, 64 * 1024));
+        auto size = std::size_t{0};
+        while (true) {
+            if (size == output.size())
+                output.resize(output.size() * 2);
+            auto const count = archive_read_data(reader, output.data() + size, output.size() - size);
+            if (count < 0)
+                throw Error(archive_error_string(reader));
+            if (count == 0)
+                break;
+            size += static_cast<std::size_t>(count);
+        }
+        output.resize(size);
+        return output;
+    }
+
+    auto compress(const Codec& codec, int level, std::span<const std::byte> data, FilterChain& chain) -> std::vector<std::byte>
+    {
+        auto filtered = std::vector<std::byte>{};
+        filtered.reserve(data.size());
+        chain.encode(data, true, filtered);
+        return compress(codec, level, filtered);
+    }
+
+    auto decompress(std::span<const std::byte> data, std::size_t size_hint, FilterChain& chain) -> std::vector<std::byte>
+    {
+        auto const filtered = decompress(data, size_hint);
+        auto output = std::vector<std::byte>{};
+        output.reserve(filtered.size());
+        chain.decode(filtered, true, output);
+        return output;
+    }
+
+} // namespace zfiles
@@ -0,0 +1,32 @@
+#include <zfiles/context_pool.h>
+#include <zstd.h>
+
+namespace zfiles {
+
+    auto ZstdCompressor::create() -> Context*
+    {
+        return ZSTD_createCCtx();
+    }
+    void ZstdCompressor::reset(Context* context) noexcept
+    {
+        ZSTD_CCtx_reset(context, ZSTD_reset_session_and_parameters);
+    }
+    void ZstdCompressor::destroy(Context* context) noexcept
+    {
+        ZSTD_freeCCtx(context);
+    }
+
+    auto ZstdDecompressor::create() -> Context*
+    {
+        return ZSTD_createDCtx();
+    }
+    void ZstdDecompressor::reset(Context* context) noexcept
+    {
+        ZSTD_DCtx_reset(context, ZSTD_reset_session_and_parameters);
+    }
+    void ZstdDecompressor::destroy(Context* context) noexcept
+    {
+        ZSTD_freeDCtx(context);
+    }
+
+} // namespace zfiles
@@ -0,0 +1,47 @@
+#include <zfiles/crc32.h>
+#include <array>
+
+namespace zfiles {
+
+    namespace {
+        // tables[k][b] is the CRC of byte b followed by k zero bytes, which
+        // lets the loop below fold eight bytes per step.
+        constexpr auto tables = [] {
+            auto result = std::array<std::array<std::uint32_t, 256>, 8>{};
+            for (auto b = std::uint32_t{0}; b < 256; ++b) {
+                auto crc = b;
+                for (auto bit = 0; bit < 8; ++bit)
+                    crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+                result[0][b] = crc;
+            }
+            for (auto k = std::size_t{1}; k < result.size(); ++k) {
+                for (auto b = std::size_t{0}; b < 256; ++b)
+                    result[k][b] = (result[k - 1][b] >> 8) ^ result[0][result[k - 1][b] & 0xff];
+            }
+            return result;
+        }();
+
+        auto load_le32(const std::byte* data) -> std::uint32_t
+        {
+            return std::to_integer<std::uint32_t>(data[0]) | std::to_integer<std::uint32_t>(data[1]) << 8
+                | std::to_integer<std::uint32_t>(data[2]) << 16 | std::to_integer<std::uint32_t>(data[3]) << 24;
+        }
+    }
+
+    auto crc32(std::span<const std::byte> data, std::uint32_t crc) -> std::uint32_t
+    {
+        crc = ~crc;
+        auto it = data.data();
+        auto const end = it + data.size();
+        for (; end - it >= 8; it += 8) {
+            auto const low = load_le32(it) ^ crc;
+            auto const high = load_le32(it + 4);
+            crc = tables[7][low & 0xff] ^ tables[6][(low >> 8) & 0xff] ^ tables[5][(low >> 16) & 0xff] ^ tables[4][low >> 24]
+                ^ tables[3][high & 0xff] ^ tables[2][(high >> 8) & 0xff] ^ tables[1][(high >> 16) & 0xff] ^ tables[0][high >> 24];
+        }
+        for (; it != end; ++it)
+            crc = (crc >> 8) ^ tables[0][(crc ^ std::to_integer<std::uint32_t>(*it)) & 0xff];
+        return ~crc;
+    }
+
+} // namespace zfiles
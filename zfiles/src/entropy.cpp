@@ -0,0 +1,93 @@
+#include <zfiles/entropy.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace zfiles {
+
+    namespace {
+        // Above this many bits per byte general purpose codecs gain next to nothing.
+        constexpr auto incompressible_entropy = 7.9;
+
+        struct Magic {
+            std::size_t offset;
+            std::string_view bytes;
+            std::string_view format;
+        };
+        using namespace std::string_view_literals;
+        constexpr auto magics = std::array{
+            Magic{ 0, "PK\x03\x04"sv, "zip"sv },
+            Magic{ 0, "\x1F\x8B"sv, "gzip"sv },
+            Magic{ 0, "\xFD" "7zXZ\x00"sv, "xz"sv },
+            Magic{ 0, "\x28\xB5\x2F\xFD"sv, "zstd"sv },
+            Magic{ 0, "\x04\x22\x4D\x18"sv, "lz4"sv },
+            Magic{ 0, "BZh"sv, "bzip2"sv },
+            Magic{ 0, "7z\xBC\xAF\x27\x1C"sv, "7z"sv },
+            Magic{ 0, "Rar!\x1A\x07"sv, "rar"sv },
+            Magic{ 0, "\xFF\xD8\xFF"sv, "jpeg"sv },
+            Magic{ 0, "\x89PNG\r\n\x1A\n"sv, "png"sv },
+            Magic{ 0, "GIF8"sv, "gif"sv },
+            Magic{ 8, "WEBP"sv, "webp"sv },
+            Magic{ 4, "ftyp"sv, "mp4"sv },
+            Magic{ 0, "\x1A\x45\xDF\xA3"sv, "matroska"sv },
+            Magic{ 0, "OggS"sv, "ogg"sv },
+            Magic{ 0, "fLaC"sv, "flac"sv },
+            Magic{ 0, "ID3"sv, "mp3"sv },
+        };
+    }
+
+    double byte_entropy(std::span<const std::byte> data) noexcept
+    {
+        // Four interleaved tables so consecutive equal bytes do not serialise on
+        // the same counter.
+        std::array<std::array<std::uint32_t, 256>, 4> counts{};
+        auto p = data.data();
+        auto const end = p + data.size();
+        for (; p + 8 <= end; p += 8) {
+            std::uint64_t word;
+            std::memcpy(&word, p, 8);
+            ++counts[0][word & 0xFF];
+            ++counts[1][(word >> 8) & 0xFF];
+            ++counts[2][(word >> 16) & 0xFF];
+            ++counts[3][(word >> 24) & 0xFF];
+            ++counts[0][(word >> 32) & 0xFF];
+            ++counts[1][(word >> 40) & 0xFF];
+            ++counts[2][(word >> 48) & 0xFF];
+            ++counts[3][word >> 56];
+        }
+        for (; p < end; ++p)
+            ++counts[0][std::to_integer<std::uint8_t>(*p)];
+
+        auto entropy = 0.0;
+        auto const total = static_cast<double>(data.size());
+        for (auto value = 0; value < 256; ++value) {
+            auto const count = counts[0][value] + counts[1][value] + counts[2][value] + counts[3][value];
+            if (count == 0)
+                continue;
+            auto const probability = count / total;
+            entropy -= probability * std::log2(probability);
+        }
+        return entropy;
+    }
+
+    std::optional<std::string_view> compressed_format(std::span<const std::byte> data) noexcept
+    {
+        auto const found = std::find_if(magics.begin(), magics.end(), [data](const Magic& magic) {
+            return data.size() >= magic.offset + magic.bytes.size()
+                && std::memcmp(data.data() + magic.offset, magic.bytes.data(), magic.bytes.size()) == 0;
+        });
+        if (found == magics.end())
+            return std::nullopt;
+        return found->format;
+    }
+
+    bool is_incompressible(std::span<const std::byte> data) noexcept
+    {
+        if (compressed_format(data))
+            return true;
+        return byte_entropy(data.first(std::min(data.size(), entropy_sample_size))) > incompressible_entropy;
+    }
+
+} // namespace zfiles
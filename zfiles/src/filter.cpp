@@ -0,0 +1,452 @@
+#include <zfiles/filter.h>
+#include <zfiles/error.h>
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace zfiles {
+
+    namespace {
+        auto read32le(const std::byte* p) noexcept -> std::uint32_t {
+            return std::to_integer<std::uint32_t>(p[0])
+                | std::to_integer<std::uint32_t>(p[1]) << 8
+                | std::to_integer<std::uint32_t>(p[2]) << 16
+                | std::to_integer<std::uint32_t>(p[3]) << 24;
+        }
+        void write32le(std::byte* p, std::uint32_t value) noexcept {
+            p[0] = static_cast<std::byte>(value);
+            p[1] = static_cast<std::byte>(value >> 8);
+            p[2] = static_cast<std::byte>(value >> 16);
+            p[3] = static_cast<std::byte>(value >> 24);
+        }
+
+        // Position of the first E8 (CALL) or E9 (JMP) opcode in [pos, end), or `end`.
+        auto find_x86_branch(const std::byte* data, std::size_t pos, std::size_t end) noexcept -> std::size_t {
+#if defined(__SSE2__)
+            auto const mask = _mm_set1_epi8(static_cast<char>(0xFE));
+            auto const opcode = _mm_set1_epi8(static_cast<char>(0xE8));
+            for (; pos + 16 <= end; pos += 16) {
+                auto const v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+                auto const found = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(v, mask), opcode)));
+                if (found != 0)
+                    return pos + std::countr_zero(found);
+            }
+#endif
+            for (; pos < end && (std::to_integer<unsigned>(data[pos]) & 0xFE) != 0xE8; ++pos)
+                ;
+            return pos;
+        }
+        // Position of the first 4-byte word in [pos, end) that is a BL or ADRP instruction.
+        auto find_arm64_branch(const std::byte* data, std::size_t pos, std::size_t end) noexcept -> std::size_t {
+#if defined(__SSE2__)
+            auto const bl_mask = _mm_set1_epi32(static_cast<int>(0xFC000000));
+            auto const bl = _mm_set1_epi32(static_cast<int>(0x94000000));
+            auto const adrp_mask = _mm_set1_epi32(static_cast<int>(0x9F000000));
+            auto const adrp = _mm_set1_epi32(static_cast<int>(0x90000000));
+            for (; pos + 16 <= end; pos += 16) {
+                auto const v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+                auto const found = _mm_or_si128(
+                    _mm_cmpeq_epi32(_mm_and_si128(v, bl_mask), bl),
+                    _mm_cmpeq_epi32(_mm_and_si128(v, adrp_mask), adrp));
+                if (_mm_movemask_epi8(found) != 0)
+                    break;
+            }
+#endif
+            return pos;
+        }
+
+#if defined(__SSE2__)
+        template <int Shift>
+        auto prefix_sum(__m128i x) noexcept -> __m128i {
+            if constexpr (Shift < 16)
+                return prefix_sum<Shift * 2>(_mm_add_epi8(x, _mm_slli_si128(x, Shift)));
+            else
+                return x;
+        }
+        // Delta decoding of data[i..n) for a distance that divides 16: an in-register
+        // prefix sum per lane followed by the carry of the previous `Distance` bytes.
+        template <std::size_t Distance>
+        auto delta_decode_sse(std::byte* data, std::size_t i, std::size_t n) noexcept -> std::size_t {
+            for (; i + 16 <= n; i += 16) {
+                auto carry = __m128i{};
+                if constexpr (Distance == 1) {
+                    carry = _mm_set1_epi8(static_cast<char>(data[i - 1]));
+                } else if constexpr (Distance == 2) {
+                    std::uint16_t last;
+                    std::memcpy(&last, data + i - 2, 2);
+                    carry = _mm_set1_epi16(static_cast<short>(last));
+                } else if constexpr (Distance == 4) {
+                    std::uint32_t last;
+                    std::memcpy(&last, data + i - 4, 4);
+                    carry = _mm_set1_epi32(static_cast<int>(last));
+                } else {
+                    carry = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data + i - 8)), _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data + i - 8)));
+                }
+                auto const x = prefix_sum<Distance>(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_add_epi8(x, carry));
+            }
+            return i;
+        }
+
+        // Transposes 16 records of `RecordSize` bytes per step by splitting even and
+        // odd bytes log2(RecordSize) times; the stream reached through split bits
+        // b1, b2, ... holds column b1 + 2*b2 + ...
+        template <std::size_t RecordSize>
+        auto transpose_encode_sse(const std::byte* in, std::byte* out, std::size_t records) noexcept -> std::size_t {
+            auto const low = _mm_set1_epi16(0x00FF);
+            auto r = std::size_t{0};
+            for (; r + 16 <= records; r += 16) {
+                __m128i v[RecordSize];
+                for (auto i = std::size_t{0}; i < RecordSize; ++i)
+                    v[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + r * RecordSize + 16 * i));
+                for (auto streams = std::size_t{1}; streams < RecordSize; streams *= 2) {
+                    auto const half = RecordSize / streams / 2;
+                    __m128i next[RecordSize];
+                    for (auto s = std::size_t{0}; s < streams; ++s) {
+                        for (auto i = std::size_t{0}; i < half; ++i) {
+                            auto const a = v[s * half * 2 + 2 * i];
+                            auto const b = v[s * half * 2 + 2 * i + 1];
+                            next[s * half + i] = _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low));
+                            next[(s + streams) * half + i] = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+                        }
+                    }
+                    std::copy(std::begin(next), std::end(next), std::begin(v));
+                }
+                for (auto column = std::size_t{0}; column < RecordSize; ++column)
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + column * records + r), v[column]);
+            }
+            return r;
+        }
+        template <std::size_t RecordSize>
+        auto transpose_decode_sse(const std::byte* in, std::byte* out, std::size_t records) noexcept -> std::size_t {
+            auto r = std::size_t{0};
+            for (; r + 16 <= records; r += 16) {
+                __m128i v[RecordSize];
+                for (auto column = std::size_t{0}; column < RecordSize; ++column)
+                    v[column] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + column * records + r));
+                for (auto streams = RecordSize / 2; streams >= 1; streams /= 2) {
+                    auto const half = RecordSize / streams / 2;
+                    __m128i next[RecordSize];
+                    for (auto s = std::size_t{0}; s < streams; ++s) {
+                        for (auto i = std::size_t{0}; i < half; ++i) {
+                            auto const even = v[s * half + i];
+                            auto const odd = v[(s + streams) * half + i];
+                            next[s * half * 2 + 2 * i] = _mm_unpacklo_epi8(even, odd);
+                            next[s * half * 2 + 2 * i + 1] = _mm_unpackhi_epi8(even, odd);
+                        }
+                    }
+                    std::copy(std::begin(next), std::end(next), std::begin(v));
+                }
+                for (auto i = std::size_t{0}; i < RecordSize; ++i)
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + r * RecordSize + 16 * i), v[i]);
+            }
+            return r;
+        }
+#endif
+    }
+
+    std::size_t X86Filter::encode(std::span<std::byte> data, bool last) { return convert(data, last, true); }
+    std::size_t X86Filter::decode(std::span<std::byte> data, bool last) { return convert(data, last, false); }
+    void X86Filter::reset()
+    {
+        position = 0;
+        prev_mask = 0;
+        prev_pos = static_cast<std::uint32_t>(-5);
+    }
+    std::size_t X86Filter::convert(std::span<std::byte> data, bool last, bool is_encoder)
+    {
+        static constexpr bool mask_to_allowed_status[8] = { true, true, true, false, true, false, false, false };
+        static constexpr std::uint32_t mask_to_bit_number[8] = { 0, 1, 2, 2, 3, 3, 3, 3 };
+        auto test_ms_byte = [](std::uint32_t b) { return ((b + 1) & 0xFE) == 0; };
+
+        auto const buffer = data.data();
+        auto const size = data.size();
+        if (size < 5)
+            return last ? size : 0;
+        if (position - prev_pos > 5)
+            prev_pos = position - 5;
+
+        auto const limit = size - 5;
+        auto pos = std::size_t{0};
+        while ((pos = find_x86_branch(buffer, pos, limit + 1)) <= limit) {
+            auto const offset = position + static_cast<std::uint32_t>(pos) - prev_pos;
+            prev_pos = position + static_cast<std::uint32_t>(pos);
+            if (offset > 5) {
+                prev_mask = 0;
+            } else {
+                for (auto i = std::uint32_t{0}; i < offset; ++i) {
+                    prev_mask &= 0x77;
+                    prev_mask <<= 1;
+                }
+            }
+            auto b = std::to_integer<std::uint32_t>(buffer[pos + 4]);
+            if (test_ms_byte(b) && mask_to_allowed_status[(prev_mask >> 1) & 0x7] && (prev_mask >> 1) < 0x10) {
+                auto src = read32le(buffer + pos + 1);
+                auto dest = std::uint32_t{};
+                while (true) {
+                    auto const pc = position + static_cast<std::uint32_t>(pos) + 5;
+                    dest = is_encoder ? src + pc : src - pc;
+                    if (prev_mask == 0)
+                        break;
+                    auto const i = mask_to_bit_number[prev_mask >> 1];
+                    b = (dest >> (24 - i * 8)) & 0xFF;
+                    if (!test_ms_byte(b))
+                        break;
+                    src = dest ^ ((1U << (32 - i * 8)) - 1);
+                }
+                write32le(buffer + pos + 1, (dest & 0x00FFFFFF) | ((0U - ((dest >> 24) & 1)) << 24));
+                pos += 5;
+                prev_mask = 0;
+            } else {
+                ++pos;
+                prev_mask |= 1;
+                if (test_ms_byte(b))
+                    prev_mask |= 0x10;
+            }
+        }
+        position += static_cast<std::uint32_t>(pos);
+        return last ? size : pos;
+    }
+
+    std::size_t Arm64Filter::encode(std::span<std::byte> data, bool last) { return convert(data, last, true); }
+    std::size_t Arm64Filter::decode(std::span<std::byte> data, bool last) { return convert(data, last, false); }
+    void Arm64Filter::reset()
+    {
+        position = 0;
+    }
+    std::size_t Arm64Filter::convert(std::span<std::byte> data, bool last, bool is_encoder)
+    {
+        auto const buffer = data.data();
+        auto const end = data.size() & ~std::size_t{3};
+        for (auto i = find_arm64_branch(buffer, 0, end); i < end; i = find_arm64_branch(buffer, i + 4, end)) {
+            auto pc = position + static_cast<std::uint32_t>(i);
+            auto instr = read32le(buffer + i);
+            if ((instr >> 26) == 0x25) {
+                // BL
+                auto const src = instr;
+                pc >>= 2;
+                if (!is_encoder)
+                    pc = 0U - pc;
+                write32le(buffer + i, 0x94000000 | ((src + pc) & 0x03FFFFFF));
+            } else if ((instr & 0x9F000000) == 0x90000000) {
+                // ADRP, only converted within +/-512 MiB
+                auto const src = ((instr >> 29) & 3) | ((instr >> 3) & 0x001FFFFC);
+                if ((src + 0x00020000) & 0x001C0000)
+                    continue;
+                instr &= 0x9000001F;
+                pc >>= 12;
+                if (!is_encoder)
+                    pc = 0U - pc;
+                auto const dest = src + pc;
+                instr |= (dest & 3) << 29;
+                instr |= (dest & 0x0003FFFC) << 3;
+                instr |= (0U - (dest & 0x00020000)) & 0x00E00000;
+                write32le(buffer + i, instr);
+            }
+        }
+        position += static_cast<std::uint32_t>(end);
+        return last ? data.size() : end;
+    }
+
+    DeltaFilter::DeltaFilter(std::size_t distance) : distance(distance)
+    {
+        if (distance < 1 || distance > history.size())
+            throw std::invalid_argument("delta distance must be between 1 and 256");
+    }
+    void DeltaFilter::reset()
+    {
+        history.fill(std::byte{});
+    }
+    std::size_t DeltaFilter::encode(std::span<std::byte> data, bool)
+    {
+        auto const buffer = data.data();
+        auto const n = data.size();
+        auto const d = distance;
+        auto next_history = history;
+        if (n >= d) {
+            std::memcpy(next_history.data(), buffer + n - d, d);
+        } else {
+            std::memmove(next_history.data(), next_history.data() + n, d - n);
+            std::memcpy(next_history.data() + d - n, buffer, n);
+        }
+        // Backwards, so that data[i - d] is still the original byte.
+        auto i = n;
+#if defined(__SSE2__)
+        for (; i >= d + 16; i -= 16) {
+            auto const v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer + i - 16));
+            auto const previous = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer + i - 16 - d));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(buffer + i - 16), _mm_sub_epi8(v, previous));
+        }
+#endif
+        for (; i > d; --i)
+            buffer[i - 1] = static_cast<std::byte>(std::to_integer<unsigned>(buffer[i - 1]) - std::to_integer<unsigned>(buffer[i - 1 - d]));
+        for (auto j = std::size_t{0}; j < std::min(n, d); ++j)
+            buffer[j] = static_cast<std::byte>(std::to_integer<unsigned>(buffer[j]) - std::to_integer<unsigned>(history[j]));
+        history = next_history;
+        return n;
+    }
+    std::size_t DeltaFilter::decode(std::span<std::byte> data, bool)
+    {
+        auto const buffer = data.data();
+        auto const n = data.size();
+        auto const d = distance;
+        for (auto j = std::size_t{0}; j < std::min(n, d); ++j)
+            buffer[j] = static_cast<std::byte>(std::to_integer<unsigned>(buffer[j]) + std::to_integer<unsigned>(history[j]));
+        auto i = d;
+#if defined(__SSE2__)
+        if (d >= 16) {
+            for (; i + 16 <= n; i += 16) {
+                auto const v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer + i));
+                auto const previous = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer + i - d));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(buffer + i), _mm_add_epi8(v, previous));
+            }
+        } else if (n > d) {
+            switch (d) {
+                case 1: i = delta_decode_sse<1>(buffer, i, n); break;
+                case 2: i = delta_decode_sse<2>(buffer, i, n); break;
+                case 4: i = delta_decode_sse<4>(buffer, i, n); break;
+                case 8: i = delta_decode_sse<8>(buffer, i, n); break;
+                default: break;
+            }
+        }
+#endif
+        for (; i < n; ++i)
+            buffer[i] = static_cast<std::byte>(std::to_integer<unsigned>(buffer[i]) + std::to_integer<unsigned>(buffer[i - d]));
+        if (n >= d) {
+            std::memcpy(history.data(), buffer + n - d, d);
+        } else {
+            std::memmove(history.data(), history.data() + n, d - n);
+            std::memcpy(history.data() + d - n, buffer, n);
+        }
+        return n;
+    }
+
+    TransposeFilter::TransposeFilter(std::size_t record_size, std::size_t records_per_block)
+        : record_size(record_size), records_per_block(records_per_block)
+    {
+        if (record_size == 0 || records_per_block == 0)
+            throw std::invalid_argument("transpose record size and block length must not be zero");
+    }
+    std::size_t TransposeFilter::encode(std::span<std::byte> data, bool last) { return convert(data, last, true); }
+    std::size_t TransposeFilter::decode(std::span<std::byte> data, bool last) { return convert(data, last, false); }
+    std::size_t TransposeFilter::convert(std::span<std::byte> data, bool last, bool is_encoder)
+    {
+        auto const block_size = record_size * records_per_block;
+        auto transpose = [&](std::byte* block, std::size_t records) {
+            auto const size = records * record_size;
+            scratch.resize(size);
+            auto const out = scratch.data();
+            auto r = std::size_t{0};
+#if defined(__SSE2__)
+            switch (record_size) {
+                case 2: r = is_encoder ? transpose_encode_sse<2>(block, out, records) : transpose_decode_sse<2>(block, out, records); break;
+                case 4: r = is_encoder ? transpose_encode_sse<4>(block, out, records) : transpose_decode_sse<4>(block, out, records); break;
+                case 8: r = is_encoder ? transpose_encode_sse<8>(block, out, records) : transpose_decode_sse<8>(block, out, records); break;
+                default: break;
+            }
+#endif
+            for (; r < records; ++r) {
+                for (auto column = std::size_t{0}; column < record_size; ++column) {
+                    if (is_encoder)
+                        out[column * records + r] = block[r * record_size + column];
+                    else
+                        out[r * record_size + column] = block[column * records + r];
+                }
+            }
+            std::memcpy(block, out, size);
+        };
+        auto pos = std::size_t{0};
+        for (; data.size() - pos >= block_size; pos += block_size)
+            transpose(data.data() + pos, records_per_block);
+        if (!last)
+            return pos;
+        // The final partial block holds fewer records; trailing bytes of an
+        // incomplete record are left as they are.
+        if (auto const records = (data.size() - pos) / record_size; records > 0)
+            transpose(data.data() + pos, records);
+        return data.size();
+    }
+
+    FilterChain& FilterChain::add(std::unique_ptr<Filter> filter)
+    {
+        stages.push_back(Stage{ .filter = std::move(filter), .mark = 0, .throughput = {} });
+        return *this;
+    }
+    void FilterChain::encode(std::span<const std::byte> input, bool last, std::vector<std::byte>& output)
+    {
+        run(input, last, output, true);
+    }
+    void FilterChain::decode(std::span<const std::byte> input, bool last, std::vector<std::byte>& output)
+    {
+        run(input, last, output, false);
+    }
+    void FilterChain::reset()
+    {
+        pending.clear();
+        for (auto& stage : stages) {
+            stage.filter->reset();
+            stage.mark = 0;
+            stage.throughput = {};
+        }
+    }
+    void FilterChain::run(std::span<const std::byte> input, bool last, std::vector<std::byte>& output, bool is_encoder)
+    {
+        pending.insert(pending.end(), input.begin(), input.end());
+        auto limit = pending.size();
+        auto process = [&](Stage& stage) {
+            auto const region = std::span(pending).subspan(stage.mark, limit - stage.mark);
+            auto const start = std::chrono::steady_clock::now();
+            auto const done = is_encoder ? stage.filter->encode(region, last) : stage.filter->decode(region, last);
+            stage.throughput.elapsed += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+            stage.throughput.bytes += done;
+            stage.mark += done;
+            limit = stage.mark;
+        };
+        if (is_encoder)
+            std::for_each(stages.begin(), stages.end(), process);
+        else
+            std::for_each(stages.rbegin(), stages.rend(), process);
+        output.insert(output.end(), pending.begin(), pending.begin() + limit);
+        pending.erase(pending.begin(), pending.begin() + limit);
+        for (auto& stage : stages)
+            stage.mark -= limit;
+    }
+
+    auto make_filter_chain(std::string_view spec) -> FilterChain
+    {
+        auto chain = FilterChain{};
+        for (auto more = !spec.empty(); more; ) {
+            auto const comma = spec.find(',');
+            auto const stage = spec.substr(0, comma);
+            more = comma != std::string_view::npos;
+            spec = more ? spec.substr(comma + 1) : std::string_view{};
+            auto const colon = stage.find(':');
+            auto const name = stage.substr(0, colon);
+            auto size = std::size_t{0};
+            if (colon != std::string_view::npos) {
+                auto const value = stage.substr(colon + 1);
+                auto const [end, error] = std::from_chars(value.data(), value.data() + value.size(), size);
+                if (error != std::errc{} || end != value.data() + value.size() || size == 0)
+                    throw Error("filter " + std::string(stage) + ": invalid size");
+            }
+            if (name == "x86" && colon == std::string_view::npos)
+                chain.make<X86Filter>();
+            else if (name == "arm64" && colon == std::string_view::npos)
+                chain.make<Arm64Filter>();
+            else if (name == "delta" && size <= 256)
+                chain.make<DeltaFilter>(size == 0 ? 1 : size);
+            else if (name == "transpose" && size > 0)
+                chain.make<TransposeFilter>(size);
+            else
+                throw Error("unknown filter \"" + std::string(stage) + "\"");
+        }
+        return chain;
+    }
+
+} // namespace zfiles
@@ -0,0 +1,234 @@
+#include <zfiles/index.h>
+#include <algorithm>
+#include <fstream>
+#include <system_error>
+#include <unordered_map>
+
+namespace zfiles {
+
+    namespace {
+        auto load_le(std::span<const std::byte> data, std::size_t offset, std::size_t size) -> std::uint64_t
+        {
+            auto value = std::uint64_t{0};
+            for (auto i = size; i-- > 0; )
+                value = value << 8 | std::to_integer<std::uint64_t>(data[offset + i]);
+            return value;
+        }
+
+        // The volumes of an archive (or its one file) read as the stream they
+        // were cut from.
+        class JoinedFile {
+        public:
+            explicit JoinedFile(const std::filesystem::path& path) {
+                for (auto const& volume : volume_paths(path)) {
+                    auto error = std::error_code{};
+                    auto const size = std::filesystem::file_size(volume, error);
+                    if (error)
+                        break;
+                    parts.push_back(Part{ .path = volume, .start = total, .size = size });
+                    total += size;
+                }
+            }
+
+            auto size() const noexcept -> std::uint64_t { return total; }
+
+            // Up to `size` bytes from `offset`, fewer past the end
+            auto read_at(std::uint64_t offset, std::size_t size) -> std::vector<std::byte> {
+                auto data = std::vector<std::byte>{};
+                // Last volume starting at or before the offset
+                auto index = static_cast<std::size_t>(std::upper_bound(parts.begin(), parts.end(), offset, [](std::uint64_t value, const Part& part) { return value < part.start; }) - parts.begin());
+                if (index == 0)
+                    return data;
+                for (--index; index < parts.size() && data.size() < size; ++index) {
+                    auto const& part = parts[index];
+                    auto const local = offset + data.size() - part.start;
+                    if (local >= part.size)
+                        continue;
+                    auto const count = static_cast<std::size_t>(std::min<std::uint64_t>(size - data.size(), part.size - local));
+                    if (open_index != index) {
+                        file = std::ifstream(part.path, std::ios::binary);
+                        open_index = index;
+                    }
+                    auto const done = data.size();
+                    data.resize(done + count);
+                    file.seekg(static_cast<std::streamoff>(local));
+                    file.read(reinterpret_cast<char*>(data.data() + done), static_cast<std::streamsize>(count));
+                    auto const read = static_cast<std::size_t>(std::max<std::streamsize>(file.gcount(), 0));
+                    file.clear();
+                    if (read < count) {
+                        data.resize(done + read);
+                        break;
+                    }
+                }
+                return data;
+            }
+
+        private:
+            struct Part {
+                std::filesystem::path path;
+                std::uint64_t start;
+                std::uint64_t size;
+            };
+            std::vector<Part> parts;
+            std::uint64_t total = 0;
+            std::ifstream file;
+            std::size_t open_index = static_cast<std::size_t>(-1);
+        };
+
+        struct ZipRecord {
+            std::string name;
+            std::uint64_t size;
+            std::uint64_t offset;
+            std::uint32_t crc32;
+        };
+
+        // Entries listed in a zip central directory, in its order. libarchive
+        // reads their CRC-32 but does not hand it out. Split zips are read
+        // across their volumes, as the Reader does.
+        auto zip_directory(const std::filesystem::path& path) -> std::vector<ZipRecord>
+        {
+            constexpr auto end_size = std::size_t{22};
+            constexpr auto locator_size = std::size_t{20};
+            constexpr auto header_size = std::size_t{46};
+            constexpr auto zip64_marker = std::uint64_t{0xffffffff};
+            auto file = JoinedFile(path);
+            auto const file_size = file.size();
+            if (file_size < end_size)
+                return {};
+            auto const tail_offset = file_size - std::min<std::uint64_t>(file_size, 0xffff + end_size + locator_size);
+            auto const tail = file.read_at(tail_offset, static_cast<std::size_t>(file_size - tail_offset));
+            auto end = tail.size() - end_size + 1;
+            while (end-- > 0 && load_le(tail, end, 4) != 0x06054b50) {}
+            if (end == static_cast<std::size_t>(-1))
+                return {};
+
+            auto count = load_le(tail, end + 10, 2);
+            auto directory_size = load_le(tail, end + 12, 4);
+            auto directory_offset = load_le(tail, end + 16, 4);
+            auto end_offset = tail_offset + end;
+            if (end >= locator_size && load_le(tail, end - locator_size, 4) == 0x07064b50) {
+                auto const zip64_offset = load_le(tail, end - locator_size + 8, 8);
+                auto const zip64_end = file.read_at(zip64_offset, 56);
+                if (zip64_end.size() == 56 && load_le(zip64_end, 0, 4) == 0x06064b50) {
+                    count = load_le(zip64_end, 32, 8);
+                    directory_size = load_le(zip64_end, 40, 8);
+                    directory_offset = load_le(zip64_end, 48, 8);
+                    end_offset = zip64_offset;
+                }
+            }
+            if (directory_size > end_offset)
+                return {};
+            auto directory = file.read_at(directory_offset, static_cast<std::size_t>(directory_size));
+            // Data prepended to the zip (self-extracting archives) shifts every offset.
+            if (directory.size() < 4 || load_le(directory, 0, 4) != 0x02014b50)
+                directory = file.read_at(end_offset - directory_size, static_cast<std::size_t>(directory_size));
+
+            auto records = std::vector<ZipRecord>{};
+            records.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(count, directory_size / header_size)));
+            for (auto position = std::size_t{0}; position + header_size <= directory.size() && load_le(directory, position, 4) == 0x02014b50; ) {
+                auto const name_size = static_cast<std::size_t>(load_le(directory, position + 28, 2));
+                auto const extra_size = static_cast<std::size_t>(load_le(directory, position + 30, 2));
+                auto const comment_size = static_cast<std::size_t>(load_le(directory, position + 32, 2));
+                if (position + header_size + name_size + extra_size > directory.size())
+                    break;
+                auto const name = reinterpret_cast<const char*>(directory.data() + position + header_size);
+                auto record = ZipRecord{
+                    .name = std::string(name, name_size),
+                    .size = load_le(directory, position + 24, 4),
+                    .offset = load_le(directory, position + 42, 4),
+                    .crc32 = static_cast<std::uint32_t>(load_le(directory, position + 16, 4)),
+                };
+                // Values that do not fit 32 bits are in the zip64 extra field, in this order.
+                auto const compressed_size = load_le(directory, position + 20, 4);
+                auto const extra = std::span(directory).subspan(position + header_size + name_size, extra_size);
+                for (auto field = std::size_t{0}; field + 4 <= extra.size(); ) {
+                    auto const id = load_le(extra, field, 2);
+                    auto const size = static_cast<std::size_t>(load_le(extra, field + 2, 2));
+                    if (id == 0x0001) {
+                        auto value = field + 4;
+                        auto const field_end = std::min(extra.size(), value + size);
+                        if (record.size == zip64_marker && value + 8 <= field_end) {
+                            record.size = load_le(extra, value, 8);
+                            value += 8;
+                        }
+                        if (compressed_size == zip64_marker)
+                            value += 8;
+                        if (record.offset == zip64_marker && value + 8 <= field_end)
+                            record.offset = load_le(extra, value, 8);
+                        break;
+                    }
+                    field += 4 + size;
+                }
+                records.push_back(std::move(record));
+                position += header_size + name_size + extra_size + comment_size;
+            }
+            return records;
+        }
+
+        // Gives the zip entries of `items` their CRC-32. The reader returns
+        // them in the order of their local headers: the central directory
+        // sorted by offset lines up with them, whatever the name encoding.
+        // When it does not, names are matched, the last entry of a name winning.
+        void add_zip_checksums(const std::filesystem::path& path, std::vector<IndexEntry>& items)
+        {
+            auto records = zip_directory(path);
+            std::stable_sort(records.begin(), records.end(), [](const ZipRecord& a, const ZipRecord& b) { return a.offset < b.offset; });
+            auto const aligned = records.size() == items.size() && std::equal(records.begin(), records.end(), items.begin(), [](const ZipRecord& record, const IndexEntry& item) {
+                return item.type != EntryType::File || !item.size || record.size == *item.size;
+            });
+            if (aligned) {
+                for (auto i = std::size_t{0}; i < items.size(); ++i) {
+                    if (items[i].type == EntryType::File)
+                        items[i].crc32 = records[i].crc32;
+                }
+                return;
+            }
+            auto checksums = std::unordered_map<std::string, std::uint32_t>{};
+            checksums.reserve(records.size());
+            for (auto& record : records)
+                checksums.insert_or_assign(std::move(record.name), record.crc32);
+            for (auto& item : items) {
+                if (auto const found = checksums.find(item.path); found != checksums.end() && item.type == EntryType::File)
+                    item.crc32 = found->second;
+            }
+        }
+    }
+
+    Index::Index(const std::filesystem::path& path, std::optional<std::uint64_t> memory_limit)
+    {
+        auto reader = Reader(path, 1 << 20, memory_limit);
+        while (auto found = reader.next()) {
+            auto const& entry = found->get();
+            items.push_back(IndexEntry{
+                .path = std::string(entry.path),
+                .type = entry.type,
+                .size = entry.size,
+                .mtime = entry.mtime,
+                .mode = entry.mode,
+                .link_target = std::string(entry.link_target),
+                .stored_offset = reader.stored_offset(),
+                .crc32 = std::nullopt,
+            });
+        }
+        if (reader.format_name().starts_with("ZIP"))
+            add_zip_checksums(path, items);
+
+        by_path.resize(items.size());
+        for (auto i = std::size_t{0}; i < by_path.size(); ++i)
+            by_path[i] = i;
+        std::stable_sort(by_path.begin(), by_path.end(), [this](std::size_t a, std::size_t b) {
+            return items[a].path < items[b].path;
+        });
+    }
+
+    auto Index::find(std::string_view path) const -> std::optional<std::size_t>
+    {
+        auto const last = std::upper_bound(by_path.begin(), by_path.end(), path, [this](std::string_view value, std::size_t position) {
+            return value < items[position].path;
+        });
+        if (last == by_path.begin() || items[*std::prev(last)].path != path)
+            return std::nullopt;
+        return *std::prev(last);
+    }
+
+} // namespace zfiles
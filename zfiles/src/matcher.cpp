@@ -0,0 +1,241 @@
+#include <zfiles/matcher.h>
+#include <zfiles/error.h>
+#include <algorithm>
+
+namespace zfiles {
+
+    namespace {
+        constexpr auto regex_prefix = std::string_view("re:");
+        // More DFA states than this and the cache starts over.
+        constexpr auto max_dfa_states = std::size_t{4096};
+
+        auto any_byte() -> std::bitset<256>
+        {
+            return std::bitset<256>().set();
+        }
+        auto in_segment() -> std::bitset<256>
+        {
+            return any_byte().reset('/');
+        }
+        auto single(unsigned char byte) -> std::bitset<256>
+        {
+            return std::bitset<256>().set(byte);
+        }
+
+        // Parses the bracket expression starting at pattern[start] == '['.
+        // Returns the bytes it matches and the position past its ']'.
+        auto parse_class(std::string_view pattern, std::size_t start) -> std::pair<std::bitset<256>, std::size_t>
+        {
+            auto bytes = std::bitset<256>{};
+            auto position = start + 1;
+            auto const negate = position < pattern.size() && (pattern[position] == '!' || pattern[position] == '^');
+            if (negate)
+                ++position;
+            for (auto first = true; position < pattern.size() && (first || pattern[position] != ']'); first = false) {
+                auto low = static_cast<unsigned char>(pattern[position++]);
+                if (low == '\\' && position < pattern.size())
+                    low = static_cast<unsigned char>(pattern[position++]);
+                auto high = low;
+                if (position + 1 < pattern.size() && pattern[position] == '-' && pattern[position + 1] != ']') {
+                    high = static_cast<unsigned char>(pattern[position + 1]);
+                    position += 2;
+                }
+                for (auto byte = static_cast<unsigned>(low); byte <= high; ++byte)
+                    bytes.set(byte);
+            }
+            if (position >= pattern.size())
+                throw Error("unterminated [ in pattern: " + std::string(pattern));
+            if (negate)
+                bytes.flip();
+            bytes.reset('/');
+            return {bytes, position + 1};
+        }
+
+        // Literal text a regex anchored with '^' requires at the start of a path.
+        auto anchored_prefix(std::string_view regex) -> std::string
+        {
+            auto prefix = std::string{};
+            if (!regex.starts_with('^'))
+                return prefix;
+            for (auto position = std::size_t{1}; position < regex.size(); ++position) {
+                auto const c = regex[position];
+                if (std::string_view(".[]()*+?{}|^$").find(c) != std::string_view::npos) {
+                    // The last literal may be made optional or repeated by what follows.
+                    if ((c == '*' || c == '?' || c == '{') && !prefix.empty())
+                        prefix.pop_back();
+                    break;
+                }
+                if (c == '\\')
+                    break;
+                prefix.push_back(c);
+            }
+            return prefix;
+        }
+    }
+
+    PatternSet::PatternSet(std::span<const std::string_view> patterns)
+    {
+        for (auto const pattern : patterns) {
+            if (pattern.starts_with(regex_prefix)) {
+                auto const expression = pattern.substr(regex_prefix.size());
+                try {
+                    regexes.push_back(Regex{
+                        .prefix = anchored_prefix(expression),
+                        .expression = std::regex(expression.begin(), expression.end(), std::regex::ECMAScript | std::regex::optimize),
+                    });
+                } catch (const std::regex_error& error) {
+                    throw Error("bad regex " + std::string(expression) + ": " + error.what());
+                }
+            } else {
+                compile_glob(pattern);
+                has_globs = true;
+            }
+        }
+    }
+
+    auto PatternSet::add_state() -> std::uint32_t
+    {
+        nfa.emplace_back();
+        return static_cast<std::uint32_t>(nfa.size() - 1);
+    }
+
+    // Appends the glob to the NFA as a branch of its start state. Each state
+    // has at most one byte transition; loops and choices go through epsilons.
+    void PatternSet::compile_glob(std::string_view pattern)
+    {
+        auto const anywhere = pattern.find('/') == std::string_view::npos || pattern.find('/') == pattern.size() - 1;
+        auto current = add_state();
+        nfa[0].epsilon.push_back(current);
+        auto byte_transition = [&](std::bitset<256> bytes) {
+            auto const next = add_state();
+            nfa[current].on = bytes;
+            nfa[current].next = next;
+            current = next;
+        };
+        auto loop = [&](std::bitset<256> bytes) {
+            auto const next = add_state();
+            nfa[current].on = bytes;
+            nfa[current].next = current;
+            nfa[current].epsilon.push_back(next);
+            current = next;
+        };
+        // Zero or more whole directories: (segment '/')*
+        auto directories = [&] {
+            auto const start = current;
+            auto const segment = add_state();
+            auto const slash = add_state();
+            auto const next = add_state();
+            nfa[start].on = in_segment();
+            nfa[start].next = segment;
+            nfa[start].epsilon.push_back(next);
+            nfa[segment].on = in_segment();
+            nfa[segment].next = segment;
+            nfa[segment].epsilon.push_back(slash);
+            nfa[slash].on = single('/');
+            nfa[slash].next = start;
+            current = next;
+        };
+
+        if (anywhere)
+            directories();
+        for (auto position = std::size_t{0}; position < pattern.size(); ) {
+            auto const c = pattern[position];
+            if (pattern.substr(position).starts_with("**/")) {
+                directories();
+                position += 3;
+            } else if (pattern.substr(position).starts_with("**")) {
+                loop(any_byte());
+                position += 2;
+            } else if (c == '*') {
+                loop(in_segment());
+                ++position;
+            } else if (c == '?') {
+                byte_transition(in_segment());
+                ++position;
+            } else if (c == '[') {
+                auto const [bytes, end] = parse_class(pattern, position);
+                byte_transition(bytes);
+                position = end;
+            } else {
+                if (c == '\\' && position + 1 < pattern.size())
+                    ++position;
+                byte_transition(single(static_cast<unsigned char>(pattern[position])));
+                ++position;
+            }
+        }
+        // What follows a matching directory matches too. A pattern ending in
+        // '/' already names one, and only matches with what is below it.
+        if (pattern.ends_with('/')) {
+            nfa[current].accept = true;
+            nfa[current].on = any_byte();
+            nfa[current].next = current;
+            return;
+        }
+        auto const below = add_state();
+        nfa[current].accept = true;
+        nfa[current].on = single('/');
+        nfa[current].next = below;
+        nfa[below].accept = true;
+        nfa[below].on = any_byte();
+        nfa[below].next = below;
+    }
+
+    auto PatternSet::dfa_state(std::vector<std::uint32_t> states) -> std::int32_t
+    {
+        // Epsilon closure
+        for (auto i = std::size_t{0}; i < states.size(); ++i) {
+            for (auto const next : nfa[states[i]].epsilon) {
+                if (std::find(states.begin(), states.end(), next) == states.end())
+                    states.push_back(next);
+            }
+        }
+        std::sort(states.begin(), states.end());
+        if (auto const found = dfa_ids.find(states); found != dfa_ids.end())
+            return found->second;
+
+        auto const id = static_cast<std::int32_t>(transitions.size());
+        transitions.emplace_back().fill(unknown);
+        accepting.push_back(std::any_of(states.begin(), states.end(), [this](std::uint32_t state) { return nfa[state].accept; }));
+        dfa_sets.push_back(states);
+        dfa_ids.emplace(std::move(states), id);
+        return id;
+    }
+
+    auto PatternSet::step(std::int32_t state, unsigned char byte) -> std::int32_t
+    {
+        auto next = std::vector<std::uint32_t>{};
+        for (auto const nfa_state : dfa_sets[static_cast<std::size_t>(state)]) {
+            if (nfa[nfa_state].on.test(byte))
+                next.push_back(nfa[nfa_state].next);
+        }
+        auto const id = dfa_state(std::move(next));
+        transitions[static_cast<std::size_t>(state)][byte] = id;
+        return id;
+    }
+
+    auto PatternSet::matches(std::string_view path) -> bool
+    {
+        if (has_globs) {
+            if (transitions.size() > max_dfa_states) {
+                transitions.clear();
+                accepting.clear();
+                dfa_ids.clear();
+                dfa_sets.clear();
+            }
+            if (transitions.empty())
+                dfa_state({0});
+            auto state = std::int32_t{0};
+            for (auto const c : path) {
+                auto const byte = static_cast<unsigned char>(c);
+                auto const next = transitions[static_cast<std::size_t>(state)][byte];
+                state = next != unknown ? next : step(state, byte);
+            }
+            if (accepting[static_cast<std::size_t>(state)])
+                return true;
+        }
+        return std::any_of(regexes.begin(), regexes.end(), [path](const Regex& regex) {
+            return path.starts_with(regex.prefix) && std::regex_search(path.begin(), path.end(), regex.expression);
+        });
+    }
+
+} // namespace zfiles
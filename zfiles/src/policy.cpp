@@ -0,0 +1,131 @@
+#include <zfiles/policy.h>
+#include <zfiles/entropy.h>
+#include <algorithm>
+#include <cstring>
+
+namespace zfiles {
+
+    namespace {
+        using namespace std::string_view_literals;
+
+        // Only the start of a file is looked at.
+        constexpr auto sniff_size = std::size_t{4096};
+
+        constexpr auto media_formats = std::array{
+            "jpeg"sv, "png"sv, "gif"sv, "webp"sv, "mp4"sv, "matroska"sv, "ogg"sv, "flac"sv, "mp3"sv,
+        };
+        constexpr auto structured_magics = std::array{
+            "SQLite format 3\0"sv,
+            "PAR1"sv,
+            "ORC"sv,
+            "ARROW1"sv,
+            "Obj\x01"sv,
+        };
+
+        auto starts_with(std::span<const std::byte> data, std::string_view prefix) noexcept -> bool {
+            return data.size() >= prefix.size() && std::memcmp(data.data(), prefix.data(), prefix.size()) == 0;
+        }
+
+        // ELF, DOS or PE, Mach-O (thin or fat) or WebAssembly
+        auto is_executable(std::span<const std::byte> data) noexcept -> bool {
+            return starts_with(data, "\x7F" "ELF"sv) || starts_with(data, "MZ"sv)
+                || starts_with(data, "\xCF\xFA\xED\xFE"sv) || starts_with(data, "\xCE\xFA\xED\xFE"sv)
+                || starts_with(data, "\xCA\xFE\xBA\xBE"sv) || starts_with(data, "\0asm"sv);
+        }
+
+        auto is_text(std::span<const std::byte> data) noexcept -> bool {
+            auto printable = std::size_t{0};
+            for (auto byte : data) {
+                auto const c = std::to_integer<unsigned char>(byte);
+                if (c == 0)
+                    return false;
+                printable += c >= 0x20 || c == '\t' || c == '\n' || c == '\r';
+            }
+            return printable * 100 >= data.size() * 95;
+        }
+        auto is_structured_text(std::span<const std::byte> data) noexcept -> bool {
+            auto const text = std::string_view(reinterpret_cast<const char*>(data.data()), data.size());
+            auto const first = text.find_first_not_of(" \t\r\n");
+            if (first == std::string_view::npos)
+                return false;
+            if (text[first] == '{' || text[first] == '[' || text[first] == '<')
+                return true;
+            // Delimited tables: the first line has several separators and the
+            // second line as many.
+            auto const line_end = text.find('\n');
+            if (line_end == std::string_view::npos)
+                return false;
+            auto const next_end = text.find('\n', line_end + 1);
+            auto const first_line = text.substr(0, line_end);
+            auto const second_line = text.substr(line_end + 1, next_end == std::string_view::npos ? std::string_view::npos : next_end - line_end - 1);
+            for (auto separator : { ',', '\t', ';' }) {
+                auto const count = std::count(first_line.begin(), first_line.end(), separator);
+                if (count >= 2 && std::count(second_line.begin(), second_line.end(), separator) == count)
+                    return true;
+            }
+            return false;
+        }
+
+        constexpr auto policies = std::array{
+            Policy{ "fast", {
+                CodecRule{ .level = 1 },
+                CodecRule{ .level = 1 },
+                CodecRule{ .level = 1, .store = true },
+                CodecRule{ .level = 1, .store = true },
+                CodecRule{ .level = 1 },
+                CodecRule{ .level = 1 },
+            } },
+            Policy{ "balanced", {
+                CodecRule{ .level = 12 },
+                CodecRule{ .level = 12 },
+                CodecRule{ .level = 1, .store = true },
+                CodecRule{ .level = 1, .store = true },
+                CodecRule{ .level = 9 },
+                CodecRule{ .level = 6 },
+            } },
+            Policy{ "max", {
+                CodecRule{ .level = 19 },
+                CodecRule{ .level = 19 },
+                CodecRule{ .level = 1, .store = true },
+                CodecRule{ .level = 3 },
+                CodecRule{ .level = 19 },
+                CodecRule{ .level = 19 },
+            } },
+        };
+    }
+
+    std::string_view to_string(ContentClass content_class) noexcept
+    {
+        constexpr auto names = std::array{ "text"sv, "executable"sv, "compressed"sv, "media"sv, "structured"sv, "binary"sv };
+        return names[static_cast<std::size_t>(content_class)];
+    }
+
+    ContentClass classify(std::span<const std::byte> data) noexcept
+    {
+        auto const sample = data.first(std::min(data.size(), sniff_size));
+        if (auto const format = compressed_format(sample)) {
+            auto const media = std::find(media_formats.begin(), media_formats.end(), *format) != media_formats.end();
+            return media ? ContentClass::Media : ContentClass::Compressed;
+        }
+        if (is_executable(sample))
+            return ContentClass::Executable;
+        if (std::any_of(structured_magics.begin(), structured_magics.end(), [sample](std::string_view magic) { return starts_with(sample, magic); }))
+            return ContentClass::Structured;
+        if (is_text(sample))
+            return is_structured_text(sample) ? ContentClass::Structured : ContentClass::Text;
+        if (is_incompressible(data))
+            return ContentClass::Compressed;
+        return ContentClass::Binary;
+    }
+
+    std::optional<Policy> Policy::find(std::string_view name) noexcept
+    {
+        auto const found = std::find_if(policies.begin(), policies.end(), [name](const Policy& policy) {
+            return policy.name() == name;
+        });
+        if (found == policies.end())
+            return std::nullopt;
+        return *found;
+    }
+
+} // namespace zfiles
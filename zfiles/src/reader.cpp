@@ -0,0 +1,377 @@
+#include <zfiles/reader.h>
+#include <zfiles/context_pool.h>
+#include <archive.h>
+#include <archive_entry.h>
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+#include <zstd_errors.h>
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace zfiles {
+
+    // The volumes of a split archive read as one seekable stream.
+    class Reader::Volumes {
+    public:
+        Volumes(const std::vector<std::filesystem::path>& paths, std::size_t block_size) : buffer(block_size) {
+            for (auto const& path : paths) {
+                auto const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                struct stat status;
+                if (fd < 0 || ::fstat(fd, &status) != 0) {
+                    auto const error = Error(path.string() + ": " + std::strerror(errno));
+                    if (fd >= 0)
+                        ::close(fd);
+                    throw error;
+                }
+                files.push_back(File{ .fd = fd, .start = total });
+                total += static_cast<std::uint64_t>(status.st_size);
+            }
+        }
+        Volumes(const Volumes&) = delete;
+        Volumes& operator=(const Volumes&) = delete;
+        ~Volumes() {
+            for (auto const& file : files)
+                ::close(file.fd);
+        }
+
+        static auto read_callback(archive* handle, void* data, const void** block) -> la_ssize_t {
+            auto& self = *static_cast<Volumes*>(data);
+            if (self.position >= self.total)
+                return 0;
+            auto const file = std::prev(std::upper_bound(self.files.begin(), self.files.end(), self.position, [](std::uint64_t position, const File& file) {
+                return position < file.start;
+            }));
+            auto const end = std::next(file) == self.files.end() ? self.total : std::next(file)->start;
+            auto const size = static_cast<std::size_t>(std::min<std::uint64_t>(self.buffer.size(), end - self.position));
+            auto count = ::pread(file->fd, self.buffer.data(), size, static_cast<off_t>(self.position - file->start));
+            while (count < 0 && errno == EINTR)
+                count = ::pread(file->fd, self.buffer.data(), size, static_cast<off_t>(self.position - file->start));
+            if (count < 0) {
+                archive_set_error(handle, errno, "cannot read volume: %s", std::strerror(errno));
+                return -1;
+            }
+            if (count == 0) {
+                archive_set_error(handle, EIO, "volume shorter than when opened");
+                return -1;
+            }
+            self.position += static_cast<std::uint64_t>(count);
+            *block = self.buffer.data();
+            return count;
+        }
+        static auto skip_callback(archive*, void* data, la_int64_t request) -> la_int64_t {
+            auto& self = *static_cast<Volumes*>(data);
+            auto const count = std::min<std::uint64_t>(static_cast<std::uint64_t>(request), self.total - self.position);
+            self.position += count;
+            return static_cast<la_int64_t>(count);
+        }
+        static auto seek_callback(archive*, void* data, la_int64_t offset, int whence) -> la_int64_t {
+            auto& self = *static_cast<Volumes*>(data);
+            auto const base = whence == SEEK_SET ? 0 : whence == SEEK_CUR ? static_cast<la_int64_t>(self.position) : static_cast<la_int64_t>(self.total);
+            if (base + offset < 0)
+                return ARCHIVE_FATAL;
+            self.position = static_cast<std::uint64_t>(base + offset);
+            return base + offset;
+        }
+
+    private:
+        struct File {
+            int fd;
+            // Offset of the volume in the stream
+            std::uint64_t start;
+        };
+
+        std::vector<File> files;
+        std::vector<std::byte> buffer;
+        std::uint64_t total = 0;
+        std::uint64_t position = 0;
+    };
+
+    // zstd stream decoded from the volumes (or the one file) of an archive.
+    class Reader::Decoder {
+    public:
+        Decoder(Volumes& input, std::size_t block_size, std::optional<std::uint64_t> memory_limit) : input(input), context(ZstdDecompressorPool::acquire()), output(block_size) {
+            window_limit = memory_limit ? std::clamp(static_cast<int>(std::bit_width(*memory_limit)) - 1, ZSTD_WINDOWLOG_MIN, ZSTD_WINDOWLOG_MAX) : ZSTD_WINDOWLOG_LIMIT_DEFAULT;
+            ZSTD_DCtx_setParameter(context.get(), ZSTD_d_windowLogMax, window_limit);
+        }
+        Decoder(const Decoder&) = delete;
+        Decoder& operator=(const Decoder&) = delete;
+
+        // Whether the file starts with a zstd frame
+        static auto detect(const std::filesystem::path& path) -> bool {
+            auto const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                return false;
+            unsigned char magic[4];
+            auto const count = ::pread(fd, magic, sizeof(magic), 0);
+            ::close(fd);
+            return count == 4 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD;
+        }
+
+        static auto read_callback(archive* handle, void* data, const void** block) -> la_ssize_t {
+            auto& self = *static_cast<Decoder*>(data);
+            auto out = ZSTD_outBuffer{ self.output.data(), self.output.size(), 0 };
+            while (out.pos == 0) {
+                // A full output may have left decoded data in the context.
+                if (self.in.pos == self.in.size && !self.output_full) {
+                    const void* raw = nullptr;
+                    auto const count = Volumes::read_callback(handle, &self.input, &raw);
+                    if (count < 0)
+                        return -1;
+                    if (count == 0) {
+                        if (self.frame_open) {
+                            archive_set_error(handle, EINVAL, "truncated zstd stream");
+                            return -1;
+                        }
+                        return 0;
+                    }
+                    self.in = ZSTD_inBuffer{ raw, static_cast<std::size_t>(count), 0 };
+                }
+                auto const status = ZSTD_decompressStream(self.context.get(), &out, &self.in);
+                if (ZSTD_getErrorCode(status) == ZSTD_error_frameParameter_windowTooLarge) {
+                    auto const limit = std::to_string((std::uint64_t{1} << self.window_limit) >> 10);
+                    archive_set_error(handle, ENOMEM, "zstd window larger than the memory limit of %s KiB", limit.c_str());
+                    return -1;
+                }
+                if (ZSTD_isError(status)) {
+                    archive_set_error(handle, EINVAL, "zstd: %s", ZSTD_getErrorName(status));
+                    return -1;
+                }
+                self.frame_open = status != 0;
+                self.output_full = out.pos == out.size;
+            }
+            *block = self.output.data();
+            return static_cast<la_ssize_t>(out.pos);
+        }
+
+    private:
+        Volumes& input;
+        ZstdDecompressorPool::Lease context;
+        std::vector<std::byte> output;
+        ZSTD_inBuffer in{ nullptr, 0, 0 };
+        int window_limit;
+        bool frame_open = false;
+        bool output_full = false;
+    };
+
+    Reader::Reader(const std::filesystem::path& path, std::size_t block_size, std::optional<std::uint64_t> memory_limit) : handle(archive_read_new())
+    {
+        if (!handle)
+            throw Error("cannot allocate archive reader");
+        archive_read_support_filter_all(handle);
+        archive_read_support_format_all(handle);
+        auto status = ARCHIVE_OK;
+        auto const paths = volume_paths(path);
+        auto const encoded = Decoder::detect(paths.front());
+        if (paths.size() == 1 && !encoded) {
+            status = archive_read_open_filename(handle, paths.front().string().c_str(), block_size);
+        } else {
+            try {
+                volumes = std::make_unique<Volumes>(paths, block_size);
+                if (encoded)
+                    decoder = std::make_unique<Decoder>(*volumes, block_size, memory_limit);
+            } catch (...) {
+                archive_read_free(handle);
+                throw;
+            }
+            if (decoder) {
+                archive_read_set_read_callback(handle, Decoder::read_callback);
+                archive_read_set_callback_data(handle, decoder.get());
+            } else {
+                archive_read_set_read_callback(handle, Volumes::read_callback);
+                archive_read_set_skip_callback(handle, Volumes::skip_callback);
+                archive_read_set_seek_callback(handle, Volumes::seek_callback);
+                archive_read_set_callback_data(handle, volumes.get());
+            }
+            status = archive_read_open1(handle);
+        }
+        if (status != ARCHIVE_OK) {
+            auto error = Error(path.string() + ": " + archive_error_string(handle));
+            archive_read_free(handle);
+            throw error;
+        }
+    }
+    auto volume_path(const std::filesystem::path& base, std::size_t number) -> std::filesystem::path
+    {
+        auto suffix = std::to_string(number);
+        if (suffix.size() < 3)
+            suffix.insert(0, 3 - suffix.size(), '0');
+        auto name = base;
+        name += "." + suffix;
+        return name;
+    }
+
+    auto volume_paths(const std::filesystem::path& path) -> std::vector<std::filesystem::path>
+    {
+        auto error = std::error_code{};
+        auto base = path;
+        if (path.filename().string().ends_with(".001") && std::filesystem::exists(path, error))
+            base.replace_extension();
+        else if (std::filesystem::exists(path, error) || !std::filesystem::exists(volume_path(path, 1), error))
+            return {path};
+        auto volumes = std::vector<std::filesystem::path>{};
+        for (auto number = std::size_t{1}; std::filesystem::exists(volume_path(base, number), error); ++number)
+            volumes.push_back(volume_path(base, number));
+        return volumes;
+    }
+
+    Header::Header(Header&& other) noexcept : handle(std::exchange(other.handle, nullptr))
+    {}
+    Header& Header::operator=(Header&& other) noexcept
+    {
+        if (this != &other) {
+            if (handle)
+                archive_entry_free(handle);
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    Header::~Header()
+    {
+        if (handle)
+            archive_entry_free(handle);
+    }
+
+    auto Header::size() const -> std::optional<std::uint64_t>
+    {
+        if (!archive_entry_size_is_set(handle))
+            return std::nullopt;
+        return static_cast<std::uint64_t>(archive_entry_size(handle));
+    }
+    void Header::set_size(std::uint64_t size)
+    {
+        archive_entry_set_size(handle, static_cast<la_int64_t>(size));
+    }
+
+    Reader::Reader(Reader&& other) noexcept : handle(std::exchange(other.handle, nullptr)), volumes(std::move(other.volumes)), decoder(std::move(other.decoder)), current(std::exchange(other.current, nullptr)), entry(other.entry), data_offset(other.data_offset), filter(std::move(other.filter))
+    {}
+    Reader& Reader::operator=(Reader&& other) noexcept
+    {
+        if (this != &other) {
+            if (handle)
+                archive_read_free(handle);
+            handle = std::exchange(other.handle, nullptr);
+            volumes = std::move(other.volumes);
+            decoder = std::move(other.decoder);
+            current = std::exchange(other.current, nullptr);
+            entry = other.entry;
+            data_offset = other.data_offset;
+            filter = std::move(other.filter);
+        }
+        return *this;
+    }
+    Reader::~Reader()
+    {
+        if (handle)
+            archive_read_free(handle);
+    }
+
+    void Reader::check(int status) const
+    {
+        if (status < ARCHIVE_WARN)
+            throw Error(archive_error_string(handle));
+    }
+
+    void Reader::set_filter(PathFilter path_filter)
+    {
+        filter = std::move(path_filter);
+    }
+
+    auto Reader::next() -> std::optional<std::reference_wrapper<const Entry>>
+    {
+        archive_entry* header = nullptr;
+        const char* path = nullptr;
+        do {
+            auto const status = archive_read_next_header(handle, &header);
+            if (status == ARCHIVE_EOF) {
+                current = nullptr;
+                return std::nullopt;
+            }
+            check(status);
+            path = archive_entry_pathname_utf8(header);
+            if (!path)
+                path = archive_entry_pathname(header);
+        } while (filter && !filter->matches(path ? path : ""));
+        current = header;
+
+        auto const link = archive_entry_symlink_utf8(header);
+        entry.path = path ? path : "";
+        entry.link_target = link ? std::string_view(link) : std::string_view{};
+        switch (archive_entry_filetype(header)) {
+            case AE_IFREG: entry.type = EntryType::File; break;
+            case AE_IFDIR: entry.type = EntryType::Directory; break;
+            case AE_IFLNK: entry.type = EntryType::Symlink; break;
+            default: entry.type = EntryType::Other; break;
+        }
+        entry.size = archive_entry_size_is_set(header) ? std::optional<std::uint64_t>(archive_entry_size(header)) : std::nullopt;
+        entry.mtime = archive_entry_mtime(header);
+        entry.mode = archive_entry_perm(header);
+
+        // Past the header, the bytes consumed from the unfiltered stream are
+        // the file offset of the entry data for tar archives in one file.
+        auto const is_tar = (archive_format(handle) & ARCHIVE_FORMAT_BASE_MASK) == ARCHIVE_FORMAT_TAR;
+        auto const is_plain = archive_filter_count(handle) == 1 && archive_filter_code(handle, 0) == ARCHIVE_FILTER_NONE;
+        if (is_tar && is_plain && !volumes && entry.type == EntryType::File && entry.size && archive_entry_sparse_count(header) == 0)
+            data_offset = static_cast<std::uint64_t>(archive_filter_bytes(handle, 0));
+        else
+            data_offset = std::nullopt;
+        return std::cref(entry);
+    }
+
+    auto Reader::read(std::span<std::byte> buffer) -> std::size_t
+    {
+        auto const count = archive_read_data(handle, buffer.data(), buffer.size());
+        if (count < 0)
+            throw Error(archive_error_string(handle));
+        return static_cast<std::size_t>(count);
+    }
+
+    auto Reader::read_block() -> std::optional<Block>
+    {
+        const void* data = nullptr;
+        auto size = std::size_t{0};
+        auto offset = la_int64_t{0};
+        auto const status = archive_read_data_block(handle, &data, &size, &offset);
+        if (status == ARCHIVE_EOF)
+            return std::nullopt;
+        check(status);
+        return Block{
+            .data = std::span(static_cast<const std::byte*>(data), size),
+            .offset = static_cast<std::uint64_t>(offset),
+        };
+    }
+
+    void Reader::skip()
+    {
+        check(archive_read_data_skip(handle));
+    }
+
+    auto Reader::stored_offset() const -> std::optional<std::uint64_t>
+    {
+        return data_offset;
+    }
+
+    auto Reader::header() const -> Header
+    {
+        if (!current)
+            throw Error("no current entry");
+        auto const copy = archive_entry_clone(current);
+        if (!copy)
+            throw Error("cannot copy entry header");
+        return Header(copy);
+    }
+
+    auto Reader::format_name() const -> std::string_view
+    {
+        auto const name = archive_format_name(handle);
+        return name ? name : "";
+    }
+
+} // namespace zfiles
@@ -0,0 +1,69 @@
+#include <zfiles/scheduler.h>
+#include <algorithm>
+#include <utility>
+
+namespace zfiles {
+
+    Scheduler::Scheduler(std::size_t concurrency)
+    {
+        concurrency = std::max<std::size_t>(concurrency, 1);
+        workers.reserve(concurrency);
+        for (auto i = std::size_t{0}; i < concurrency; ++i)
+            workers.emplace_back([this] { work(); });
+    }
+
+    Scheduler::~Scheduler()
+    {
+        {
+            auto lock = std::lock_guard(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    void Scheduler::submit(std::function<void()> task)
+    {
+        {
+            auto lock = std::lock_guard(mutex);
+            tasks.push_back(std::move(task));
+        }
+        ready.notify_one();
+    }
+
+    void Scheduler::wait()
+    {
+        auto lock = std::unique_lock(mutex);
+        idle.wait(lock, [this] { return tasks.empty() && running == 0; });
+        if (failure)
+            std::rethrow_exception(std::exchange(failure, nullptr));
+    }
+
+    void Scheduler::work()
+    {
+        auto lock = std::unique_lock(mutex);
+        while (true) {
+            ready.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            auto task = std::move(tasks.front());
+            tasks.pop_front();
+            ++running;
+            lock.unlock();
+            try {
+                task();
+            } catch (...) {
+                lock.lock();
+                if (!failure)
+                    failure = std::current_exception();
+                lock.unlock();
+            }
+            lock.lock();
+            --running;
+            if (tasks.empty() && running == 0)
+                idle.notify_all();
+        }
+    }
+
+} // namespace zfiles
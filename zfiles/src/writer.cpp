@@ -0,0 +1,591 @@
+#include <zfiles/writer.h>
+#include <zfiles/adaptive_level.h>
+#include <zfiles/context_pool.h>
+#include <zfiles/entropy.h>
+#include <zfiles/scheduler.h>
+#include <archive.h>
+#include <archive_entry.h>
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace zfiles {
+
+    namespace {
+        struct Layout {
+            std::string_view suffix;
+            const char* format;
+            const char* filter;
+        };
+        constexpr auto layouts = std::array{
+            Layout{ ".tar", "pax", nullptr },
+            Layout{ ".tar.gz", "pax", "gzip" },
+            Layout{ ".tgz", "pax", "gzip" },
+            Layout{ ".tar.bz2", "pax", "bzip2" },
+            Layout{ ".tbz2", "pax", "bzip2" },
+            Layout{ ".tar.xz", "pax", "xz" },
+            Layout{ ".txz", "pax", "xz" },
+            Layout{ ".tar.zst", "pax", "zstd" },
+            Layout{ ".tzst", "pax", "zstd" },
+            Layout{ ".tar.lz4", "pax", "lz4" },
+            Layout{ ".zip", "zip", nullptr },
+            Layout{ ".jar", "zip", nullptr },
+            Layout{ ".7z", "7zip", nullptr },
+            Layout{ ".cpio", "cpio", nullptr },
+        };
+
+        // Smaller files are compressed whatever they hold: a zstd frame of
+        // their own would cost more than it saves.
+        constexpr auto incompressible_minimum = std::uint64_t{16} << 10;
+
+        auto find_layout(const std::filesystem::path& path) -> const Layout*
+        {
+            auto name = path.filename().string();
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            auto const found = std::find_if(layouts.begin(), layouts.end(), [&](const Layout& layout) {
+                return name.size() > layout.suffix.size() && name.ends_with(layout.suffix);
+            });
+            return found == layouts.end() ? nullptr : &*found;
+        }
+    }
+
+    // Pieces of the archive stream on their way to the volume files. They are
+    // queued, then written by tasks of the scheduler, or by the writing thread
+    // itself when it has to wait for them: a writer running as a task of the
+    // same scheduler never waits on tasks queued behind it.
+    class Writer::Volumes {
+    public:
+        Volumes(const std::filesystem::path& path, std::uint64_t size, Scheduler* scheduler)
+            : path(path), size(size), scheduler(scheduler), queue(std::make_shared<Queue>()) {}
+
+        void write(std::span<const std::byte> data) {
+            while (!data.empty()) {
+                auto const offset = written % size;
+                if (offset == 0)
+                    open_next();
+                auto const count = static_cast<std::size_t>(std::min<std::uint64_t>({data.size(), size - offset, piece_size - piece.size()}));
+                piece.insert(piece.end(), data.begin(), data.begin() + static_cast<std::ptrdiff_t>(count));
+                data = data.subspan(count);
+                written += count;
+                if (piece.size() == piece_size || written % size == 0)
+                    flush();
+            }
+        }
+
+        void close() {
+            flush();
+            file.reset();
+            {
+                auto lock = std::unique_lock(queue->mutex);
+                queue->wait_below(0, lock);
+                if (queue->failure)
+                    throw std::system_error(queue->failure, std::generic_category(), "write volume");
+            }
+            // Volumes left over from a longer archive would be read as part of this one.
+            auto error = std::error_code{};
+            for (auto number = count + 1; std::filesystem::remove(volume_path(path, number), error); ++number) {}
+        }
+
+        // libarchive callbacks; errors cannot cross them as exceptions.
+        static auto write_callback(archive* handle, void* volumes, const void* data, std::size_t size) -> la_ssize_t {
+            try {
+                static_cast<Volumes*>(volumes)->write(std::span(static_cast<const std::byte*>(data), size));
+                return static_cast<la_ssize_t>(size);
+            } catch (const std::exception& error) {
+                archive_set_error(handle, EIO, "%s", error.what());
+                return -1;
+            }
+        }
+        static auto close_callback(archive* handle, void* volumes) -> int {
+            try {
+                static_cast<Volumes*>(volumes)->close();
+                return ARCHIVE_OK;
+            } catch (const std::exception& error) {
+                archive_set_error(handle, EIO, "%s", error.what());
+                return ARCHIVE_FATAL;
+            }
+        }
+
+    private:
+        static constexpr auto piece_size = std::size_t{4} << 20;
+        // Pieces handed over but not written yet are capped at this many bytes.
+        static constexpr auto max_pending = std::size_t{64} << 20;
+
+        struct File {
+            int fd;
+            explicit File(const std::filesystem::path& path) : fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) {
+                if (fd < 0)
+                    throw Error(path.string() + ": " + std::strerror(errno));
+            }
+            File(const File&) = delete;
+            File& operator=(const File&) = delete;
+            ~File() { ::close(fd); }
+        };
+        struct Piece {
+            // The file closes once its last piece is written.
+            std::shared_ptr<File> file;
+            std::uint64_t offset;
+            std::vector<std::byte> data;
+        };
+        // Shared with the tasks, which may run after the writer is gone.
+        struct Queue {
+            std::mutex mutex;
+            std::condition_variable drained;
+            std::deque<Piece> pieces;
+            // Bytes queued or being written
+            std::size_t pending = 0;
+            // errno of the first failed write
+            int failure = 0;
+
+            // Writes the oldest queued piece, if there is one left.
+            auto write_one(std::unique_lock<std::mutex>& lock) -> bool {
+                if (pieces.empty())
+                    return false;
+                auto piece = std::move(pieces.front());
+                pieces.pop_front();
+                lock.unlock();
+                auto const error = write_piece(piece);
+                lock.lock();
+                pending -= piece.data.size();
+                if (error && !failure)
+                    failure = error;
+                drained.notify_all();
+                return true;
+            }
+            // Until at most `limit` bytes are pending, writing queued pieces meanwhile
+            void wait_below(std::size_t limit, std::unique_lock<std::mutex>& lock) {
+                while (pending > limit) {
+                    if (!write_one(lock))
+                        drained.wait(lock);
+                }
+            }
+        };
+
+        // errno of the write, or 0
+        static auto write_piece(const Piece& piece) -> int {
+            auto done = std::size_t{0};
+            while (done < piece.data.size()) {
+                auto const count = ::pwrite(piece.file->fd, piece.data.data() + done, piece.data.size() - done, static_cast<off_t>(piece.offset + done));
+                if (count < 0 && errno == EINTR)
+                    continue;
+                if (count < 0)
+                    return errno;
+                done += static_cast<std::size_t>(count);
+            }
+            return 0;
+        }
+
+        void open_next() {
+            flush();
+            file = std::make_shared<File>(volume_path(path, ++count));
+            piece_offset = 0;
+        }
+
+        // Queues the current piece, for a task to write, or writes it without a scheduler.
+        void flush() {
+            if (piece.empty())
+                return;
+            auto const piece_bytes = piece.size();
+            {
+                auto lock = std::unique_lock(queue->mutex);
+                queue->wait_below(max_pending - piece_bytes, lock);
+                if (queue->failure)
+                    throw std::system_error(queue->failure, std::generic_category(), "write volume");
+                queue->pending += piece_bytes;
+                queue->pieces.push_back(Piece{ .file = file, .offset = piece_offset, .data = std::exchange(piece, {}) });
+                if (!scheduler)
+                    queue->write_one(lock);
+            }
+            piece_offset += piece_bytes;
+            if (scheduler) {
+                scheduler->submit([queue = queue] {
+                    auto lock = std::unique_lock(queue->mutex);
+                    queue->write_one(lock);
+                });
+            }
+            piece.reserve(piece_size);
+        }
+
+        std::filesystem::path path;
+        std::uint64_t size;
+        Scheduler* scheduler;
+        std::uint64_t written = 0;
+        std::size_t count = 0;
+        std::shared_ptr<File> file;
+        std::vector<std::byte> piece;
+        std::uint64_t piece_offset = 0;
+        std::shared_ptr<Queue> queue;
+    };
+
+    // zstd stream the archive goes through on its way to the file or to the
+    // volumes. The window is the level's own, or the long-distance one, cut
+    // down to the memory limit.
+    class Writer::Encoder {
+    public:
+        Encoder(const std::filesystem::path& path, Volumes* volumes, const WriteOptions& options) : volumes(volumes), context(ZstdCompressorPool::acquire()), output(ZSTD_CStreamOutSize()) {
+            auto const level = options.level.value_or(ZSTD_CLEVEL_DEFAULT);
+            window = options.long_window.value_or(static_cast<int>(ZSTD_getCParams(level, 0, 0).windowLog));
+            if (options.memory_limit)
+                window = std::min(window, static_cast<int>(std::bit_width(*options.memory_limit)) - 1);
+            window = std::clamp(window, ZSTD_WINDOWLOG_MIN, ZSTD_WINDOWLOG_MAX);
+            current = level;
+            if (options.adaptive_level) {
+                if (options.long_window)
+                    throw Error("an adaptive level would cut the long-distance window at each change");
+                adaptive.emplace(adaptive_min_level, adaptive_max_level, level, options.target_rate);
+                current = adaptive->level();
+            }
+            // The window stays the same across level changes.
+            set(ZSTD_c_compressionLevel, current);
+            set(ZSTD_c_windowLog, window);
+            if (options.long_window)
+                set(ZSTD_c_enableLongDistanceMatching, 1);
+            if (!volumes) {
+                fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+                if (fd < 0)
+                    throw Error(path.string() + ": " + std::strerror(errno));
+            }
+        }
+        Encoder(const Encoder&) = delete;
+        Encoder& operator=(const Encoder&) = delete;
+        ~Encoder() {
+            if (fd >= 0)
+                ::close(fd);
+        }
+
+        // With an adaptive level, the time spent outside the encoder over a
+        // block is the time the input took to come.
+        void write(std::span<const std::byte> data) {
+            auto const start = Clock::now();
+            compress(data, ZSTD_e_continue);
+            stats.bytes_by_level[current] += data.size();
+            if (!adaptive)
+                return;
+            auto const end = Clock::now();
+            compress_time += end - start;
+            block_bytes += data.size();
+            if (block_bytes < adaptive_block)
+                return;
+            auto const level = adaptive->update(block_bytes, (end - block_start) - compress_time, compress_time);
+            block_bytes = 0;
+            compress_time = {};
+            block_start = end;
+            set_level(level);
+        }
+        // Level of the data that follows; a change ends the frame.
+        void set_level(int level) {
+            if (level == current)
+                return;
+            compress({}, ZSTD_e_end);
+            set(ZSTD_c_compressionLevel, level);
+            current = level;
+        }
+        auto level() const -> int {
+            return current;
+        }
+        void close() {
+            compress({}, ZSTD_e_end);
+            if (volumes) {
+                volumes->close();
+            } else if (::close(std::exchange(fd, -1)) != 0) {
+                throw std::system_error(errno, std::generic_category(), "write archive");
+            }
+        }
+        auto window_log() const -> int {
+            return window;
+        }
+
+        WriteStats stats;
+
+        // libarchive callbacks; errors cannot cross them as exceptions.
+        static auto write_callback(archive* handle, void* encoder, const void* data, std::size_t size) -> la_ssize_t {
+            try {
+                static_cast<Encoder*>(encoder)->write(std::span(static_cast<const std::byte*>(data), size));
+                return static_cast<la_ssize_t>(size);
+            } catch (const std::exception& error) {
+                archive_set_error(handle, EIO, "%s", error.what());
+                return -1;
+            }
+        }
+        static auto close_callback(archive* handle, void* encoder) -> int {
+            try {
+                static_cast<Encoder*>(encoder)->close();
+                return ARCHIVE_OK;
+            } catch (const std::exception& error) {
+                archive_set_error(handle, EIO, "%s", error.what());
+                return ARCHIVE_FATAL;
+            }
+        }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+        // Levels above 19 need more memory than their gain is worth here.
+        static constexpr auto adaptive_min_level = 1;
+        static constexpr auto adaptive_max_level = 19;
+        static constexpr auto adaptive_block = std::size_t{1} << 20;
+
+        static void check(std::size_t status) {
+            if (ZSTD_isError(status))
+                throw Error(std::string("zstd: ") + ZSTD_getErrorName(status));
+        }
+        void set(ZSTD_cParameter parameter, int value) {
+            check(ZSTD_CCtx_setParameter(context.get(), parameter, value));
+        }
+        void compress(std::span<const std::byte> data, ZSTD_EndDirective mode) {
+            auto in = ZSTD_inBuffer{ data.data(), data.size(), 0 };
+            auto left = std::size_t{1};
+            while (in.pos < in.size || (mode == ZSTD_e_end && left != 0)) {
+                auto out = ZSTD_outBuffer{ output.data(), output.size(), 0 };
+                left = ZSTD_compressStream2(context.get(), &out, &in, mode);
+                check(left);
+                emit(std::span(output).first(out.pos));
+            }
+        }
+        void emit(std::span<const std::byte> data) {
+            if (volumes) {
+                volumes->write(data);
+                return;
+            }
+            while (!data.empty()) {
+                auto const count = ::write(fd, data.data(), data.size());
+                if (count < 0 && errno == EINTR)
+                    continue;
+                if (count < 0)
+                    throw std::system_error(errno, std::generic_category(), "write archive");
+                data = data.subspan(static_cast<std::size_t>(count));
+            }
+        }
+
+        Volumes* volumes;
+        int fd = -1;
+        ZstdCompressorPool::Lease context;
+        std::vector<std::byte> output;
+        int window = 0;
+        int current = 0;
+        std::optional<AdaptiveLevel> adaptive;
+        // Block being measured
+        std::size_t block_bytes = 0;
+        Clock::time_point block_start = Clock::now();
+        Clock::duration compress_time{};
+    };
+
+    Writer::Writer(const std::filesystem::path& path, const WriteOptions& options) : handle(archive_write_new())
+    {
+        if (!handle)
+            throw Error("cannot allocate archive writer");
+        try {
+            auto const layout = find_layout(path);
+            if (!layout)
+                throw Error(path.string() + ": unknown archive type");
+            auto const encoded = layout->filter && std::string_view(layout->filter) == "zstd";
+            if (!encoded && (options.long_window || options.memory_limit))
+                throw Error(path.string() + ": long-distance matching and memory limits need zstd compression");
+            if (!encoded && options.adaptive_level)
+                throw Error(path.string() + ": an adaptive level needs zstd compression");
+            check(archive_write_set_format_by_name(handle, layout->format));
+            if (layout->filter && !encoded)
+                check(archive_write_add_filter_by_name(handle, layout->filter));
+            if (options.level && !encoded)
+                check(archive_write_set_option(handle, nullptr, "compression-level", std::to_string(*options.level).c_str()));
+            if (options.volume_size) {
+                if (*options.volume_size == 0)
+                    throw Error("volume size must not be 0");
+                // A whole archive left under the base name would hide the volumes from readers.
+                std::filesystem::remove(path);
+                volumes = std::make_unique<Volumes>(path, *options.volume_size, options.scheduler);
+            }
+            zip = std::string_view(layout->format) == "zip";
+            // A frame of its own would cut long-distance matches, and the
+            // adaptive level is left to its measurements.
+            auto const per_entry = encoded ? !options.long_window && !options.adaptive_level : zip && options.level != 0;
+            sniff = options.skip_incompressible && per_entry;
+            if (options.policy && !per_entry)
+                throw Error(path.string() + ": a policy needs zip or zstd compression, with neither long-distance matching nor an adaptive level");
+            policy = options.policy;
+            if (encoded) {
+                encoder = std::make_unique<Encoder>(path, volumes.get(), options);
+                level = encoder->level();
+                // Handed over as it comes: the encoder buffers.
+                check(archive_write_set_bytes_per_block(handle, 0));
+                check(archive_write_open2(handle, encoder.get(), nullptr, Encoder::write_callback, Encoder::close_callback, nullptr));
+            } else if (volumes) {
+                check(archive_write_set_bytes_in_last_block(handle, 1));
+                check(archive_write_open2(handle, volumes.get(), nullptr, Volumes::write_callback, Volumes::close_callback, nullptr));
+            } else {
+                check(archive_write_open_filename(handle, path.string().c_str()));
+            }
+        } catch (...) {
+            archive_write_free(handle);
+            throw;
+        }
+    }
+    Writer::Writer(Writer&& other) noexcept
+        : handle(std::exchange(other.handle, nullptr)), disk(std::exchange(other.disk, nullptr)), volumes(std::move(other.volumes)), encoder(std::move(other.encoder)), buffer(std::move(other.buffer)),
+          sniff(other.sniff), zip(other.zip), policy(other.policy), level(other.level), statistics(std::move(other.statistics))
+    {}
+    Writer& Writer::operator=(Writer&& other) noexcept
+    {
+        if (this != &other) {
+            if (handle)
+                archive_write_free(handle);
+            if (disk)
+                archive_read_free(disk);
+            handle = std::exchange(other.handle, nullptr);
+            disk = std::exchange(other.disk, nullptr);
+            volumes = std::move(other.volumes);
+            encoder = std::move(other.encoder);
+            buffer = std::move(other.buffer);
+            sniff = other.sniff;
+            zip = other.zip;
+            policy = other.policy;
+            level = other.level;
+            statistics = std::move(other.statistics);
+        }
+        return *this;
+    }
+    Writer::~Writer()
+    {
+        // Freeing the handle closes the archive, which still writes into the volumes.
+        if (handle)
+            archive_write_free(handle);
+        if (disk)
+            archive_read_free(disk);
+    }
+
+    auto Writer::supports(const std::filesystem::path& path) -> bool
+    {
+        return find_layout(path) != nullptr;
+    }
+
+    auto Writer::same_layout(const std::filesystem::path& a, const std::filesystem::path& b) -> bool
+    {
+        auto const first = find_layout(a);
+        auto const second = find_layout(b);
+        return first && second && std::string_view(first->format) == second->format
+            && std::string_view(first->filter ? first->filter : "") == (second->filter ? second->filter : "");
+    }
+
+    void Writer::check(int status) const
+    {
+        if (status != ARCHIVE_OK)
+            throw Error(archive_error_string(handle) ? archive_error_string(handle) : "archive write error");
+    }
+
+    void Writer::add(Header& header)
+    {
+        archive_entry_sparse_clear(header.handle);
+        auto const status = archive_write_header(handle, header.handle);
+        // Attributes the format cannot store are dropped with a warning.
+        if (status < ARCHIVE_WARN)
+            check(status);
+    }
+
+    void Writer::write(std::span<const std::byte> data)
+    {
+        while (!data.empty()) {
+            auto const written = archive_write_data(handle, data.data(), data.size());
+            if (written < 0)
+                throw Error(archive_error_string(handle));
+            if (written == 0)
+                throw Error("entry data longer than its header says");
+            data = data.subspan(static_cast<std::size_t>(written));
+        }
+    }
+
+    void Writer::add_file(const std::filesystem::path& source, std::string_view name)
+    {
+        if (!disk) {
+            disk = archive_read_disk_new();
+            if (!disk)
+                throw Error("cannot allocate disk reader");
+            archive_read_disk_set_standard_lookup(disk);
+        }
+        auto const entry = archive_entry_new();
+        if (!entry)
+            throw Error("cannot allocate entry header");
+        auto header = Header(entry);
+        archive_entry_copy_pathname(entry, std::string(name).c_str());
+        archive_entry_copy_sourcepath(entry, source.c_str());
+        if (archive_read_disk_entry_from_file(disk, entry, -1, nullptr) < ARCHIVE_WARN)
+            throw Error(source.string() + ": " + archive_error_string(disk));
+        if (archive_entry_filetype(entry) != AE_IFREG) {
+            add(header);
+            return;
+        }
+
+        auto file = std::ifstream(source, std::ios::binary);
+        if (!file)
+            throw Error(source.string() + ": cannot open");
+        buffer.resize(std::size_t{1} << 20);
+        auto const size = static_cast<std::uint64_t>(archive_entry_size(entry));
+        // The first block is read before the header, which depends on it in zip.
+        auto read = [&](std::uint64_t left) {
+            file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(std::min<std::uint64_t>(left, buffer.size())));
+            return static_cast<std::size_t>(file.gcount());
+        };
+        auto count = read(size);
+        auto const sample = std::span(buffer).first(std::min(count, entropy_sample_size));
+        auto rule = std::optional<CodecRule>{};
+        auto counted = static_cast<FileCount*>(nullptr);
+        if (policy && size >= incompressible_minimum) {
+            auto const content_class = classify(sample);
+            rule = policy->rule(content_class);
+            counted = &statistics.classes[content_class];
+        } else if (sniff && size >= incompressible_minimum && is_incompressible(sample)) {
+            rule = CodecRule{ .level = 1, .store = true };
+            counted = &statistics.incompressible;
+        }
+        // The level stays until a file needs another, which keeps frames long.
+        if (encoder)
+            encoder->set_level(!rule ? level : rule->store ? 1 : rule->level);
+        auto const store = zip && rule && rule->store;
+        if (store)
+            check(archive_write_zip_set_compression_store(handle));
+        add(header);
+        if (store)
+            check(archive_write_zip_set_compression_deflate(handle));
+        // A file growing while it is read is cut to the size in its header.
+        for (auto left = size; left > 0 && count > 0; count = read(left)) {
+            write(std::span(buffer).first(count));
+            left -= count;
+        }
+        if (counted) {
+            ++counted->files;
+            counted->bytes += size;
+        }
+    }
+
+    void Writer::close()
+    {
+        check(archive_write_close(handle));
+    }
+
+    auto Writer::window_log() const -> int
+    {
+        return encoder ? encoder->window_log() : 0;
+    }
+
+    auto Writer::stats() const -> WriteStats
+    {
+        auto stats = statistics;
+        if (encoder)
+            stats.bytes_by_level = encoder->stats.bytes_by_level;
+        return stats;
+    }
+
+} // namespace zfiles
@@ -2,7 +2,7 @@
 target("zfiles")
     set_kind("shared")
     set_languages("cxxlatest", "clatest")
-    add_packages("libarchive")
+    add_packages("libarchive", "zstd", "zlib", "xz")
     add_files("src/*.cpp")
-    add_headerfiles("src/*.h")
-    add_includedirs("include")
\ No newline at end of file
+    add_headerfiles("include/(zfiles/*.h)")
+    add_includedirs("include", {public = true})
\ No newline at end of file